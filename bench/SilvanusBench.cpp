@@ -0,0 +1,423 @@
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "Adafruit_SHT31.hpp"
+#include "HttpRouteTable.hpp"
+#include "I2CDevice.hpp"
+#include "SampleHistory.hpp"
+#include "SensorFilter.hpp"
+#include "StaticFileCache.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <fmt/format.h>
+
+using json = nlohmann::json;
+
+// Usage: silvanus_bench [--filter <substring>] [--json <file>] [--samples <n>]
+//
+// Every benchmark is run as a number of samples, each sample timing a batch
+// of iterations sized to take about a millisecond. The spread of the per-op
+// time across samples gives the percentiles. Heap allocations are counted by
+// replacing the global operator new, so allocs/op is exact.
+
+static std::atomic<uint64_t> allocationCount{0};
+
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+// Keep the compiler from optimizing a result away
+template <typename T>
+static void doNotOptimize(T const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchResult
+{
+    std::string name;
+    uint64_t iterations;
+    double meanNs;
+    double p50Ns;
+    double p90Ns;
+    double p99Ns;
+    double allocsPerOp;
+};
+
+class BenchRunner
+{
+public:
+    BenchRunner(std::string filter, int samples) : filter_(filter), samples_(samples) { }
+
+    void Run(const std::string& name, const std::function<void()>& op)
+    {
+        using clock = std::chrono::steady_clock;
+        if (!filter_.empty() && name.find(filter_) == std::string::npos)
+            return;
+
+        // Warm up and size the batch so one sample takes roughly 1 ms
+        uint64_t batch = 1;
+        while (true)
+        {
+            auto start = clock::now();
+            for (uint64_t i = 0; i < batch; i++) op();
+            auto elapsed = clock::now() - start;
+            if (elapsed >= std::chrono::milliseconds(1) || batch >= (1u << 24))
+                break;
+            batch *= 2;
+        }
+
+        std::vector<double> perOp;
+        perOp.reserve(samples_);
+        uint64_t allocsBefore = allocationCount.load();
+        auto totalStart = clock::now();
+        for (int s = 0; s < samples_; s++)
+        {
+            auto start = clock::now();
+            for (uint64_t i = 0; i < batch; i++) op();
+            auto elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            perOp.push_back(elapsed / batch);
+        }
+        double totalNs = std::chrono::duration<double, std::nano>(clock::now() - totalStart).count();
+        uint64_t allocs = allocationCount.load() - allocsBefore;
+        // The perOp vector was reserved up front so the loop above did not allocate
+
+        std::sort(perOp.begin(), perOp.end());
+        uint64_t iterations = batch * samples_;
+        BenchResult result;
+        result.name = name;
+        result.iterations = iterations;
+        result.meanNs = totalNs / iterations;
+        result.p50Ns = percentile(perOp, 0.50);
+        result.p90Ns = percentile(perOp, 0.90);
+        result.p99Ns = percentile(perOp, 0.99);
+        result.allocsPerOp = (double)allocs / iterations;
+        results_.push_back(result);
+
+        std::cout << fmt::format("{:<36} {:>12.1f} {:>12.1f} {:>12.1f} {:>12.1f} {:>10.2f}",
+                                 result.name, result.meanNs, result.p50Ns, result.p90Ns, result.p99Ns, result.allocsPerOp) << std::endl;
+    }
+
+    json ResultsJson() const
+    {
+        json out = json::array();
+        for (const auto& r : results_)
+        {
+            out.push_back({
+                {"name", r.name},
+                {"iterations", r.iterations},
+                {"ns_per_op", r.meanNs},
+                {"p50_ns", r.p50Ns},
+                {"p90_ns", r.p90Ns},
+                {"p99_ns", r.p99Ns},
+                {"allocs_per_op", r.allocsPerOp}
+            });
+        }
+        return out;
+    }
+
+private:
+    static double percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty()) return 0.0;
+        size_t idx = std::min(sorted.size() - 1, (size_t)(p * (sorted.size() - 1) + 0.5));
+        return sorted[idx];
+    }
+
+    std::string filter_;
+    int samples_;
+    std::vector<BenchResult> results_;
+};
+
+// Talks to a fake SHT31 on the other end of a socketpair, so a round trip
+// costs the same syscalls as the real bus without the sensor's conversion delay
+template <typename Bus>
+class MockSensor final : public BasicI2CDevice<Bus>
+{
+public:
+    explicit MockSensor(Bus&& bus) : BasicI2CDevice<Bus>(std::move(bus)) { }
+    bool RoundTrip(uint8_t* frame)
+    {
+        return this->readI2C(SHT31_MEAS_HIGHREP, frame, 6, 0.0);
+    }
+};
+
+static void mockDeviceThreadFunc(int fd, const uint8_t* frame)
+{
+    uint8_t cmd[16];
+    while (read(fd, cmd, sizeof(cmd)) > 0)
+    {
+        if (write(fd, frame, 6) != 6)
+            break;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string filter;
+    std::string jsonPath;
+    int samples = 200;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) filter = argv[++i];
+        else if (arg == "--json" && i + 1 < argc) jsonPath = argv[++i];
+        else if (arg == "--samples" && i + 1 < argc) samples = std::max(1, atoi(argv[++i]));
+        else
+        {
+            std::cerr << "Usage: silvanus_bench [--filter <substring>] [--json <file>] [--samples <n>]" << std::endl;
+            return 1;
+        }
+    }
+
+    config.Init();
+    BenchRunner bench(filter, samples);
+
+    std::cout << fmt::format("{:<36} {:>12} {:>12} {:>12} {:>12} {:>10}",
+                             "benchmark", "ns/op", "p50 ns", "p90 ns", "p99 ns", "allocs/op") << std::endl;
+
+    // ConfigService
+    config.SetConfigValue("benchmark.nested.value", 42);
+    config.SetConfigValue("benchmarkFlat", 1.5f);
+    bench.Run("config/GetConfigValue/flat", [&]()
+    {
+        doNotOptimize(config.GetConfigValue("benchmarkFlat", 0.0f));
+    });
+    bench.Run("config/GetConfigValue/nested", [&]()
+    {
+        doNotOptimize(config.GetConfigValue("benchmark.nested.value", 0));
+    });
+    int toggle = 0;
+    bench.Run("config/SetConfigValue/changed", [&]()
+    {
+        config.SetConfigValue("benchmark.nested.value", toggle++ & 1);
+    });
+    bench.Run("config/SetConfigValue/unchanged", [&]()
+    {
+        config.SetConfigValue("benchmark.nested.value", 1);
+    });
+    bench.Run("config/splitKeyPath", [&]()
+    {
+        doNotOptimize(ConfigService::splitKeyPath("benchmark.nested.value"));
+    });
+
+    // Same construction and serialization as the /status handler
+    bench.Run("status/build+serialize", [&]()
+    {
+        auto status = json::object();
+        status["temperature"] = 21.5f;
+        status["humidity"] = 48.25f;
+        status["light-on"] = true;
+        status["pump-on"] = false;
+        std::stringstream ss;
+        ss << std::setw(4) << status;
+        doNotOptimize(ss.str());
+    });
+
+    // SHT31 frame handling
+    uint8_t goodFrame[6] = {0x66, 0x66, 0, 0x7A, 0xE1, 0};
+    goodFrame[2] = Adafruit_SHT31::crc8(goodFrame, 2);
+    goodFrame[5] = Adafruit_SHT31::crc8(goodFrame + 3, 2);
+    bench.Run("sht31/crc8", [&]()
+    {
+        doNotOptimize(Adafruit_SHT31::crc8(goodFrame, 2));
+    });
+    bench.Run("sht31/decodeTempHum", [&]()
+    {
+        float t, h;
+        doNotOptimize(Adafruit_SHT31::decodeTempHum(goodFrame, &t, &h));
+        doNotOptimize(t);
+        doNotOptimize(h);
+    });
+
+    // I2C round trip against a mock device, directly and recorded to a
+    // file, then played back from the recording without and with the
+    // runtime backend's dispatch
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == 0)
+    {
+        std::thread device(mockDeviceThreadFunc, fds[1], goodFrame);
+        std::string recording = (std::filesystem::temp_directory_path() / "silvanus-bench-i2c.rec").string();
+        {
+            MockSensor<LinuxI2CBus> sensor(LinuxI2CBus(LinuxI2CBus::OpenFile{fds[0]}));
+            uint8_t readback[6];
+            bench.Run("i2c/readI2C/mock-roundtrip", [&]()
+            {
+                doNotOptimize(sensor.RoundTrip(readback));
+            });
+        } // closes fds[0], which ends the device thread
+        device.join();
+
+        int recordFds[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, recordFds) == 0)
+        {
+            std::thread recordDevice(mockDeviceThreadFunc, recordFds[1], goodFrame);
+            {
+                MockSensor<RecordingI2CBus<LinuxI2CBus>> sensor(RecordingI2CBus<LinuxI2CBus>(LinuxI2CBus(LinuxI2CBus::OpenFile{recordFds[0]}), recording));
+                uint8_t readback[6];
+                for (int i = 0; i < 16; i++)
+                {
+                    sensor.RoundTrip(readback);
+                }
+            }
+            recordDevice.join();
+            close(recordFds[1]);
+
+            MockSensor<ReplayI2CBus> replay{ReplayI2CBus(recording)};
+            MockSensor<RuntimeI2CBus> runtimeReplay{RuntimeI2CBus(ReplayI2CBus(recording))};
+            uint8_t readback[6];
+            bench.Run("i2c/readI2C/replay", [&]()
+            {
+                doNotOptimize(replay.RoundTrip(readback));
+            });
+            bench.Run("i2c/readI2C/runtime-replay", [&]()
+            {
+                doNotOptimize(runtimeReplay.RoundTrip(readback));
+            });
+            std::filesystem::remove(recording);
+        }
+        close(fds[1]);
+    }
+    else
+    {
+        std::cerr << "Skipping i2c benchmarks, socketpair failed." << std::endl;
+    }
+
+    // Route lookup as done by HttpService for every request, with the
+    // static files plus a few hundred extra routes to show it doesn't grow
+    std::filesystem::path webDir = std::filesystem::path(config.resourcePath()) / "Web";
+    if (std::filesystem::exists(webDir))
+    {
+        StaticFileCache web;
+        web.Load(webDir);
+        HttpRouteTable routes;
+        auto noop = [](const httplib::Request& req, httplib::Response& res) { };
+        for (const auto& [filename, file] : web.Files())
+        {
+            routes.Add("GET", "/" + filename, HttpRouteTable::Route{noop, RoutePriority::Static});
+        }
+        for (const char* path : {"/status", "/system/settings", "/metrics", "/light", "/pump"})
+        {
+            routes.Add("GET", path, HttpRouteTable::Route{noop, RoutePriority::Api});
+        }
+        for (int i = 0; i < 500; i++)
+        {
+            routes.Add("GET", fmt::format("/assets/file{}.js", i), HttpRouteTable::Route{noop, RoutePriority::Static});
+        }
+        std::string method = "GET";
+        std::string staticPath = "/silvanus.js";
+        std::string apiPath = "/status";
+        bench.Run("http/HttpRouteTable::Find/static", [&]()
+        {
+            doNotOptimize(routes.Find(method, staticPath));
+        });
+        bench.Run("http/HttpRouteTable::Find/api", [&]()
+        {
+            doNotOptimize(routes.Find(method, apiPath));
+        });
+    }
+    else
+    {
+        std::cerr << "Skipping route lookup benchmarks, " << webDir << " not found." << std::endl;
+    }
+
+    // A full ring of minute samples, about six days
+    {
+        auto ring = std::make_unique<RuntimeState::SampleRing>();
+        auto rollups = std::make_unique<RuntimeState::RollupRing>();
+        SampleHistory history(*ring, *rollups);
+        auto start = SampleHistory::Clock::now() - std::chrono::minutes(RuntimeState::SampleCapacity);
+        for (size_t i = 0; i < RuntimeState::SampleCapacity; i++)
+        {
+            history.Record(start + std::chrono::minutes(i), 20.0f + (i % 50) * 0.1f, 40.0f + (i % 70) * 0.5f);
+        }
+        auto next = SampleHistory::Clock::now();
+        bench.Run("history/Record", [&]()
+        {
+            next += std::chrono::minutes(1);
+            history.Record(next, 21.0f, 45.0f);
+        });
+        bench.Run("history/Aggregate/week-hourly", [&]()
+        {
+            doNotOptimize(history.Aggregate(next - std::chrono::hours(24 * 7), next, std::chrono::hours(1)));
+        });
+        bench.Run("history/Aggregate/month-daily", [&]()
+        {
+            doNotOptimize(history.Aggregate(next - std::chrono::hours(24 * 30), next, std::chrono::hours(24)));
+        });
+        bench.Run("history/Chart/week-500", [&]()
+        {
+            doNotOptimize(history.Chart(SampleHistory::Series::Humidity, next - std::chrono::hours(24 * 7), next, 500));
+        });
+        bench.Run("history/Range/week-scan", [&]()
+        {
+            doNotOptimize(history.Range(next - std::chrono::hours(24 * 7), next, RuntimeState::SampleCapacity));
+        });
+    }
+
+    // A full chain of every stage on one reading
+    {
+        SensorFilter filter;
+        std::string error;
+        filter.Configure(json::array({
+            {{"type", "outlier"}, {"window", 9}, {"threshold", 3}},
+            {{"type", "rate"}, {"max", 2}},
+            {{"type", "median"}, {"size", 5}},
+            {{"type", "kalman"}, {"q", 0.01}, {"r", 0.25}},
+            {{"type", "ema"}, {"alpha", 0.3}}
+        }), error);
+        float reading = 20.0f;
+        bench.Run("filter/Filter/all-stages", [&]()
+        {
+            reading = reading > 30.0f ? 20.0f : reading + 0.37f;
+            doNotOptimize(filter.Filter(reading));
+        });
+    }
+
+    if (!jsonPath.empty())
+    {
+        json report = {
+            {"samples", samples},
+            {"results", bench.ResultsJson()}
+        };
+        std::ofstream ofs(jsonPath, std::ofstream::out | std::ofstream::trunc);
+        ofs << std::setw(4) << report << std::endl;
+        if ((ofs.rdstate() & std::ofstream::failbit) != 0)
+        {
+            std::cerr << "Failed to write " << jsonPath << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
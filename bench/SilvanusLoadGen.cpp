@@ -0,0 +1,297 @@
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "ApiRoutes.hpp"
+#include "HttpService.hpp"
+#include "LatencyHistogram.hpp"
+#include "PlantSchedule.hpp"
+#include "SceneTable.hpp"
+#include "Silvanus.hpp"
+#include "StaticFileCache.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include <httplib.h>
+#include <nlohmann/json.hpp>
+#include <fmt/format.h>
+
+using json = nlohmann::json;
+
+// Usage: silvanus_loadgen [--duration <s>] [--concurrency <n>] [--mix <op=weight,...>]
+//                         [--probe-period-ms <ms>] [--json <file>]
+//
+// Starts the real HTTP API (same routes as the service, simulated hardware
+// and a scratch config, journal and runtime state) on a loopback port and drives it with a fixed number of closed-loop
+// clients. While the load runs, a probe thread sleeps to a fixed-period
+// deadline and records how late it wakes, and a pump pulse is kept going so
+// Silvanus' own off-deadline lateness is measured under the same load.
+//
+// Ops: status (GET /status), settings (GET /system/settings),
+//      patch (PATCH /system/settings), light (PUT /light), static (web assets)
+
+struct Operation
+{
+    std::string name;
+    int weight;
+    LatencyHistogram latency;
+    std::atomic<uint64_t> errors{0};
+};
+
+static bool parseMix(const std::string& mix, std::vector<std::unique_ptr<Operation>>& ops)
+{
+    std::stringstream ss(mix);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        auto eq = item.find('=');
+        if (eq == std::string::npos)
+            return false;
+        std::string name = item.substr(0, eq);
+        int weight = atoi(item.substr(eq + 1).c_str());
+        bool known = false;
+        for (auto& op : ops)
+        {
+            if (op->name == name)
+            {
+                op->weight = weight;
+                known = true;
+            }
+        }
+        if (!known)
+            return false;
+    }
+    return true;
+}
+
+static json histogramJson(const LatencyHistogram& h)
+{
+    return {
+        {"count", h.Count()},
+        {"mean_us", h.Mean()},
+        {"p50_us", h.Percentile(0.50)},
+        {"p99_us", h.Percentile(0.99)},
+        {"p999_us", h.Percentile(0.999)},
+        {"max_us", h.Max()}
+    };
+}
+
+static std::string histogramRow(const std::string& name, const LatencyHistogram& h)
+{
+    return fmt::format("{:<24} {:>9} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}",
+                       name, h.Count(),
+                       h.Percentile(0.50) / 1000.0, h.Percentile(0.99) / 1000.0,
+                       h.Percentile(0.999) / 1000.0, h.Max() / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+    int durationSec = 10;
+    int concurrency = 8;
+    int probePeriodMs = 10;
+    std::string mix = "status=50,settings=10,patch=5,light=5,static=30";
+    std::string jsonPath;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--duration" && i + 1 < argc) durationSec = std::max(1, atoi(argv[++i]));
+        else if (arg == "--concurrency" && i + 1 < argc) concurrency = std::max(1, atoi(argv[++i]));
+        else if (arg == "--mix" && i + 1 < argc) mix = argv[++i];
+        else if (arg == "--probe-period-ms" && i + 1 < argc) probePeriodMs = std::max(1, atoi(argv[++i]));
+        else if (arg == "--json" && i + 1 < argc) jsonPath = argv[++i];
+        else
+        {
+            std::cerr << "Usage: silvanus_loadgen [--duration <s>] [--concurrency <n>] [--mix <op=weight,...>] "
+                         "[--probe-period-ms <ms>] [--json <file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::unique_ptr<Operation>> ops;
+    for (const char* name : {"status", "settings", "patch", "light", "static"})
+    {
+        ops.push_back(std::make_unique<Operation>());
+        ops.back()->name = name;
+        ops.back()->weight = 0;
+    }
+    if (!parseMix(mix, ops))
+    {
+        std::cerr << "Bad --mix, expected e.g. status=50,settings=10,patch=5,light=5,static=30" << std::endl;
+        return 1;
+    }
+
+#if defined(SILVANUS_BACKEND_PI)
+    std::cerr << "silvanus_loadgen would switch real relays, build it with -DSILVANUS_BACKEND=simulated or runtime" << std::endl;
+    return 1;
+#endif
+
+    // A scratch config, journal and runtime state, so a run never touches
+    // those of a service on the same machine. Removed after everything
+    // using them is gone.
+    struct ScratchDirectory
+    {
+        std::filesystem::path path;
+        ~ScratchDirectory()
+        {
+            std::error_code error;
+            std::filesystem::remove_all(path, error);
+        }
+    } scratch{std::filesystem::temp_directory_path() / fmt::format("silvanus-loadgen-{}", getpid())};
+    std::filesystem::create_directories(scratch.path);
+    config.SetConfigPath((scratch.path / "SilvanusConfig.json").string());
+    config.Init();
+    config.SetConfigValue("runtimeState", std::string(""));
+    config.SetConfigValue("journalPath", (scratch.path / "SilvanusEvents.journal").string());
+    config.SetConfigValue("hardwareBackend", std::string("simulated"));
+    Silvanus silvanus;
+    PlantSchedule schedule(silvanus);
+    SceneTable scenes(silvanus);
+    RuleEngine rules(silvanus, scenes);
+    HttpService httpService("127.0.0.1", 0);
+    RegisterApiRoutes(httpService, silvanus, schedule, scenes, rules, []() { });
+    int port = httpService.Port();
+
+    // Static assets to cycle through
+    std::vector<std::string> assets = {"/"};
+    StaticFileCache web;
+    web.Load(std::filesystem::path(config.resourcePath()) / "Web");
+    for (const auto& [filename, file] : web.Files())
+    {
+        assets.push_back("/" + filename);
+    }
+
+    // Patch with the current value so the run leaves the settings as it found them
+    std::string patchBody = json({{"lightInterval", config.GetConfigValue("lightInterval", 43200)}}).dump();
+
+    std::discrete_distribution<int>::param_type weights;
+    {
+        std::vector<double> w;
+        for (auto& op : ops) w.push_back(op->weight);
+        weights = std::discrete_distribution<int>::param_type(w.begin(), w.end());
+    }
+
+    std::cout << fmt::format("Driving 127.0.0.1:{} with {} clients for {} s ({})", port, concurrency, durationSec, mix) << std::endl;
+
+    std::atomic<bool> stop{false};
+    LatencyHistogram overall;
+
+    // Actuator timing probe: how late does a thread wake for a fixed-period deadline?
+    LatencyHistogram probeLateness;
+    std::thread probe([&]()
+    {
+        auto period = std::chrono::milliseconds(probePeriodMs);
+        auto next = std::chrono::steady_clock::now() + period;
+        while (!stop)
+        {
+            std::this_thread::sleep_until(next);
+            auto late = std::chrono::steady_clock::now() - next;
+            probeLateness.Record(std::chrono::duration_cast<std::chrono::microseconds>(late).count());
+            next += period;
+        }
+    });
+
+    // Keep a pump pulse going so the real pulse thread hits off-deadlines during the run
+    std::thread pulser([&]()
+    {
+        while (!stop)
+        {
+            if (!silvanus.GetPump())
+            {
+                silvanus.PulsePump(std::chrono::seconds(1));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < concurrency; c++)
+    {
+        clients.emplace_back([&, c]()
+        {
+            httplib::Client client("127.0.0.1", port);
+            client.set_keep_alive(true);
+            std::mt19937 rng(c + 1);
+            std::discrete_distribution<int> pick(weights);
+            size_t assetIndex = c;
+            bool lightState = false;
+            while (!stop)
+            {
+                Operation& op = *ops[pick(rng)];
+                auto opStart = std::chrono::steady_clock::now();
+                httplib::Result res;
+                if (op.name == "status") res = client.Get("/status");
+                else if (op.name == "settings") res = client.Get("/system/settings");
+                else if (op.name == "patch") res = client.Patch("/system/settings", patchBody, "application/json");
+                else if (op.name == "light") res = client.Put("/light", (lightState = !lightState) ? "true" : "false", "application/json");
+                else res = client.Get(assets[assetIndex++ % assets.size()]);
+                auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - opStart).count();
+
+                if (!res || res->status >= 300)
+                {
+                    op.errors++;
+                }
+                op.latency.Record(micros);
+                overall.Record(micros);
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(durationSec));
+    stop = true;
+    for (auto& t : clients) t.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    probe.join();
+    pulser.join();
+
+    uint64_t errors = 0;
+    for (auto& op : ops) errors += op->errors;
+
+    std::cout << fmt::format("{} requests, {} errors, {:.1f} req/s", overall.Count(), errors, overall.Count() / elapsed) << std::endl;
+    std::cout << fmt::format("{:<24} {:>9} {:>10} {:>10} {:>10} {:>10}", "latency (ms)", "count", "p50", "p99", "p999", "max") << std::endl;
+    std::cout << histogramRow("all", overall) << std::endl;
+    for (auto& op : ops)
+    {
+        if (op->latency.Count() > 0)
+            std::cout << histogramRow(op->name, op->latency) << std::endl;
+    }
+    std::cout << histogramRow("actuator probe lateness", probeLateness) << std::endl;
+    std::cout << histogramRow("pulse off lateness", silvanus.OffDeadlineLateness()) << std::endl;
+
+    if (!jsonPath.empty())
+    {
+        json report = {
+            {"duration_s", elapsed},
+            {"concurrency", concurrency},
+            {"mix", mix},
+            {"requests", overall.Count()},
+            {"errors", errors},
+            {"throughput_rps", overall.Count() / elapsed},
+            {"latency", histogramJson(overall)},
+            {"probe_period_ms", probePeriodMs},
+            {"probe_lateness", histogramJson(probeLateness)},
+            {"pulse_off_lateness", histogramJson(silvanus.OffDeadlineLateness())}
+        };
+        for (auto& op : ops)
+        {
+            json entry = histogramJson(op->latency);
+            entry["errors"] = op->errors.load();
+            report["operations"][op->name] = entry;
+        }
+        std::ofstream ofs(jsonPath, std::ofstream::out | std::ofstream::trunc);
+        ofs << std::setw(4) << report << std::endl;
+    }
+
+    return 0;
+}
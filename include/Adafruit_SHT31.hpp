@@ -59,6 +59,9 @@ public:
   void heater(bool h);
   bool isHeaterEnabled();
 
+  static uint8_t crc8(const uint8_t *data, int len);
+  static bool decodeTempHum(const uint8_t *frame, float *temperature_out, float *humidity_out);
+
 private:
   /**
    * Placeholder to track humidity internally.
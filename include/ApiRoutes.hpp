@@ -0,0 +1,18 @@
+#pragma once
+
+#include "HttpService.hpp"
+#include "PlantSchedule.hpp"
+#include "RuleEngine.hpp"
+#include "SceneTable.hpp"
+#include "Silvanus.hpp"
+
+#include <functional>
+
+// Register the Silvanus HTTP API on the service.
+// onRestart is invoked by POST /system/restart.
+void RegisterApiRoutes(HttpService& httpService, 
+                       Silvanus& silvanus, 
+                       PlantSchedule& schedule,
+                       SceneTable& scenes,
+                       RuleEngine& rules,
+                       std::function<void()> onRestart);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "PlantSchedule.hpp"
+#include "Silvanus.hpp"
+
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// POST /batch: an ordered list of operations that is checked as a whole
+// before any of it runs.
+//
+// [
+//     { "op": "settings", "value": { "lightTime": 21600 } },
+//     { "op": "light", "value": true },
+//     { "op": "pulse", "channel": "pump", "duration": 30000 }
+// ]
+//
+// Operations are "settings" (a settings patch), "channels" (channel names
+// to bools, like PUT /channels), "light" and "pump" (a bool), "pulse" (a
+// channel name and milliseconds) and "auto-light". Settings are applied
+// first with one save and one schedule re-evaluation, then every channel
+// operation in order as one Silvanus::ApplyChanges transaction, so the
+// batch's switches win over the schedule.
+class CommandBatch
+{
+public:
+    static constexpr size_t MaxOperations = 64;
+
+    CommandBatch();
+
+    // Check every operation. results gets one entry per operation saying
+    // whether it is valid. Returns false if any isn't, or sets error and
+    // returns false if ops is not an array of at most MaxOperations.
+    bool Parse(const nlohmann::json& ops, const Silvanus& silvanus, nlohmann::json& results, std::string& error);
+    // Apply a batch Parse accepted. If the settings patch no longer applies
+    // nothing is, error is set and it returns false.
+    bool Apply(Silvanus& silvanus, PlantSchedule& schedule, std::string& error);
+private:
+    bool parseOperation(const nlohmann::json& op, const Silvanus& silvanus, std::string& error);
+
+    // Every settings operation merged, later keys win
+    nlohmann::json patch_;
+    bool prime_;
+    std::vector<ChannelChange> changes_;
+};
@@ -5,6 +5,7 @@
 #include <unordered_set>
 #include <ctime>
 #include <iostream>
+#include <mutex>
 #include <sigslot/signal.hpp>
 #include <nlohmann/json.hpp>
 
@@ -37,6 +38,8 @@ class ConfigService
     ConfigService();
     ~ConfigService();
 
+    // Use another config file (e.g. a scratch one for tools), before Init
+    void SetConfigPath(const std::string& path);
     // Load the config from a file and get the sercive ready to use
     // MUST be called before any other methods may be called
     void Init();
@@ -48,22 +51,40 @@ class ConfigService
     std::string GetSharedResourcePath(const std::string& resourceName) const;
 
     void SaveConfig();
+    // Re-read the config file (e.g. after another process saved it) and notify every subscriber
+    bool Reload();
+    // Check that every key in patch is known and gets a value of its type, and that no key
+    // is inside another one, without applying it
+    bool CheckPatch(const nlohmann::json& patch, std::string& error);
+    // Apply every setting in patch, or none of them if any key is unknown or has the wrong type.
+    // Subscribers hear about the changed keys once everything is set.
+    bool ApplyPatch(const nlohmann::json& patch, std::string& error);
+    // Same for a patch still in json text. Parses it with SAX and checks each key and
+    // type as it is read, so a bad patch fails at the first bad key without building a DOM.
+    bool ParseAndApplyPatch(const std::string& body, std::string& error);
     bool HasKey(const std::string& key);
     bool ValueTypeMatches(const std::string& key, const nlohmann::json& value);
     const nlohmann::json& GetConfigJson(const std::string& key = "") const;
+    // Copy of the config (or a sub-tree of it) that is safe to use while other threads change settings
+    nlohmann::json GetConfigSnapshot(const std::string& key = "") const;
     void Subscribe(const std::function <void (const ConfigUpdateEventArg&)>& handler);
 
+    // Split a dotted key ("a.b.c") into its path elements
+    static std::vector<std::string> splitKeyPath(const std::string& path);
+
     // Configuration functions
     template <typename T>
     T GetConfigValue(const std::string& key, const T& defaultValue)
     {
         if (!_initDone) throw std::runtime_error("Config service is not initialized!");
+        const std::lock_guard<std::recursive_mutex> lock(_mutex);
         return getConfigValueInternal(key, defaultValue);
     }
     
     template <typename T>
     void SetConfigValue(const std::string& key, const T& value)
     {
+      const std::lock_guard<std::recursive_mutex> lock(_mutex);
       try
       {
         nlohmann::json& entry = getJsonValue(key, true);
@@ -90,11 +111,13 @@ class ConfigService
     bool hasJsonValue(const std::string& path);
     nlohmann::json& getJsonValue(const std::string& path, bool createIfMissing);
     const nlohmann::json& getJsonValue(const std::string& path) const;
-    static std::vector<std::string> splitKeyPath(const std::string& path);
     nlohmann::json _config;
+    // Guards _config. Recursive because change handlers read settings back.
+    mutable std::recursive_mutex _mutex;
 
     bool _settingsReadOK;
     bool _initDone;
+    std::string configPath_;
 
     // If the event is raised with ConfigService::AllSettings, that means a full file refresh
     sigslot::signal<const ConfigUpdateEventArg&> OnSettingChanged;
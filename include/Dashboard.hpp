@@ -0,0 +1,112 @@
+#pragma once
+
+#include "SampleHistory.hpp"
+#include "Silvanus.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Serves GET /dashboard?fields=status.temperature,settings,history.humidity:
+// exactly the requested fields in one response. Fields are section.name, a
+// section on its own means all of it:
+//
+//   status    temperature, humidity, light-on, pump-on, channels, dimmers, inputs, interlocked
+//   settings  any settings key (dotted for nested ones)
+//   history   temperature, humidity (chart points between from and to)
+//   events    the last journal events
+//   health    deadlineMisses, httpRejected, logDropped, realtime
+//
+// Each distinct fields string is compiled once into a list of steps with
+// the json text between the values worked out ahead, and cached, so a
+// request runs the steps and writes values straight into the body.
+class Dashboard
+{
+public:
+    // What the status fields read, filled in one go per request
+    struct Status
+    {
+        float temperature;
+        float humidity;
+        uint32_t channels;
+        uint32_t interlocked;
+        std::array<float, Silvanus::MaxChannels> dimmerLevels;  // Below 0 without a dimmer
+    };
+    struct Health
+    {
+        uint64_t deadlineMisses;
+        uint64_t httpRejected;
+        uint64_t logDropped;
+        bool realtime;
+    };
+    // Chart range of the history fields
+    struct Options
+    {
+        SampleHistory::Clock::time_point from;
+        SampleHistory::Clock::time_point to;
+        size_t points;
+    };
+    // Where the sections come from. status is required, a section without
+    // a source is rejected. The others append their json to the body.
+    struct Sources
+    {
+        std::function<bool(Status&)> status;
+        std::function<void(std::string&)> inputs;
+        std::function<void(SampleHistory::Series, const Options&, std::string&)> history;
+        std::function<void(std::string&)> events;
+        std::function<void(Health&)> health;
+    };
+    enum class Result
+    {
+        Ok,
+        BadFields,      // error says which
+        Unavailable     // The status source had nothing
+    };
+
+    Dashboard(const std::vector<OutputChannel>& channels, Sources sources);
+
+    Result Serialize(const std::string& fields, const Options& options, std::string& body, std::string& error);
+private:
+    enum class Field
+    {
+        Temperature, Humidity, Light, Pump, Channels, Dimmers, Inputs, Interlocked,
+        Setting, AllSettings,
+        TemperatureHistory, HumidityHistory,
+        Events,
+        DeadlineMisses, HttpRejected, LogDropped, Realtime
+    };
+    struct Step
+    {
+        Field field;
+        std::string prefix;     // Json text before the value
+        std::string key;        // Settings key
+    };
+    struct Plan
+    {
+        std::vector<Step> steps;
+        std::string suffix;
+        bool needsStatus;
+        bool needsHealth;
+        // Size of the last body, reserved up front next time
+        mutable std::atomic<size_t> sizeHint;
+    };
+
+    std::shared_ptr<const Plan> plan(const std::string& fields, std::string& error);
+    std::shared_ptr<const Plan> compile(const std::string& fields, std::string& error) const;
+    void writeValue(const Step& step, const Status& status, const Health& health, const Options& options, std::string& body) const;
+
+    Sources sources_;
+    // "name": of every channel, and the light and pump role bits
+    std::vector<std::string> channelKeys_;
+    uint32_t lightMask_;
+    uint32_t pumpMask_;
+
+    std::shared_mutex plansMutex_;
+    std::unordered_map<std::string, std::shared_ptr<const Plan>> plans_;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Append-only log of actuator activity made of fixed size records. A
+// record's cursor is its index in the file, so reading from a cursor is
+// one seek. Appends only copy the record into an in-memory ring, so they
+// never touch the disk from the actuator threads. A background thread
+// writes what piled up and fsyncs it once per interval.
+class EventJournal
+{
+public:
+    enum class Type : uint32_t
+    {
+        Startup = 1,
+        ChannelOn = 2,      // channels: the channels that went on
+        ChannelOff = 3,     // channels: the channels that went off
+        EventFired = 4,     // channels, key and value (duration ms) of a schedule event
+        CatchUp = 5         // Same as EventFired, for an occurrence missed while down
+    };
+
+    struct Record
+    {
+        uint64_t timeNs;    // Wall clock, ns since the epoch
+        uint32_t type;
+        uint32_t channels;
+        uint32_t key;
+        uint32_t value;
+        uint32_t magic;
+        uint32_t crc;
+    };
+    static_assert(sizeof(Record) == 32, "Journal records are 32 bytes on disk");
+
+    // Opens (or creates) the journal at path, drops a torn or corrupt tail
+    // left by a crash, and appends a Startup record. An empty path disables it.
+    EventJournal(const std::string& path, std::chrono::milliseconds syncInterval);
+    ~EventJournal();
+
+    bool Enabled() const;
+    // Records that arrive while PendingCapacity are still unwritten are dropped
+    void Append(Type type, uint32_t channels = 0, uint32_t key = 0, uint32_t value = 0);
+    // Write and fsync now instead of with the next batch
+    void Sync();
+    // Cursor of the next record to be appended
+    uint64_t End() const;
+    // Cursor of the first record at or after time. A binary search, so a
+    // wall clock step back only blurs where it lands.
+    uint64_t Seek(std::chrono::system_clock::time_point time) const;
+    // Up to count records starting at cursor
+    std::vector<Record> Read(uint64_t cursor, size_t count) const;
+    // Visit records from newest to oldest until visit returns false
+    void ScanBackward(const std::function<bool(const Record&)>& visit) const;
+
+    static const char* TypeName(uint32_t type);
+    static constexpr size_t PendingCapacity = 1024;
+private:
+    void syncThreadFunc();
+    // Write the pending records and fsync them
+    void flush();
+
+    int fd_;
+    std::atomic<uint64_t> end_;
+    // Records from written_ to end_ wait in the ring, slot cursor % PendingCapacity
+    std::vector<Record> pending_;
+    uint64_t written_;
+    mutable std::mutex mutex_;
+    // Held by whoever is writing, never by Append
+    std::mutex writeMutex_;
+    std::condition_variable cv_;
+    bool exit_;
+    std::chrono::milliseconds syncInterval_;
+    std::unique_ptr<std::thread> syncThread_;
+};
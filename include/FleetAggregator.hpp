@@ -0,0 +1,84 @@
+#pragma once
+
+#include <httplib.h>
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Polls the /status and /history of many Silvanus nodes and keeps the
+// latest of each for a merged fleet view. Nodes come from the fleetPeers
+// list and, with fleetDiscovery on, from FleetAnnouncer datagrams.
+// A fixed set of workers bounds the requests in flight; each node keeps
+// one keep-alive connection and is asked with If-None-Match, so an
+// unchanged node costs an empty 304 and no parsing.
+class FleetAggregator
+{
+public:
+    FleetAggregator();
+    ~FleetAggregator();
+
+    // Every node and its last status, the json body of GET /fleet
+    std::string Nodes();
+    // Last /history body of the node with that name or host:port, false if there is none
+    bool History(const std::string& node, std::string& body);
+    size_t NodeCount();
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Peer
+    {
+        std::string address;    // host:port
+        std::string host;
+        int port;
+        bool discovered;        // Expires when the announcements stop
+        bool removed;           // Expired while a worker had it
+
+        // Only touched by the worker that took the peer off the timeline
+        std::unique_ptr<httplib::Client> client;
+        std::string statusTag;
+        std::string historyTag;
+        Clock::time_point nextHistory;
+
+        // Guarded by mutex_
+        std::string name;
+        Clock::time_point lastAnnounced;
+        nlohmann::json status;
+        std::string history;
+        std::chrono::system_clock::time_point lastSeen;
+        int failures;
+        std::string error;
+    };
+    using PeerPtr = std::shared_ptr<Peer>;
+
+    void addPeer(const std::string& name, const std::string& host, int port, bool discovered);
+    void expirePeers();
+    Clock::time_point nextPoll(const Peer& peer) const;
+    void poll(const PeerPtr& peer);
+    void workerFunc();
+    void discoveryFunc();
+
+    std::chrono::milliseconds pollInterval_;
+    std::chrono::seconds historyInterval_;
+    std::chrono::seconds peerExpiry_;
+    size_t maxNodes_;
+
+    std::mutex mutex_;
+    std::condition_variable due_;
+    std::map<std::string, PeerPtr> peers_;                      // By address
+    std::set<std::pair<Clock::time_point, PeerPtr>> timeline_;  // Idle peers by next poll
+    bool dirty_;
+    std::string nodes_;
+    bool exit_;
+
+    int discoverySocket_;
+    std::vector<std::thread> workers_;
+    std::unique_ptr<std::thread> discovery_;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Tells fleet aggregators on the LAN that this node exists by sending
+// {"name": ..., "port": ...} to a multicast group every few seconds.
+// The aggregator takes the address from the datagram's sender.
+class FleetAnnouncer
+{
+public:
+    static constexpr const char* DefaultGroup = "239.255.77.77";
+    static constexpr int DefaultPort = 7777;
+
+    // Announce the HTTP API on httpPort
+    FleetAnnouncer(int httpPort);
+    ~FleetAnnouncer();
+private:
+    void threadFunc();
+
+    std::string message_;
+    std::string group_;
+    int port_;
+    int socket_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool exit_;
+    std::unique_ptr<std::thread> thread_;
+};
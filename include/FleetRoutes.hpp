@@ -0,0 +1,7 @@
+#pragma once
+
+#include "FleetAggregator.hpp"
+#include "HttpService.hpp"
+
+// Register the merged fleet API and dashboard of the aggregator mode
+void RegisterFleetRoutes(HttpService& httpService, FleetAggregator& fleet);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "HardwareLink.hpp"
+#include "HttpService.hpp"
+
+#include <functional>
+
+// Register the HTTP API of the split mode's web front end, which reaches
+// the hardware daemon through the link instead of touching the hardware.
+// onRestart is invoked by POST /system/restart and only restarts the front end.
+void RegisterFrontEndRoutes(HttpService& httpService,
+                            HardwareLink& link,
+                            std::function<void()> onRestart);
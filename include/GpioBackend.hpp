@@ -0,0 +1,93 @@
+#pragma once
+
+#include "PwmDimmer.hpp"
+
+#include <cstdint>
+#include <variant>
+
+// The output pins Silvanus switches relays with and the registers the
+// PWM dimmer programs. Gpio is the backend SILVANUS_BACKEND picked at
+// compile time, so switching a relay is a direct register store on the Pi.
+
+// The Pi's peripherals mapped from /dev/mem (minimal_gpio.h)
+class MmapGpio
+{
+public:
+    // Throws if the registers can't be mapped
+    MmapGpio();
+
+    // Drive the pin to level, then make it an output so it never glitches the other way
+    void SetOutput(unsigned gpio, bool level);
+    // Bank 1 (GPIO 0-31) in one register write each
+    void SetBank1(uint32_t bits) { gpio_[SetWord] = bits; }
+    void ClearBank1(uint32_t bits) { gpio_[ClearWord] = bits; }
+    PwmDimmer::Registers PwmRegisters() const;
+    // The PWM clock runs off the 19.2 MHz oscillator, 54 MHz on the Pi 4
+    uint32_t OscillatorHz() const;
+private:
+    // GPSET0 and GPCLR0
+    static constexpr int SetWord = 7;
+    static constexpr int ClearWord = 10;
+    volatile uint32_t* gpio_;
+};
+
+// Pins in plain memory and mock PWM registers, for PCs
+class SimulatedGpio
+{
+public:
+    SimulatedGpio();
+    // The PWM dimmer keeps pointers into the registers
+    SimulatedGpio(const SimulatedGpio&) = delete;
+    SimulatedGpio& operator=(const SimulatedGpio&) = delete;
+
+    void SetOutput(unsigned gpio, bool level);
+    void SetBank1(uint32_t bits);
+    void ClearBank1(uint32_t bits);
+    PwmDimmer::Registers PwmRegisters();
+    uint32_t OscillatorHz() const;
+    // Level of every bank 1 pin
+    uint32_t Levels() const;
+private:
+    uint32_t levels_;
+    PwmDimmer::MockRegisters registers_;
+};
+
+// Either backend, picked by the hardwareBackend setting when constructed
+// ("pi" and "record" map the Pi's registers, "simulated" and "replay"
+// don't). For the "runtime" build variant and benchmarks.
+class RuntimeGpio
+{
+public:
+    RuntimeGpio();
+
+    void SetOutput(unsigned gpio, bool level)
+    {
+        std::visit([=](auto& backend) { backend.SetOutput(gpio, level); }, gpio_);
+    }
+    void SetBank1(uint32_t bits)
+    {
+        std::visit([=](auto& backend) { backend.SetBank1(bits); }, gpio_);
+    }
+    void ClearBank1(uint32_t bits)
+    {
+        std::visit([=](auto& backend) { backend.ClearBank1(bits); }, gpio_);
+    }
+    PwmDimmer::Registers PwmRegisters()
+    {
+        return std::visit([](auto& backend) { return backend.PwmRegisters(); }, gpio_);
+    }
+    uint32_t OscillatorHz() const
+    {
+        return std::visit([](const auto& backend) { return backend.OscillatorHz(); }, gpio_);
+    }
+private:
+    std::variant<SimulatedGpio, MmapGpio> gpio_;
+};
+
+#if defined(SILVANUS_BACKEND_RUNTIME)
+using Gpio = RuntimeGpio;
+#elif defined(SILVANUS_BACKEND_PI)
+using Gpio = MmapGpio;
+#else
+using Gpio = SimulatedGpio;
+#endif
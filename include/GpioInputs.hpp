@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+struct OutputChannel;
+
+// Input pins watched through the GPIO character device. The kernel queues
+// every edge with its own timestamp and a thread blocks on the line request
+// until edges arrive, so nothing is polled and kHz pulse trains aren't missed.
+//
+// Counter inputs (hall effect flow meters) count rising edges. Switch
+// inputs (float/level switches) are debounced and can interlock output
+// channels: while the switch is active, those channels are held off.
+class GpioInputs
+{
+public:
+    enum class Type
+    {
+        Counter,
+        Switch
+    };
+
+    enum class Pull
+    {
+        None,
+        Down,
+        Up
+    };
+
+    struct Input
+    {
+        std::string name;
+        Type type;
+        unsigned gpio;
+        bool activeLow;
+        Pull pull;
+        std::chrono::milliseconds debounce;   // Switches only
+        double pulsesPerLiter;                // Counters only
+        uint32_t interlockMask;               // Channels held off while a switch is active
+
+        // Written by the event thread only
+        std::atomic<uint64_t> pulses{0};
+        std::atomic<uint64_t> lastPulseNs{0};
+        std::atomic<uint64_t> lastPeriodNs{0};
+        std::atomic<bool> active{false};
+
+        // Switch debouncing, event thread only
+        bool pending;
+        bool pendingHigh;
+        uint64_t pendingSinceNs;
+    };
+
+    // onSwitchChange runs on the event thread after a switch changes state
+    GpioInputs(const std::vector<OutputChannel>& channels, std::function<void()> onSwitchChange);
+    ~GpioInputs();
+
+    // Build the input table from the "inputs" config json, skipping bad entries
+    static std::vector<std::unique_ptr<Input>> ParseInputs(const nlohmann::json& table,
+                                                           const std::vector<OutputChannel>& channels);
+
+    size_t Count() const;
+    const Input& Get(size_t input) const;
+    // Pulses per second from the last two edges, 0 once the meter has been quiet for a second
+    double PulseRate(size_t input) const;
+    // Union of the interlock masks of every active switch
+    uint32_t InterlockMask() const;
+    // True if the lines were requested and are being watched
+    bool Watching() const;
+private:
+    bool requestLines(const std::string& chipPath);
+    void threadFunc();
+    void handleEdge(Input& input, bool high, uint64_t timestampNs);
+    // Commit switch levels that have been stable for their debounce time.
+    // Returns ms until the next pending switch is due, -1 if none is pending.
+    int settleSwitches(uint64_t nowNs);
+
+    std::vector<std::unique_ptr<Input>> inputs_;
+    std::function<void()> onSwitchChange_;
+    int lineFd_;
+    int wakeFd_;
+    std::unique_ptr<std::thread> thread_;
+};
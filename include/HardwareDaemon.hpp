@@ -0,0 +1,40 @@
+#pragma once
+
+#include "HardwareLink.hpp"
+#include "PlantSchedule.hpp"
+#include "SceneTable.hpp"
+#include "Silvanus.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// The hardware side of the split mode: runs the web front end's commands
+// from the hardware link against Silvanus and publishes the state back
+class HardwareDaemon
+{
+public:
+    HardwareDaemon(Silvanus& silvanus, PlantSchedule& schedule, SceneTable& scenes);
+    ~HardwareDaemon();
+
+    // Read the sensors and publish a fresh state, called from the main loop
+    void Publish();
+private:
+    LinkResult execute(const LinkCommand& command);
+    void publish(bool readSensors);
+    void threadFunc();
+
+    Silvanus& silvanus_;
+    PlantSchedule& schedule_;
+    SceneTable& scenes_;
+    std::unique_ptr<HardwareLink> link_;
+
+    // The state block has a single writer, publishes from either thread take turns
+    std::mutex publishMutex_;
+    float temperature_;
+    float humidity_;
+
+    std::atomic<bool> exit_;
+    std::unique_ptr<std::thread> thread_;
+};
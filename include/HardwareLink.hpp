@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+enum class LinkCommandType : uint32_t
+{
+    SetChannels = 1,    // channels on, offChannels off
+    PulseChannels = 2,  // channels for durationMs
+    WaterNow = 3,
+    AutoLight = 4,      // Re-prime the schedule
+    ApplyScene = 5,     // Scene name in payload, for durationMs (0 to leave it on)
+    SetDimmer = 6,      // level of the channels' dimmers
+    PatchSettings = 7   // Json settings patch in payload, saved by the daemon
+};
+
+enum class LinkResult : int32_t
+{
+    Ok = 0,
+    Rejected = 1,       // Bad arguments
+    UnknownScene = 2,
+    Unavailable = -1,   // No daemon
+    QueueFull = -2,
+    Timeout = -3
+};
+
+struct LinkCommand
+{
+    LinkCommandType type;
+    uint32_t channels;
+    uint32_t offChannels;
+    float level;
+    int64_t durationMs;
+    char payload[2048];     // Nul terminated
+};
+
+// What the daemon publishes for the front end to read
+struct LinkState
+{
+    int64_t updatedNs;      // Wall clock of the last publish
+    uint32_t daemonPid;
+    uint32_t channels;
+    uint32_t interlocked;
+    float temperature;
+    float humidity;
+    float dimmerLevels[32]; // -1 for channels without a dimmer
+    uint64_t deadlineMisses;
+};
+
+// Connects the hardware daemon with the web front end through shared
+// memory: a single producer/single consumer command ring (the front end
+// serializes its HTTP threads into the one producer) and a seqlock state
+// block. Both sides sleep on futexes in the shared region, so a command is
+// one copy and two wakeups, and reading the state never blocks the daemon.
+class HardwareLink
+{
+public:
+    enum class Role
+    {
+        Daemon,     // Creates the region and serves commands
+        FrontEnd    // Attaches to the daemon's region, sends commands
+    };
+    static constexpr size_t RingCapacity = 64;
+
+    HardwareLink(const std::string& name, Role role);
+    ~HardwareLink();
+
+    // Front end: queue a command and wait for the daemon to run it
+    LinkResult Send(const LinkCommand& command, std::chrono::milliseconds timeout);
+    // Front end: consistent copy of the state, false without a daemon or if
+    // it stays mid-publish (a daemon that died while publishing)
+    bool ReadState(LinkState& state);
+
+    // Daemon: run handle(command) for every queued command, waiting up to
+    // `wait` for one to arrive. Returns how many ran.
+    template <typename F>
+    size_t Serve(std::chrono::milliseconds wait, F&& handle)
+    {
+        if (region_ == nullptr) return 0;
+        uint32_t bell = region_->doorbell.load(std::memory_order_acquire);
+        uint64_t tail = region_->tail.load(std::memory_order_relaxed);
+        if (tail == region_->head.load(std::memory_order_acquire))
+        {
+            waitDoorbell(bell, wait);
+        }
+
+        size_t served = 0;
+        for (uint64_t head = region_->head.load(std::memory_order_acquire); tail != head; tail++, served++)
+        {
+            size_t slot = tail % RingCapacity;
+            region_->results[slot] = handle(region_->commands[slot]);
+            region_->tail.store(tail + 1, std::memory_order_release);
+            complete((uint32_t)(tail + 1));
+        }
+        return served;
+    }
+    // Daemon: publish a new state
+    void PublishState(const LinkState& state);
+    // Daemon: wake a Serve() that is waiting, e.g. to shut down
+    void Interrupt();
+private:
+    struct Region
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t size;
+        alignas(64) std::atomic<uint64_t> head;     // Written by the front end
+        alignas(64) std::atomic<uint64_t> tail;     // Written by the daemon
+        alignas(64) std::atomic<uint32_t> doorbell; // Futex, bumped after a push
+        std::atomic<uint32_t> completed;            // Futex, low bits of the last finished command's tail
+        LinkCommand commands[RingCapacity];
+        LinkResult results[RingCapacity];
+        alignas(64) std::atomic<uint32_t> stateSeq; // Odd while the state is written
+        LinkState state;
+    };
+
+    bool attach();
+    void waitDoorbell(uint32_t bell, std::chrono::milliseconds wait);
+    void complete(uint32_t tail);
+
+    std::string name_;
+    Role role_;
+    Region* region_;
+    std::mutex sendMutex_;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "EventJournal.hpp"
+#include "SampleHistory.hpp"
+
+#include <httplib.h>
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+// Streams the samples or journal events of a time range as CSV or NDJSON,
+// optionally gzipped.
+// Each call formats one batch and only comes back for the next once the
+// socket took it, so memory stays at one batch however long the range is
+// and a slow client slows the export down instead of piling it up.
+class HistoryExport
+{
+public:
+    enum class Format
+    {
+        Csv,
+        Ndjson
+    };
+
+    HistoryExport(const SampleHistory& history, Format format,
+                  SampleHistory::Clock::time_point from, SampleHistory::Clock::time_point to, bool gzip);
+    // Journal events, channelNames name the bits of a record's channel mask
+    HistoryExport(const EventJournal& journal, std::vector<std::string> channelNames, Format format,
+                  SampleHistory::Clock::time_point from, SampleHistory::Clock::time_point to, bool gzip);
+    ~HistoryExport();
+    HistoryExport(const HistoryExport&) = delete;
+    HistoryExport& operator=(const HistoryExport&) = delete;
+
+    static const char* ContentType(Format format);
+    // False if gzip was asked for but could not start, the output is plain then
+    bool Compressed() const;
+
+    // Content provider step: write the next batch, or finish and call
+    // sink.done(). False if the client went away or compression failed.
+    bool WriteNext(httplib::DataSink& sink);
+private:
+    static constexpr size_t BatchSize = 512;
+
+    void startGzip();
+    // The next batch of samples or events into text_, false if it was the last
+    bool formatSamples();
+    bool formatEvents();
+    void format(const StateSample& sample);
+    void format(const EventJournal::Record& record);
+    // A reading, null (NDJSON) or an empty field (CSV) if it failed
+    void formatReading(float value);
+    bool emit(httplib::DataSink& sink, bool last);
+
+    // One of them is set
+    const SampleHistory* history_;
+    const EventJournal* journal_;
+    std::vector<std::string> channelNames_;
+    Format format_;
+    uint64_t cursor_;
+    SampleHistory::Clock::time_point to_;
+    bool gzip_;
+    z_stream zstream_;
+    bool headerWritten_;
+    StateSample batch_[BatchSize];
+    // Reused between batches so a long export doesn't allocate per batch
+    std::string text_;
+    std::string compressed_;
+};
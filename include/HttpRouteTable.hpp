@@ -0,0 +1,36 @@
+#pragma once
+
+#include "HttpWorkerPool.hpp"
+
+#include <httplib.h>
+#include <array>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// Hash table of routes with fixed paths. Finding one is a single
+// hash lookup no matter how many routes are registered, where httplib
+// tries each of its regex routes in turn.
+class HttpRouteTable
+{
+public:
+    struct Route
+    {
+        httplib::Server::Handler handler;
+        RoutePriority priority;
+    };
+
+    // True if the pattern has no regex syntax, so it only matches itself.
+    // '.' is allowed since it shows up in every file name.
+    static bool IsExactPath(const std::string& pattern);
+
+    // Returns false for methods the table does not handle
+    bool Add(const std::string& method, const std::string& path, Route route);
+    // Returns nullptr if no route matches. HEAD finds the GET route.
+    // The route is shared so a caller can run it without holding a lock on the table.
+    std::shared_ptr<const Route> Find(const std::string& method, const std::string& path) const;
+    size_t Size() const;
+private:
+    static int methodIndex(const std::string& method);
+    std::array<std::unordered_map<std::string, std::shared_ptr<const Route>>, 6> routes_;
+};
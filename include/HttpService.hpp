@@ -1,24 +1,65 @@
 #pragma once
 
+#include "HttpRouteTable.hpp"
+#include "HttpWorkerPool.hpp"
+#include "StaticFileCache.hpp"
+
 #include <httplib.h>
 #include <vector>
 #include <unordered_map>
 #include <mutex>
+#include <shared_mutex>
 #include <thread>
 #include <condition_variable>
 
 class HttpService
 {
 public:
+    // Bind to the address and port from the config, plus the HTTPS
+    // listener on httpsPort if httpsEnabled is set
     HttpService();
+    // Bind to the given address and port (0 picks any free port)
+    HttpService(const std::string& addr, int port);
     ~HttpService();
     bool Running();
     std::string ListeningInterface();
+    int Port();
+    // Port of the HTTPS listener, 0 if it isn't running
+    int TlsPort();
     httplib::Server& Server();
+    const HttpAdmission& Admission() const;
+
+    // Route registration. Fixed paths are looked up in a hash table ahead of
+    // httplib's regex routes; patterns with regex syntax fall back to httplib.
+    // The priority decides which requests are shed first under load.
+    void Get(const std::string& pattern, httplib::Server::Handler handler, RoutePriority priority = RoutePriority::Api);
+    void Post(const std::string& pattern, httplib::Server::Handler handler, RoutePriority priority = RoutePriority::Api);
+    void Put(const std::string& pattern, httplib::Server::Handler handler, RoutePriority priority = RoutePriority::Api);
+    void Patch(const std::string& pattern, httplib::Server::Handler handler, RoutePriority priority = RoutePriority::Api);
+    void Delete(const std::string& pattern, httplib::Server::Handler handler, RoutePriority priority = RoutePriority::Api);
+
+    // Answer with body and an ETag of it, or an empty 304 if the client
+    // already has it (If-None-Match), so pollers skip the transfer and parse
+    static void SendTagged(const httplib::Request& req, httplib::Response& res, std::string body);
+    // Read a body that is a single json bool, without building a json value
+    static bool ParseBool(const std::string& body, bool& value);
 private:
     std::string listeningInterface;
+    int port_;
     void setupCallbacks();
+    void setupAdmission();
+    void setupDispatch(httplib::Server& server);
+    void startTls(const std::string& addr);
+    void addRoute(const std::string& method, const std::string& pattern, httplib::Server::Handler handler, RoutePriority priority);
+    void setBusyResponse(httplib::Response& res);
     std::unique_ptr<httplib::Server> srv;
     std::unique_ptr<std::thread> serverThread;
-    std::unordered_map<std::string, std::string> web;
+    // Same routes and admission as srv, over TLS
+    std::unique_ptr<httplib::Server> tlsSrv_;
+    std::unique_ptr<std::thread> tlsThread_;
+    int tlsPort_;
+    StaticFileCache web;
+    std::unique_ptr<HttpAdmission> admission_;
+    std::shared_mutex routesMutex_;
+    HttpRouteTable routes_;
 };
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <httplib.h>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// How important a route is when the server is overloaded.
+// Control routes drive the actuators and are never shed.
+enum class RoutePriority
+{
+    Control = 0,
+    Api = 1,
+    Static = 2
+};
+
+// Per-priority budgets for the HTTP worker threads. A worker counts
+// against the priority of the last request it handled until its
+// connection closes, since httplib keeps it pinned for keep-alive.
+class HttpAdmission
+{
+public:
+    struct Limits
+    {
+        size_t workers;       // Worker threads in the pool
+        size_t queueLimit;    // Connections allowed to wait for a worker
+        size_t apiBudget;     // Workers that may be busy with Api routes
+        size_t staticBudget;  // Workers that may be busy with Static routes
+        int retryAfterSec;    // Retry-After sent with a 503
+    };
+
+    HttpAdmission(const Limits& limits);
+    const Limits& GetLimits() const;
+
+    // Called on the worker thread once the request is parsed.
+    // Returns false if the request should get a 503.
+    bool Admit(RoutePriority priority);
+    // Called on the worker thread when its connection is done
+    void Release();
+
+    // Mark the current worker's connection as over the queue budget
+    static void SetShed(bool shed);
+    // Mark the current thread's connection as past both queues, it gets a 503 whatever the route
+    static void SetDropped(bool dropped);
+
+    uint64_t RejectedCount() const;
+    uint64_t ShedConnectionCount() const;
+    void CountShedConnection();
+    uint64_t DroppedConnectionCount() const;
+    void CountDroppedConnection();
+private:
+    Limits limits_;
+    std::array<std::atomic<size_t>, 3> busy_;
+    std::atomic<uint64_t> rejected_;
+    std::atomic<uint64_t> shedConnections_;
+    std::atomic<uint64_t> droppedConnections_;
+};
+
+// Fixed size worker pool with a bounded connection queue, installed as
+// httplib's new_task_queue. Connections that arrive while the queue is
+// full wait in a second queue of the same size, flagged so anything
+// except a Control route is answered with an immediate 503. Workers take
+// from the two queues in turn. Past both, connections are dropped.
+class HttpWorkerPool final : public httplib::TaskQueue
+{
+public:
+    // Older httplib returns void from enqueue, newer returns bool (false closes the socket)
+    using EnqueueResult = decltype(std::declval<httplib::TaskQueue&>().enqueue(std::function<void()>()));
+
+    HttpWorkerPool(HttpAdmission& admission);
+    ~HttpWorkerPool() override;
+
+    EnqueueResult enqueue(std::function<void()> fn) override;
+    void shutdown() override;
+private:
+    void workerThreadFunc();
+
+    HttpAdmission& admission_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+    std::deque<std::function<void()>> shedQueue_;
+    std::vector<std::thread> workers_;
+    // Which queue the next worker takes from when both have connections
+    bool takeShed_;
+    bool shutdown_;
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// The buses I2CDevice talks through. Each moves whole transfers, Write()
+// and Read() return true if every byte went through. I2CBus is the one
+// SILVANUS_BACKEND picked at compile time, so drivers call it directly.
+
+// Linux i2c-dev, or any already open file standing in for it
+class LinuxI2CBus
+{
+public:
+    // An already open file standing in for the bus (e.g. one end of a socketpair)
+    struct OpenFile { int fd; };
+
+    // Throws if the bus can't be opened or the device addressed
+    LinuxI2CBus(uint8_t deviceId, const std::string& deviceName = "/dev/i2c-1");
+    // Takes ownership of the file, it is closed on destruction
+    explicit LinuxI2CBus(OpenFile file);
+    LinuxI2CBus(LinuxI2CBus&& other) noexcept;
+    LinuxI2CBus(const LinuxI2CBus&) = delete;
+    LinuxI2CBus& operator=(const LinuxI2CBus&) = delete;
+    ~LinuxI2CBus();
+
+    bool Write(const uint8_t* buf, size_t len);
+    bool Read(uint8_t* buf, size_t len);
+private:
+    int fd_;
+};
+
+// No device attached: writes go nowhere and reads return zeros
+class SimulatedI2CBus
+{
+public:
+    SimulatedI2CBus(uint8_t deviceId = 0, const std::string& deviceName = "");
+
+    bool Write(const uint8_t* buf, size_t len);
+    bool Read(uint8_t* buf, size_t len);
+};
+
+// Passes transfers to Bus and appends each to a recording, one line per
+// transfer: "w" or "r" and the bytes in hex. Failed transfers are not recorded.
+template <typename Bus>
+class RecordingI2CBus
+{
+public:
+    RecordingI2CBus(Bus&& bus, const std::string& path) :
+        bus_(std::move(bus)), out_(path, std::ofstream::out | std::ofstream::trunc)
+    {
+    }
+
+    bool Write(const uint8_t* buf, size_t len)
+    {
+        if (!bus_.Write(buf, len)) return false;
+        record('w', buf, len);
+        return true;
+    }
+    bool Read(uint8_t* buf, size_t len)
+    {
+        if (!bus_.Read(buf, len)) return false;
+        record('r', buf, len);
+        return true;
+    }
+private:
+    void record(char direction, const uint8_t* buf, size_t len)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string line(1, direction);
+        line += ' ';
+        for (size_t i = 0; i < len; i++)
+        {
+            line += digits[buf[i] >> 4];
+            line += digits[buf[i] & 0xF];
+        }
+        out_ << line << '\n';
+        out_.flush();
+    }
+
+    Bus bus_;
+    std::ofstream out_;
+};
+
+// Plays a recording back: each read returns the next recorded read and
+// writes step over recorded writes. Starts over at the end of the recording.
+class ReplayI2CBus
+{
+public:
+    // Throws if the recording can't be read or holds no reads
+    explicit ReplayI2CBus(const std::string& path);
+
+    bool Write(const uint8_t* buf, size_t len);
+    bool Read(uint8_t* buf, size_t len);
+private:
+    struct Transfer
+    {
+        bool read;
+        std::vector<uint8_t> data;
+    };
+    std::vector<Transfer> transfers_;
+    size_t next_;
+};
+
+// Every bus behind one type, picked when constructed. The "runtime"
+// backend uses it with the hardwareBackend setting, and benchmarks use it to
+// swap buses without rebuilding. Each transfer is a switch on the bus type.
+class RuntimeI2CBus
+{
+public:
+    using Variant = std::variant<LinuxI2CBus, SimulatedI2CBus, RecordingI2CBus<LinuxI2CBus>, ReplayI2CBus>;
+
+    // Picks the bus from the hardwareBackend setting: "pi" (i2c-dev),
+    // "simulated", "record" (i2c-dev, recorded to i2cRecording) or "replay"
+    // (plays i2cRecording back)
+    RuntimeI2CBus(uint8_t deviceId, const std::string& deviceName = "/dev/i2c-1");
+    explicit RuntimeI2CBus(Variant bus) : bus_(std::move(bus)) { }
+
+    bool Write(const uint8_t* buf, size_t len)
+    {
+        return std::visit([=](auto& bus) { return bus.Write(buf, len); }, bus_);
+    }
+    bool Read(uint8_t* buf, size_t len)
+    {
+        return std::visit([=](auto& bus) { return bus.Read(buf, len); }, bus_);
+    }
+private:
+    static Variant open(uint8_t deviceId, const std::string& deviceName);
+    Variant bus_;
+};
+
+#if defined(SILVANUS_BACKEND_RUNTIME)
+using I2CBus = RuntimeI2CBus;
+#elif defined(SILVANUS_BACKEND_PI)
+using I2CBus = LinuxI2CBus;
+#else
+using I2CBus = SimulatedI2CBus;
+#endif
@@ -1,24 +1,62 @@
 #pragma once
 
+#include "I2CBackend.hpp"
+
+#include <chrono>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
-class I2CDevice
+// Register access for a device on a Bus (see I2CBackend.hpp). Drivers
+// derive from I2CDevice, which talks through the bus the build picked.
+template <typename Bus>
+class BasicI2CDevice
 {
 public:
-  I2CDevice(uint8_t deviceId, std::string i2cDeviceName = "/dev/i2c-1");
-  virtual ~I2CDevice();
-protected: 
-  // Write the data in buf to the provided address 
-  bool writeI2C(uint16_t addr, const std::vector<uint8_t>& buf = std::vector<uint8_t>());
+  // Arguments are passed on to the bus, e.g. the device id and bus name
+  template <typename... Args>
+  explicit BasicI2CDevice(Args&&... args) : bus_(std::forward<Args>(args)...) { }
+protected:
+  // Write the data in buf to the provided address
+  bool writeI2C(uint16_t addr, const std::vector<uint8_t>& buf = std::vector<uint8_t>())
+  {
+    return writeI2C(addr, buf.data(), buf.size());
+  }
   // Write the data in buf to the provided address
-  bool writeI2C(uint16_t addr, const uint8_t* buf, size_t len);
+  bool writeI2C(uint16_t addr, const uint8_t* buf, size_t len)
+  {
+    std::vector<uint8_t> bufWithAddr(2 + len);
+    bufWithAddr[0] = addr >> 8;
+    bufWithAddr[1] = addr & 0x00FF;
+    for (size_t i = 0; i < len; i++)
+    {
+      bufWithAddr[i + 2] = buf[i];
+    }
+    return bus_.Write(bufWithAddr.data(), bufWithAddr.size());
+  }
   // Poke the provided address, wait, then fill buf with the returned data
-  bool readI2C(uint16_t addr, std::vector<uint8_t>& buf, double delayMs = 8.0);
+  bool readI2C(uint16_t addr, std::vector<uint8_t>& buf, double delayMs = 8.0)
+  {
+    return readI2C(addr, buf.data(), buf.size(), delayMs);
+  }
   // Poke the provided address, wait, then read len bytes into buf
-  bool readI2C(uint16_t addr, uint8_t* buf, size_t len, double delayMs = 8.0);
+  bool readI2C(uint16_t addr, uint8_t* buf, size_t len, double delayMs = 8.0)
+  {
+    writeI2C(addr);
+    delay(delayMs);
+    return bus_.Read(buf, len);
+  }
   // Wait the specified number of milliseconds
-  void delay(double milliseconds);
+  void delay(double milliseconds)
+  {
+    if (milliseconds > 0.0)
+    {
+      std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(milliseconds));
+    }
+  }
 private:
-  int i2cFile_;
+  Bus bus_;
 };
+
+using I2CDevice = BasicI2CDevice<I2CBus>;
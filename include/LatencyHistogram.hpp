@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free log-linear histogram of durations in microseconds.
+// Record() may be called from any thread; buckets are ~6% wide so
+// percentiles are reported with at most that much error.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+    void Record(uint64_t micros);
+    void Reset();
+    uint64_t Count() const;
+    uint64_t Max() const;
+    double Mean() const;
+    // Returns the upper edge of the bucket holding the requested percentile (0 to 1)
+    uint64_t Percentile(double p) const;
+private:
+    static constexpr int SubBucketBits = 4;
+    static constexpr int SubBuckets = 1 << SubBucketBits;
+    static constexpr int BucketCount = SubBuckets + (64 - SubBucketBits) * SubBuckets;
+    static int bucketIndex(uint64_t micros);
+    static uint64_t bucketUpperEdge(int index);
+
+    std::array<std::atomic<uint64_t>, BucketCount> buckets_;
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "PwmDimmer.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct OutputChannel;
+
+// Sunrise and sunset ramps for dimmable lights. A dimmer is a hardware PWM
+// pin paired with an output channel (the relay powering the light). Every
+// pulse of that channel is a window: brightness ramps up over the sunrise
+// duration from its start and down over the sunset duration before its end.
+// Brightness is a pure function of time, so a window resumed after a
+// restart picks up at the level it would have had.
+class LightRamp
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Curve
+    {
+        Linear,
+        Smooth,     // Eases in and out
+        Perceptual  // Looks linear to the eye (duty ~ t^2.2)
+    };
+
+    LightRamp(PwmDimmer& dimmer, const std::vector<OutputChannel>& channels);
+    ~LightRamp();
+
+    // Channels that have a dimmer
+    uint32_t DimmedMask() const;
+    // Ramp the dimmed channels in mask over a window
+    void StartWindow(uint32_t mask, Clock::time_point start, Clock::time_point end);
+    // Back to the base level (the channel was switched off)
+    void EndWindow(uint32_t mask);
+    // Brightness outside ramps, 0 to 1. Returns false if the channel has no dimmer.
+    bool SetBaseLevel(int channel, float level);
+    // Current duty, -1 if the channel has no dimmer
+    float Level(int channel) const;
+
+    static float Shape(Curve curve, float t);
+    static bool ParseCurve(const std::string& name, Curve& curve);
+private:
+    struct Dimmer
+    {
+        int channel;
+        int pwmChannel;
+        Clock::time_point start;
+        Clock::time_point end;
+        float baseLevel;
+        std::atomic<float> level;
+    };
+
+    Dimmer* find(int channel);
+    float levelAt(const Dimmer& dimmer, Clock::time_point now) const;
+    Clock::time_point nextUpdate(const Dimmer& dimmer, Clock::time_point now) const;
+    void threadFunc();
+
+    PwmDimmer& pwm_;
+    // The Pi has two PWM channels
+    std::array<Dimmer, 2> dimmers_;
+    size_t dimmerCount_;
+    uint32_t dimmedMask_;
+
+    std::chrono::milliseconds sunrise_;
+    std::chrono::milliseconds sunset_;
+    Curve curve_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool exit_;
+    std::unique_ptr<std::thread> thread_;
+};
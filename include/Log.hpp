@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <fmt/format.h>
+
+enum class LogLevel
+{
+    Debug = 0,
+    Info = 1,
+    Warning = 2,
+    Error = 3
+};
+
+// Messages below this level are compiled out entirely. Pi builds default
+// to Info, PC (simulator) builds keep the debug chatter.
+#ifndef SILVANUS_LOG_LEVEL
+#ifdef PI_HOST
+#define SILVANUS_LOG_LEVEL 1
+#else
+#define SILVANUS_LOG_LEVEL 0
+#endif
+#endif
+
+// Asynchronous logger. Callers format straight into a slot of a fixed size
+// lock-free ring and return; a background thread drains the ring and writes
+// whole batches to stdout. Nothing on the calling side allocates, locks or
+// makes a syscall, so it is safe to log from the pulse thread or while
+// holding a mutex. If the ring is full the message is dropped and counted.
+class Log
+{
+public:
+    static constexpr size_t SlotCount = 512;
+    static constexpr size_t MaxMessageLength = 240;
+
+    template <typename... Args>
+    static void Write(LogLevel level, fmt::format_string<Args...> format, Args&&... args)
+    {
+        if ((int)level < minLevel_.load(std::memory_order_relaxed))
+            return;
+        Slot* slot = claimSlot();
+        if (slot == nullptr)
+            return;
+        try
+        {
+            auto result = fmt::format_to_n(slot->text, MaxMessageLength, format, std::forward<Args>(args)...);
+            slot->length = result.size < MaxMessageLength ? result.size : MaxMessageLength;
+        }
+        catch (...)
+        {
+            // The slot is already claimed, it has to be committed either way
+            slot->length = 0;
+        }
+        slot->level = level;
+        commitSlot(slot);
+    }
+
+    // Runtime threshold on top of the compile time one
+    static void SetLevel(LogLevel level);
+    static bool ParseLevel(const std::string& name, LogLevel& level);
+    // Block until everything queued so far has been written
+    static void Flush();
+    static uint64_t DroppedCount();
+    // Keep the writer thread off a CPU. It starts with the first message,
+    // usually before anything could reserve one.
+    static bool AvoidCpu(int cpu);
+
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence;
+        uint64_t position;
+        LogLevel level;
+        size_t length;
+        char text[MaxMessageLength];
+    };
+private:
+    static Slot* claimSlot();
+    static void commitSlot(Slot* slot);
+    static std::atomic<int> minLevel_;
+};
+
+// Lets one message through per interval from a call site
+class LogRateLimit
+{
+public:
+    explicit LogRateLimit(std::chrono::milliseconds interval);
+    bool Allow();
+private:
+    int64_t intervalNs_;
+    std::atomic<int64_t> nextAllowedNs_;
+};
+
+#define SILVANUS_LOG(level, ...) \
+    do { if constexpr ((int)(level) >= SILVANUS_LOG_LEVEL) Log::Write((level), __VA_ARGS__); } while (0)
+
+#define SILVANUS_LOG_EVERY(level, intervalMs, ...) \
+    do { \
+        if constexpr ((int)(level) >= SILVANUS_LOG_LEVEL) \
+        { \
+            static LogRateLimit logRateLimit_(std::chrono::milliseconds(intervalMs)); \
+            if (logRateLimit_.Allow()) Log::Write((level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(...) SILVANUS_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) SILVANUS_LOG(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARNING(...) SILVANUS_LOG(LogLevel::Warning, __VA_ARGS__)
+#define LOG_ERROR(...) SILVANUS_LOG(LogLevel::Error, __VA_ARGS__)
+
+#define LOG_DEBUG_EVERY(intervalMs, ...) SILVANUS_LOG_EVERY(LogLevel::Debug, intervalMs, __VA_ARGS__)
+#define LOG_INFO_EVERY(intervalMs, ...) SILVANUS_LOG_EVERY(LogLevel::Info, intervalMs, __VA_ARGS__)
+#define LOG_WARNING_EVERY(intervalMs, ...) SILVANUS_LOG_EVERY(LogLevel::Warning, intervalMs, __VA_ARGS__)
+#define LOG_ERROR_EVERY(intervalMs, ...) SILVANUS_LOG_EVERY(LogLevel::Error, intervalMs, __VA_ARGS__)
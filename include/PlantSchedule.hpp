@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ScheduleEngine.hpp"
+#include "Silvanus.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// The daily schedule, driven by the config settings: the original light
+// and watering settings plus any number of zones from the "zones" setting
+class PlantSchedule
+{
+public:
+    PlantSchedule(Silvanus& silvanus);
+    // Resume every resumable event (like the light) whose window is underway
+    // so that we don't lose a day's sunlight if the system reboots, and switch
+    // their channels off otherwise
+    void Prime();
+    // Run catch-up events whose last occurrence was missed while we were
+    // down, going by the event journal. Skipped when we are crash looping.
+    void CatchUp();
+    // Start any event that came due since the last call
+    void Evaluate();
+    // Run the pump for one day's worth of water
+    void WaterNow();
+    // The next count events to fire
+    nlohmann::json Upcoming(size_t count);
+
+    // Parse the "zones" setting, skipping bad events
+    static std::vector<ScheduleEvent> ParseZones(const nlohmann::json& zones, const Silvanus& silvanus);
+private:
+    // Rebuild the timeline from the current settings
+    void rebuild();
+
+    Silvanus& silvanus_;
+    std::mutex mutex_;
+    ScheduleEngine engine_;
+
+    // Plant watering parameters
+    int lightTime_; // When the light should turn on (seconds after local midnight)
+    int lightInterval_; // How long the light should run (seconds)
+    int waterTime_; // When to water the plants (seconds after local midnight)
+    float waterFlowRate_; // milliliters per second
+    float waterAmountPerDay_; // milliliters
+    nlohmann::json zones_;
+};
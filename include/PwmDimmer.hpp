@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+// Drives the BCM283x PWM peripheral (clocked from the oscillator by the
+// clock manager) in mark-space mode. Once a channel's duty is written the
+// hardware generates the waveform by itself, no CPU involved.
+//
+// Only GPIO 12/18 (PWM channel 0) and 13/19 (PWM channel 1) can be used.
+class PwmDimmer
+{
+public:
+    // Register block sizes in 32 bit words, as mapped by minimal_gpio.h
+    static constexpr int PwmWords = 0x28 / 4;
+    static constexpr int ClockWords = 0xA8 / 4;
+    static constexpr int GpioWords = 0xF4 / 4;
+
+    // Mapped peripheral registers (or a MockRegisters block)
+    struct Registers
+    {
+        volatile uint32_t* pwm;
+        volatile uint32_t* clock;
+        volatile uint32_t* gpio;
+    };
+
+    // Plain memory standing in for the peripherals off-Pi. The clock is
+    // never busy, so the driver runs the same register sequence against it.
+    struct MockRegisters
+    {
+        uint32_t pwm[PwmWords] = {};
+        uint32_t clock[ClockWords] = {};
+        uint32_t gpio[GpioWords] = {};
+        Registers Map() { return Registers{pwm, clock, gpio}; }
+    };
+
+    PwmDimmer(Registers registers, uint32_t oscillatorHz);
+
+    // Program the PWM clock for the given output frequency, with the finest
+    // duty resolution up to maxRange steps that the clock allows. Returns
+    // the frequency actually achieved (0 on failure).
+    uint32_t Start(uint32_t frequencyHz, uint32_t maxRange);
+    // Route the pin to its PWM channel and enable it at 0% duty.
+    // Returns the PWM channel, or -1 if the pin can't do PWM or its channel is taken.
+    int Attach(unsigned gpio);
+    // 0 to 1
+    void SetDuty(int channel, float duty);
+    uint32_t Range() const;
+private:
+    bool waitClockIdle();
+
+    Registers regs_;
+    uint32_t oscillatorHz_;
+    uint32_t range_;
+    unsigned channelGpio_[2];
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "SceneTable.hpp"
+#include "Silvanus.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// Control rules from the "rules" setting:
+//
+// "rules": [
+//     "humidity < 40 for 10m -> relay expansion on 5m",
+//     "temperature > 30 and not (humidity > 80) -> scene cool 15m",
+//     "reservoir == 1 -> relay pump off"
+// ]
+//
+// A condition compares temperature, humidity and the GPIO inputs (a switch
+// reads 1 while active, a flow meter its liters per minute) with numbers,
+// combined with and/or/not. The action runs once when the condition
+// becomes true, or after it has held for the "for" time, and again only
+// after it went false in between. Actions are relay/channel <name> on
+// [duration], relay/channel <name> off and scene <name> [duration].
+//
+// Rules are compiled into short postfix programs over numbered input slots,
+// and each slot lists the rules that read it, so a sample only re-runs the
+// rules whose inputs changed. "for" deadlines sleep on a timeline, nothing polls.
+class RuleEngine
+{
+public:
+    enum class Op : uint8_t
+    {
+        Input,      // Push slot's value
+        Constant,   // Push value
+        Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual,
+        And, Or, Not
+    };
+    struct Instruction
+    {
+        Op op;
+        uint16_t slot;
+        float value;
+    };
+    struct Action
+    {
+        enum class Type
+        {
+            ChannelOn,
+            ChannelOff,
+            Scene
+        };
+        Type type;
+        uint32_t channelMask;
+        std::string scene;
+        std::chrono::milliseconds duration; // 0 for no duration
+    };
+    struct Rule
+    {
+        std::string text;
+        std::vector<Instruction> program;
+        std::vector<uint16_t> slots;        // Inputs the condition reads
+        std::chrono::milliseconds hold;     // "for", 0 to act at once
+        Action action;
+
+        // Evaluation state
+        bool active;
+        bool pending;                       // Waiting out hold until deadline
+        std::chrono::steady_clock::time_point deadline;
+        uint64_t fired;
+    };
+    static constexpr size_t MaxStack = 16;
+
+    RuleEngine(Silvanus& silvanus, SceneTable& scenes);
+    ~RuleEngine();
+
+    // A new sensor sample arrived, the GPIO inputs are read along with it
+    void OnSample(float temperature, float humidity);
+    // Every rule with its state
+    nlohmann::json Status();
+
+    // Names of the input slots, in slot order
+    static std::vector<std::string> InputNames(const Silvanus& silvanus);
+    // Returns false and sets error if the rule is invalid
+    static bool Compile(const std::string& text, const std::vector<std::string>& inputs,
+                        const Silvanus& silvanus, Rule& rule, std::string& error);
+private:
+    void load(const nlohmann::json& rules);
+    // Call with mutex_ held. Queues the rule's action in actions_ if it is due.
+    void evaluate(size_t rule, std::chrono::steady_clock::time_point now);
+    void fire(Rule& rule);
+    // Run and clear the queued actions, call without mutex_ held
+    void runActions(std::vector<Action>& actions);
+    void timerFunc();
+
+    Silvanus& silvanus_;
+    SceneTable& scenes_;
+    std::vector<std::string> inputNames_;
+
+    std::mutex mutex_;
+    std::vector<Rule> rules_;
+    std::vector<float> values_;                     // By slot, NaN until the first sample
+    std::vector<std::vector<uint16_t>> dependents_; // Rules reading each slot
+    std::vector<uint8_t> queued_;                   // By rule, set while a sample collects what to run
+    std::set<std::pair<std::chrono::steady_clock::time_point, size_t>> deadlines_;
+    std::vector<Action> actions_;                   // Fired under the lock, run after it
+
+    std::condition_variable timerCv_;
+    bool exit_;
+    std::unique_ptr<std::thread> timerThread_;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// One sensor reading as kept in the runtime state
+struct StateSample
+{
+    int64_t timeNs;     // Wall clock, ns since the epoch
+    float temperature;
+    float humidity;
+};
+
+// Min, max and sum of one series' readings, failed (NaN) readings left out
+struct StateSeriesSummary
+{
+    uint32_t count;     // Readings that aren't NaN
+    float min;
+    float max;
+    double sum;
+};
+
+// One hour of samples, summarized, kept long after the samples are gone
+struct StateRollup
+{
+    int64_t timeNs;     // Start of the hour (UTC)
+    uint32_t count;     // Samples, NaN or not
+    StateSeriesSummary temperature;
+    StateSeriesSummary humidity;
+};
+
+// Runtime state that outlives the process: a named shared memory object
+// that a restarted Silvanus re-attaches to, so a restart or an upgrade with
+// the same layout picks up in-flight pulses and the sample history instead
+// of starting cold. /dev/shm is cleared on reboot, which is also when the
+// steady clock times stored here stop meaning anything.
+class RuntimeState
+{
+public:
+    // Bump whenever Region changes
+    static constexpr uint32_t Version = 2;
+    static constexpr size_t MaxChannels = 32;
+    static constexpr size_t SampleCapacity = 8192;
+    // Hours of rollups, about five and a half months
+    static constexpr size_t RollupCapacity = 4096;
+    static constexpr int64_t RollupPeriodNs = 3600000000000;
+
+    struct SampleRing
+    {
+        // Samples ever written, the slot is written before this is bumped
+        std::atomic<uint64_t> head;
+        StateSample samples[SampleCapacity];
+    };
+
+    struct RollupRing
+    {
+        // Hours ever started, the one before head is still being filled
+        std::atomic<uint64_t> head;
+        StateRollup rollups[RollupCapacity];
+    };
+
+    struct Region
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t size;
+        char bootId[40];
+        uint64_t layout;            // Hash of the output channel table the pulses refer to
+
+        // Odd while a writer is updating offTimesNs
+        std::atomic<uint32_t> pulseSeq;
+        std::atomic<uint32_t> channelState;
+        int64_t offTimesNs[MaxChannels];    // Steady clock, 0 for none
+
+        SampleRing samples;
+        RollupRing rollups;
+    };
+
+    // Attaches to (or creates) the shared memory object `name`. Anything
+    // from another boot, version or size is thrown away. Pulses are only
+    // kept if `layout` matches. An empty name or a failure to map keeps
+    // the state in process memory instead.
+    RuntimeState(const std::string& name, uint64_t layout);
+    ~RuntimeState();
+
+    Region& Get();
+    // Whether the samples came from a previous run
+    bool Resumed() const;
+    // Whether the pulses came from a previous run with the same channel table
+    bool PulsesResumed() const;
+private:
+    Region* region_;
+    std::unique_ptr<Region> local_;
+    bool resumed_;
+    bool pulsesResumed_;
+};
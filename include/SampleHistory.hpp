@@ -0,0 +1,78 @@
+#pragma once
+
+#include "RuntimeState.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// Sensor readings over time, oldest dropped first, kept in the runtime
+// state ring so they survive a restart. A segment tree over the ring's
+// slots answers min/max/mean over any time range in O(log n). Every
+// sample is also summed into an hourly rollup that outlives it by months,
+// so aggregates reach back past the ring to the hour.
+class SampleHistory
+{
+public:
+    using Clock = std::chrono::system_clock;
+
+    using SeriesSummary = StateSeriesSummary;
+    struct Summary
+    {
+        uint32_t count;     // Samples, NaN or not
+        SeriesSummary temperature;
+        SeriesSummary humidity;
+    };
+    struct Bucket
+    {
+        int64_t timeNs;     // Start of the bucket
+        Summary summary;
+    };
+    enum class Series
+    {
+        Temperature,
+        Humidity
+    };
+    struct ChartPoint
+    {
+        int64_t timeNs;
+        float value;
+    };
+
+    SampleHistory(RuntimeState::SampleRing& ring, RuntimeState::RollupRing& rollups);
+
+    // Times never go backwards in the ring, an earlier time is clamped to the last one
+    void Record(Clock::time_point time, float temperature, float humidity);
+    size_t Size() const;
+    // Up to limit samples with from <= time < to, oldest first
+    std::vector<StateSample> Range(Clock::time_point from, Clock::time_point to, size_t limit) const;
+    // Cursor of the first sample at or after time, to Read() from
+    uint64_t Seek(Clock::time_point time) const;
+    // Copy up to max samples before `to` from the cursor on and advance it.
+    // Samples the ring dropped since the cursor was taken are skipped.
+    size_t Read(uint64_t& cursor, Clock::time_point to, StateSample* out, size_t max) const;
+    // Summaries of [from, to) in buckets of step, empty buckets left out.
+    // Before the oldest sample's hour they come from the hourly rollups.
+    std::vector<Bucket> Aggregate(Clock::time_point from, Clock::time_point to, std::chrono::nanoseconds step) const;
+    // At most `points` (3 or more) samples of [from, to) that keep the shape
+    // of the series, picked with Largest-Triangle-Three-Buckets. NaN
+    // readings are never picked.
+    std::vector<ChartPoint> Chart(Series series, Clock::time_point from, Clock::time_point to, size_t points) const;
+private:
+    // Index of the first retained sample at or after timeNs
+    uint64_t lowerBound(int64_t timeNs) const;
+    void setLeaf(size_t slot, const StateSample& sample);
+    void rollUp(const StateSample& sample);
+    // Samples before this are only covered by the rollups
+    int64_t rawStartNs() const;
+    // Index of the first retained rollup at or after timeNs
+    uint64_t rollupLowerBound(int64_t timeNs) const;
+    Summary querySlots(size_t first, size_t last) const;
+    Summary query(uint64_t first, uint64_t last) const;
+
+    RuntimeState::SampleRing& ring_;
+    RuntimeState::RollupRing& rollups_;
+    // Leaves at [SampleCapacity, 2 * SampleCapacity) mirror the ring slots, node i covers 2i and 2i + 1
+    std::vector<Summary> tree_;
+    mutable std::mutex mutex_;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Silvanus.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// Named output states from the "scenes" setting, compiled to channel masks.
+//
+// "scenes": {
+//     "day":   { "on": ["light", "fan"], "off": ["heater"] },
+//     "night": { "on": ["heater"], "exclusive": true },
+//     "flush": { "steps": [ { "at": 0, "on": ["pump"] },
+//                           { "at": 1500, "on": ["fan"], "off": ["pump"] } ] }
+// }
+//
+// "at" is milliseconds after the scene starts. "exclusive" switches every
+// channel the step doesn't name off.
+class SceneTable
+{
+public:
+    struct Step
+    {
+        std::chrono::milliseconds at;
+        uint32_t onMask;
+        uint32_t offMask;
+    };
+
+    enum class ApplyResult
+    {
+        Applied,
+        UnknownScene,
+        BadDuration
+    };
+
+    SceneTable(Silvanus& silvanus);
+
+    // Start the scene, replacing any scene still sequencing. With a
+    // duration, every channel the scene switched on goes off again that
+    // long after it started (0 for no duration). A duration that ends
+    // before the scene's last step or is over maxPulseDuration is a BadDuration.
+    ApplyResult Apply(const std::string& name, std::chrono::milliseconds duration);
+    std::vector<std::string> Names() const;
+
+    // Returns false and sets error if the definition is invalid
+    static bool Compile(const nlohmann::json& definition, const Silvanus& silvanus,
+                        std::vector<Step>& steps, std::string& error);
+private:
+    void load(const nlohmann::json& scenes);
+
+    Silvanus& silvanus_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::vector<Step>> scenes_;
+};
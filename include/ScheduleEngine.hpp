@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// One recurring daily event: switch channels on at a time of day for a while
+struct ScheduleEvent
+{
+    std::string zone;
+    uint32_t channelMask;
+    int timeOfDay;                      // Seconds after local midnight
+    std::chrono::milliseconds duration;
+    uint8_t weekdays;                   // Bit 0 is Sunday, like tm_wday
+    bool resume;                        // Pick up the rest of the window if it is underway at startup
+    bool catchUp;                       // Run a missed occurrence late after downtime
+    uint32_t key;                       // Identifies the event across restarts (see EventKey)
+};
+
+// Keeps every event's next occurrence in a time-ordered timeline, so a tick
+// only looks at the front and firing an event costs O(log n) to reschedule.
+class ScheduleEngine
+{
+public:
+    using Clock = std::chrono::system_clock;
+    static constexpr uint8_t EveryDay = 0x7F;
+
+    // Replace all events. Only occurrences after `now` go in the timeline.
+    void SetEvents(std::vector<ScheduleEvent> events, Clock::time_point now);
+    const std::vector<ScheduleEvent>& Events() const;
+
+    // Calls fire(event) for every event due by now, in time order, and moves
+    // each fired event on to its first occurrence after now. After the clock
+    // jumps forward an event fires once, not once per day skipped.
+    template <typename F>
+    void FireDue(Clock::time_point now, F&& fire)
+    {
+        while (!timeline_.empty() && timeline_.begin()->at <= now)
+        {
+            Entry entry = *timeline_.begin();
+            timeline_.erase(timeline_.begin());
+            const ScheduleEvent& event = events_[entry.event];
+            fire(event);
+            schedule(entry.event, std::max(entry.at, now));
+        }
+    }
+
+    // time_point::max() if nothing is scheduled
+    Clock::time_point NextFire() const;
+    // The next count occurrences, without consuming them
+    std::vector<std::pair<Clock::time_point, const ScheduleEvent*>> Upcoming(size_t count) const;
+
+    // First occurrence strictly after `after`, time_point::max() if there is none
+    static Clock::time_point NextOccurrence(const ScheduleEvent& event, Clock::time_point after);
+    // Last occurrence that started at or before `now`, time_point::min() if there is none
+    static Clock::time_point PreviousOccurrence(const ScheduleEvent& event, Clock::time_point now);
+    // End of the occurrence underway at `now`, time_point::min() if none is
+    static Clock::time_point OngoingUntil(const ScheduleEvent& event, Clock::time_point now);
+    // Hash of where an event is configured, its zone and position in it, so
+    // moving its time or changing its duration keeps the key
+    static uint32_t EventKey(const std::string& zone, size_t index);
+private:
+    struct Entry
+    {
+        Clock::time_point at;
+        size_t event;
+        bool operator<(const Entry& other) const
+        {
+            return at < other.at || (at == other.at && event < other.event);
+        }
+    };
+
+    void schedule(size_t event, Clock::time_point after);
+
+    std::vector<ScheduleEvent> events_;
+    std::set<Entry> timeline_;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Streaming filter chain for one sensor, configured per sensor in the
+// "sensorFilters" setting:
+//
+// "sensorFilters": {
+//     "humidity": [{"type": "outlier", "window": 7, "threshold": 3}, {"type": "median", "size": 5}],
+//     "temperature": [{"type": "rate", "max": 2}, {"type": "kalman", "q": 0.01, "r": 0.25}]
+// }
+//
+// Stages run in order: median of the last size readings, ema with weight
+// alpha, kalman for a slowly drifting value with process noise q and
+// measurement noise r, outlier (Hampel) replacing readings more than
+// threshold deviations from the window's median, and rate limiting each
+// step to max. All state lives in fixed arrays inside the chain so a
+// sample never allocates. Failed (NaN) readings pass through untouched.
+class SensorFilter
+{
+public:
+    static constexpr size_t MaxStages = 8;
+    static constexpr size_t MaxWindow = 15;
+
+    enum class Type : uint8_t
+    {
+        Median,
+        Ema,
+        Kalman,
+        Outlier,
+        RateLimit
+    };
+    struct Stage
+    {
+        Type type;
+        uint8_t size;       // Window of median and outlier
+        float param;        // alpha, q, threshold or max step
+        float noise;        // Kalman measurement noise r
+        std::array<float, MaxWindow> window;
+        uint8_t count;
+        uint8_t next;
+        bool primed;
+        float estimate;     // Last output of ema, kalman and rate
+        float error;        // Kalman error variance
+        uint64_t adjusted;  // Readings replaced or limited
+    };
+
+    SensorFilter();
+
+    // Build a chain from the json list of stages. On error the chain is
+    // left unchanged and error says which stage is wrong.
+    bool Configure(const nlohmann::json& stages, std::string& error);
+    // Run a reading through the chain
+    float Filter(float raw);
+    // Forget the history, keeping the stages
+    void Reset();
+
+    size_t StageCount() const;
+    // How many samples the output lags a step of the input in steady state
+    float DelaySamples() const;
+    // Stages, last reading and output, their variance over roughly the last
+    // 20 samples, readings adjusted and time spent per sample
+    nlohmann::json Status() const;
+private:
+    static float median(const float* values, size_t count);
+    float run(Stage& stage, float value);
+
+    std::array<Stage, MaxStages> stages_;
+    size_t stageCount_;
+
+    // Exponentially weighted mean and variance of input and output
+    struct Moments
+    {
+        float mean;
+        float variance;
+        bool primed;
+        void Add(float value);
+    };
+    Moments rawMoments_;
+    Moments filteredMoments_;
+    float lastRaw_;
+    float lastFiltered_;
+    uint64_t samples_;
+    uint64_t lastNs_;
+    uint64_t maxNs_;
+    uint64_t totalNs_;
+};
@@ -1,37 +1,194 @@
 #pragma once
 
 #include "Adafruit_SHT31.hpp"
+#include "EventJournal.hpp"
+#include "GpioBackend.hpp"
+#include "GpioInputs.hpp"
+#include "LatencyHistogram.hpp"
+#include "LightRamp.hpp"
+#include "PwmDimmer.hpp"
+#include "RuntimeState.hpp"
+#include "SampleHistory.hpp"
+#include "SensorFilter.hpp"
 
+#include <array>
+#include <string>
 #include <vector>
+#include <atomic>
 #include <mutex>
+#include <condition_variable>
 #include <thread>
 #include <memory>
+#include <nlohmann/json.hpp>
+
+// One relay (or any other output pin) driven by Silvanus
+struct OutputChannel
+{
+    std::string name;   // Unique, used by the API
+    std::string role;   // What it drives: "light", "pump", "fan", ... (empty for nothing in particular)
+    unsigned gpio;      // BCM pin number, must be in GPIO bank 1 (0-31)
+    bool activeLow;     // Relay boards that switch on when the pin is pulled low
+};
+
+// A timed change of channel state
+struct ChannelTransition
+{
+    std::chrono::steady_clock::time_point at;
+    uint32_t onMask;
+    uint32_t offMask;
+};
+
+// One step of Silvanus::ApplyChanges. With a duration the channels in
+// onMask are pulsed for that long, offMask is only for plain switching.
+struct ChannelChange
+{
+    uint32_t onMask;
+    uint32_t offMask;
+    std::chrono::milliseconds duration;
+};
 
 class Silvanus
 {
 public:
+    // Channel i is bit i of every channel mask
+    static constexpr size_t MaxChannels = 32;
+
     Silvanus();
     ~Silvanus();
+
+    // Build the channel table from the "outputChannels" config json, skipping bad entries
+    static std::vector<OutputChannel> ParseChannels(const nlohmann::json& table);
+    static nlohmann::json DefaultChannels();
+
+    const std::vector<OutputChannel>& Channels() const;
+    // -1 if there is no such channel
+    int FindChannel(const std::string& name) const;
+    int FindChannelByRole(const std::string& role) const;
+    // Switch every channel in onMask on and every channel in offMask off
+    // with a single set and a single clear register write. Off wins if a
+    // channel is in both.
+    void SetChannels(uint32_t onMask, uint32_t offMask);
+    uint32_t GetChannels() const;
+    void SetChannel(int channel, bool state);
+    bool GetChannel(int channel) const;
+    // Switch the channels on now and off again after duration. elapsed is
+    // how far into the pulse we already are (when resuming one after a
+    // restart), dimmed lights use it to pick up their ramp.
+    void PulseChannels(uint32_t mask, std::chrono::milliseconds duration,
+                       std::chrono::milliseconds elapsed = std::chrono::milliseconds(0));
+    // Play a sequence of transitions on the pulse thread, replacing any
+    // sequence still pending. Transitions already due are applied at once.
+    void RunSequence(std::vector<ChannelTransition> sequence);
+    // Apply changes in order as one transaction: later changes win channel
+    // by channel, the pins change with one set and one clear write, and the
+    // pulse thread sees all of them or none. A channel ends up pulsed only if
+    // its last change is a pulse, a plain change cancels its pending pulse.
+    void ApplyChanges(const std::vector<ChannelChange>& changes);
+
+    // Shorthands for the channels with the "light" and "pump" roles
     void SetLight(bool state);
     void SetPump(bool state);
     bool GetLight();
     bool GetPump();
     void PulseLight(std::chrono::seconds duration);
     void PulsePump(std::chrono::seconds duration);
+    // Sunrise/sunset dimming of the channels that have a PWM dimmer
+    LightRamp& Dimming();
+    // Flow meters and float switches
+    const GpioInputs& Inputs() const;
+    // Channels held off by an active switch input
+    uint32_t InterlockedChannels() const;
+    // Every channel change and schedule event, kept across restarts
+    EventJournal& Journal();
+    // Restart the pulses that were running when the previous process
+    // stopped and still have time left. Call after the schedule is primed.
+    void ResumePulses();
+    // Sensor readings, kept across restarts
+    SampleHistory& History();
     float GetHumidity();
     float GetTemperature();
+    // Read both sensors at once and run them through their "sensorFilters"
+    // chains, this is what the history and the rules get
+    void Sample(float& temperature, float& humidity);
+    // The last raw reading if it is at most maxAge old, else a fresh one,
+    // so pollers share I2C transactions
+    void CachedReading(std::chrono::milliseconds maxAge, float& temperature, float& humidity);
+    // Each sensor's filter chain with its variance and latency
+    nlohmann::json FilterStatus();
+    // How late pulses were switched off relative to their deadline
+    const LatencyHistogram& OffDeadlineLateness() const;
+    // Off-deadlines that ran later than actuatorDeadlineTolerance
+    uint64_t DeadlineMissCount() const;
+    std::chrono::microseconds DeadlineTolerance() const;
+    // Longest pulse or scene duration a command may ask for
+    std::chrono::milliseconds MaxPulseDuration() const;
+    // True if the pulse thread got the SCHED_FIFO priority it asked for
+    bool PulseThreadRealtime() const;
 private:
+    static uint32_t channelBit(int channel);
+
+    std::vector<OutputChannel> channels_;
+    int lightChannel_;
+    int pumpChannel_;
+    // GPIO bank 1 bit of each channel, and which of them are active low
+    std::array<uint32_t, MaxChannels> gpioBits_;
+    uint32_t activeLowBits_;
+    // Logical channel state, bit i set means channel i is on. Written
+    // under ioMutex_ so it always matches the pins, read without locking.
+    std::atomic<uint32_t> channelState_;
+    // Records channel changes in the order they hit the pins
+    std::unique_ptr<EventJournal> journal_;
+    // Shared memory mirror of the channel state and pending off times, and
+    // the off times it held at startup
+    std::unique_ptr<RuntimeState> state_;
+    std::array<int64_t, MaxChannels> resumedOffTimesNs_;
+    uint32_t resumedChannels_;
+    std::unique_ptr<SampleHistory> history_;
+    // Call with threadMutex_ held
+    void saveOffTimes();
+
+    // Serializes GPIO writes. Kept separate from the sensor so a slow
+    // I2C read never holds up switching a relay off.
     std::mutex ioMutex_;
-    #ifndef PI_HOST
-    bool lightState_;
-    bool pumpState_;
-    #endif
+    std::mutex sensorMutex_;
+    // Last readBoth() and when it was, under sensorMutex_
+    std::chrono::steady_clock::time_point readingTime_;
+    float lastTemperature_;
+    float lastHumidity_;
+    // Configured from a settings subscriber, run from the main loop
+    std::mutex filterMutex_;
+    SensorFilter temperatureFilter_;
+    SensorFilter humidityFilter_;
+    void configureFilters(const nlohmann::json& filters);
 
     void pulseThreadFunc();
+    void recordOffDeadline(std::chrono::steady_clock::time_point deadline);
+    int realtimePriority_;
+    int pulseCpu_;
+    std::atomic<bool> pulseThreadRealtime_;
     bool exit_;
-    std::chrono::steady_clock::time_point lightOffTime_;
-    std::chrono::steady_clock::time_point pumpOffTime_;
+    // When each channel's pulse ends, max() if it has none pending
+    std::array<std::chrono::steady_clock::time_point, MaxChannels> offTimes_;
+    // Pending sequence, sorted by time, played from sequenceNext_ on
+    std::vector<ChannelTransition> sequence_;
+    size_t sequenceNext_;
+    // Merge every transition due by now into one pair of masks
+    void takeDueTransitions(std::chrono::steady_clock::time_point now, uint32_t& onMask, uint32_t& offMask);
     std::mutex threadMutex_;
+    std::condition_variable pulseCv_;
     std::unique_ptr<std::thread> pulseThread_;
+    std::chrono::microseconds deadlineTolerance_;
+    std::chrono::milliseconds maxPulseDuration_;
+    LatencyHistogram offDeadlineLateness_;
+    std::atomic<uint64_t> deadlineMisses_;
     Adafruit_SHT31 tempHumSensor_;
+
+    // Relay pins and the PWM registers, real or simulated depending on the build
+    Gpio gpio_;
+    std::unique_ptr<PwmDimmer> pwm_;
+    std::unique_ptr<LightRamp> ramp_;
+
+    void applyInterlock();
+    std::atomic<uint32_t> interlock_;
+    std::unique_ptr<GpioInputs> inputs_;
 };
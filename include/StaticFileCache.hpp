@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+// In-memory copy of the web UI files, keyed by file name
+class StaticFileCache
+{
+public:
+    struct File
+    {
+        std::string content;
+        std::string mimeType;
+    };
+
+    // Read every servable file (html, css, js) in the directory
+    void Load(const std::string& directory);
+    // Returns nullptr if the file is not cached
+    const File* Find(const std::string& filename) const;
+    const std::unordered_map<std::string, File>& Files() const;
+    static std::string GetMimeType(const std::string& filename);
+private:
+    std::unordered_map<std::string, File> files_;
+};
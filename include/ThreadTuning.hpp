@@ -0,0 +1,18 @@
+#pragma once
+
+#include <thread>
+
+// Scheduling helpers for the thread that calls them (unless given one). All return false
+// (and leave the thread as it was) if the OS refuses, e.g. without root.
+class ThreadTuning
+{
+public:
+    // Run under SCHED_FIFO at the given priority (1-99)
+    static bool SetRealtimePriority(int priority);
+    // Restrict to a single CPU
+    static bool PinToCpu(int cpu);
+    // Keep off a CPU. Threads created afterwards inherit this.
+    static bool AvoidCpu(int cpu);
+    // Same for another, already running thread
+    static bool AvoidCpu(std::thread& thread, int cpu);
+};
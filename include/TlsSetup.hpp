@@ -0,0 +1,22 @@
+#pragma once
+
+#include <openssl/ssl.h>
+#include <string>
+
+// OpenSSL setup for the HTTPS listener. A Pi 3 has no AES instructions and
+// spends tens of milliseconds on a full handshake, so everything here aims
+// at doing as few of them as possible: a small ECDSA key, ChaCha20 first,
+// and session resumption through both a server cache and tickets.
+class TlsSetup
+{
+public:
+    // Make sure certPath and keyPath hold a usable pair. A self-signed ECDSA
+    // P-256 certificate is generated if they are missing, and one we generated
+    // is replaced when it expires within renewDays. Certificates from anyone
+    // else are never touched. Returns false if there is no usable pair.
+    static bool EnsureCertificate(const std::string& certPath, const std::string& keyPath, int validDays, int renewDays);
+
+    // Load the pair into a server context and set protocols, ciphers and resumption
+    static bool ConfigureServer(SSL_CTX& ctx, const std::string& certPath, const std::string& keyPath,
+                                long sessionCacheSize, long sessionTimeoutSec);
+};
@@ -73,6 +73,8 @@ static volatile int pi_is_2711 = 0;
 static volatile uint32_t* gpioReg = (uint32_t*)MAP_FAILED;
 static volatile uint32_t* systReg = (uint32_t*)MAP_FAILED;
 static volatile uint32_t* bscsReg = (uint32_t*)MAP_FAILED;
+static volatile uint32_t* pwmReg  = (uint32_t*)MAP_FAILED;
+static volatile uint32_t* clkReg  = (uint32_t*)MAP_FAILED;
 
 #define PI_BANK (gpio>>5)
 #define PI_BIT  (1<<(gpio&0x1F))
@@ -225,7 +227,7 @@ unsigned gpioHardwareRevision(void)
          if (!piPeriphBase)
             piPeriphBase = buf[8]<<24 | buf[9]<<16 | buf[10]<<8 | buf[11];
 
-         if (piPeriphBase == 0xFE00000) pi_is_2711 = 1;
+         if (piPeriphBase == 0xFE000000) pi_is_2711 = 1;
       }
       fclose(filp);
    }
@@ -268,12 +270,16 @@ int gpioInitialise(void)
    gpioReg  = initMapMem(fd, GPIO_BASE,  GPIO_LEN);
    systReg  = initMapMem(fd, SYST_BASE,  SYST_LEN);
    bscsReg  = initMapMem(fd, BSCS_BASE,  BSCS_LEN);
+   pwmReg   = initMapMem(fd, PWM_BASE,   PWM_LEN);
+   clkReg   = initMapMem(fd, CLK_BASE,   CLK_LEN);
 
    close(fd);
 
    if ((gpioReg == (uint32_t*)MAP_FAILED) ||
        (systReg == (uint32_t*)MAP_FAILED) ||
-       (bscsReg == (uint32_t*)MAP_FAILED))
+       (bscsReg == (uint32_t*)MAP_FAILED) ||
+       (pwmReg  == (uint32_t*)MAP_FAILED) ||
+       (clkReg  == (uint32_t*)MAP_FAILED))
    {
       fprintf(stderr,
          "Bad, mmap failed\n");
@@ -0,0 +1,54 @@
+function fleetMain()
+{
+    getFleet();
+}
+
+function fleetCell(row, text)
+{
+    var cell = document.createElement("td");
+    cell.innerText = text;
+    row.appendChild(cell);
+}
+
+function getFleet()
+{
+    var url = "/fleet";
+    var xhr = new XMLHttpRequest();
+    xhr.open("GET", url);
+
+    xhr.setRequestHeader("Accept", "application/json");
+
+    xhr.onreadystatechange = function () {
+    if (xhr.readyState === 4) {
+        if (xhr.status < 300 && xhr.status >= 200)
+        {
+            var fleet = JSON.parse(xhr.responseText);
+            var body = document.getElementById("fleetNodes");
+            body.innerHTML = "";
+            var online = 0;
+            fleet.nodes.forEach(function (node) {
+                var status = node.status || {};
+                var row = document.createElement("tr");
+                fleetCell(row, node.name);
+                fleetCell(row, node.address);
+                fleetCell(row, node.online ? Math.round(status["temperature"]) + " ℃" : "-");
+                fleetCell(row, node.online ? Math.round(status["humidity"]) + " %" : "-");
+                fleetCell(row, node.online ? (status["light-on"] ? "On" : "Off") : "-");
+                fleetCell(row, node.online ? (status["pump-on"] ? "On" : "Off") : "-");
+                fleetCell(row, node.online ? "OK" : (node.error || "Waiting"));
+                if (node.online) online++;
+                body.appendChild(row);
+            });
+            document.getElementById("fleetMsg").innerText = online + " of " + fleet.nodes.length + " online";
+        }
+        else
+        {
+            console.log(xhr.status);
+            console.log(xhr.responseText);
+            document.getElementById("fleetMsg").innerText = "Error! Retrying.";
+        }
+        setTimeout(getFleet, 2000);
+    }};
+
+    xhr.send();
+}
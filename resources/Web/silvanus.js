@@ -1,28 +1,66 @@
 function silvanusMain()
 {
-    getSettings();
-    getStatus(true);
+    getDashboard("settings," + STATUS_FIELDS, true);
+    getCharts(true);
 }
 
-function getSettings()
+function getCharts(loop = false)
 {
-    var url = "/system/settings";
+    getChart("temperature", "chartTemperature", "#00965d");
+    getChart("humidity", "chartHumidity", "#1e7795");
+
+    if (loop)
+    {
+        setTimeout(function () { getCharts(true); }, 60000);
+    }
+}
+
+// The server picks one point per canvas pixel (LTTB), so this only draws
+function getChart(series, canvasId, color)
+{
+    var canvas = document.getElementById(canvasId);
+    var range = parseInt(document.getElementById("historyRange").value);
+    var to = Math.floor(Date.now() / 1000);
+    var url = "/history/chart?series=" + series + "&from=" + (to - range) + "&to=" + to + "&points=" + canvas.width;
     var xhr = new XMLHttpRequest();
     xhr.open("GET", url);
 
     xhr.setRequestHeader("Accept", "application/json");
-    xhr.setRequestHeader("Content-Type", "application/json");
 
     xhr.onreadystatechange = function () {
     if (xhr.readyState === 4) {
+        var context = canvas.getContext("2d");
+        context.clearRect(0, 0, canvas.width, canvas.height);
         if (xhr.status < 300 && xhr.status >= 200)
         {
-            var settings = JSON.parse(xhr.responseText);
-            document.getElementById("lightInterval").value = settings.lightInterval;
-            document.getElementById("lightTime").value = settings.lightTime;
-            document.getElementById("waterAmountPerDay").value = settings.waterAmountPerDay;
-            document.getElementById("waterFlowRate").value = settings.waterFlowRate;
-            document.getElementById("waterTime").value = settings.waterTime;
+            var points = JSON.parse(xhr.responseText).points;
+            if (points.length < 2)
+            {
+                return;
+            }
+            var low = Infinity;
+            var high = -Infinity;
+            points.forEach(function (point) {
+                low = Math.min(low, point[1]);
+                high = Math.max(high, point[1]);
+            });
+            var span = Math.max(high - low, 1);
+            var pad = 14;
+
+            context.strokeStyle = color;
+            context.lineWidth = 1.5;
+            context.beginPath();
+            points.forEach(function (point, i) {
+                var x = (point[0] - (to - range)) / range * canvas.width;
+                var y = canvas.height - pad - (point[1] - low) / span * (canvas.height - 2 * pad);
+                if (i == 0) context.moveTo(x, y); else context.lineTo(x, y);
+            });
+            context.stroke();
+
+            context.fillStyle = "#EEE5E5";
+            context.font = "11px Arial";
+            context.fillText(high.toFixed(1), 2, 11);
+            context.fillText(low.toFixed(1), 2, canvas.height - 2);
         }
         else
         {
@@ -34,9 +72,17 @@ function getSettings()
     xhr.send();
 }
 
-function getStatus(loop = true)
+// What the status line shows, polled every second in one request
+var STATUS_FIELDS = "status.temperature,status.humidity,status.light-on,status.pump-on";
+
+function getSettings()
+{
+    getDashboard("settings", false);
+}
+
+function getDashboard(fields, loop)
 {
-    var url = "/status";
+    var url = "/dashboard?fields=" + fields;
     var xhr = new XMLHttpRequest();
     xhr.open("GET", url);
 
@@ -47,16 +93,29 @@ function getStatus(loop = true)
     if (xhr.readyState === 4) {
         if (xhr.status < 300 && xhr.status >= 200)
         {
-            var status = JSON.parse(xhr.responseText);
-            document.getElementById("statusTemp").innerText = Math.round(status["temperature"]);
-            document.getElementById("statusHumidity").innerText = Math.round(status["humidity"]);
-            document.getElementById("statusLight").innerText = status["light-on"] ? "On" : "Off";
-            document.getElementById("statusPump").innerText = status["pump-on"] ? "On" : "Off";
-            document.getElementById("statusMsg").innerText = "OK"
+            var dashboard = JSON.parse(xhr.responseText);
+            var settings = dashboard.settings;
+            if (settings)
+            {
+                document.getElementById("lightInterval").value = settings.lightInterval;
+                document.getElementById("lightTime").value = settings.lightTime;
+                document.getElementById("waterAmountPerDay").value = settings.waterAmountPerDay;
+                document.getElementById("waterFlowRate").value = settings.waterFlowRate;
+                document.getElementById("waterTime").value = settings.waterTime;
+            }
+            var status = dashboard.status;
+            if (status)
+            {
+                document.getElementById("statusTemp").innerText = Math.round(status["temperature"]);
+                document.getElementById("statusHumidity").innerText = Math.round(status["humidity"]);
+                document.getElementById("statusLight").innerText = status["light-on"] ? "On" : "Off";
+                document.getElementById("statusPump").innerText = status["pump-on"] ? "On" : "Off";
+                document.getElementById("statusMsg").innerText = "OK"
+            }
 
             if (loop)
             {
-                setTimeout(getStatus, 1000);
+                setTimeout(function () { getDashboard(STATUS_FIELDS, true); }, 1000);
             }
         }
         else
@@ -64,11 +123,14 @@ function getStatus(loop = true)
             console.log(xhr.status);
             console.log(xhr.responseText);
 
-            document.getElementById("statusTemp").innerText = "-";
-            document.getElementById("statusHumidity").innerText = "-";
-            document.getElementById("statusLight").innerText = "-";
-            document.getElementById("statusPump").innerText = "-";
-            document.getElementById("statusMsg").innerText = "Error! Refresh to try again."
+            if (loop)
+            {
+                document.getElementById("statusTemp").innerText = "-";
+                document.getElementById("statusHumidity").innerText = "-";
+                document.getElementById("statusLight").innerText = "-";
+                document.getElementById("statusPump").innerText = "-";
+                document.getElementById("statusMsg").innerText = "Error! Refresh to try again."
+            }
         }
     }};
 
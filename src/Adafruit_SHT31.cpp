@@ -173,7 +173,7 @@ void Adafruit_SHT31::readBoth(float *temperature_out, float *humidity_out)
  *
  * @return The computed CRC8 value.
  */
-static uint8_t crc8(const uint8_t *data, int len)
+uint8_t Adafruit_SHT31::crc8(const uint8_t *data, int len)
 {
   /*
    *
@@ -202,34 +202,49 @@ static uint8_t crc8(const uint8_t *data, int len)
 }
 
 /**
- * Internal function to perform a temp + humidity read.
+ * Checks and converts a raw 6 byte measurement frame
+ * (temperature MSB, LSB, CRC, humidity MSB, LSB, CRC).
  *
- * @return True if successful, otherwise false.
+ * @param frame            The 6 bytes read back from the sensor.
+ * @param temperature_out  Where to write the temperature float.
+ * @param humidity_out     Where to write the relative humidity float.
+ *
+ * @return True if both CRCs matched, otherwise false.
  */
-bool Adafruit_SHT31::readTempHum(void)
+bool Adafruit_SHT31::decodeTempHum(const uint8_t *frame, float *temperature_out, float *humidity_out)
 {
-  uint8_t readbuffer[6];
-  readI2C(SHT31_MEAS_HIGHREP, readbuffer, 6, 20.0);
-
-  if (readbuffer[2] != crc8(readbuffer, 2) ||
-      readbuffer[5] != crc8(readbuffer + 3, 2))
+  if (frame[2] != crc8(frame, 2) ||
+      frame[5] != crc8(frame + 3, 2))
     return false;
 
-  int32_t stemp = (int32_t)(((uint32_t)readbuffer[0] << 8) | readbuffer[1]);
+  int32_t stemp = (int32_t)(((uint32_t)frame[0] << 8) | frame[1]);
   // simplified (65536 instead of 65535) integer version of:
   // temp = (stemp * 175.0f) / 65535.0f - 45.0f;
   stemp = ((4375 * stemp) >> 14) - 4500;
-  temp = (float)stemp / 100.0f;
+  *temperature_out = (float)stemp / 100.0f;
 
-  uint32_t shum = ((uint32_t)readbuffer[3] << 8) | readbuffer[4];
+  uint32_t shum = ((uint32_t)frame[3] << 8) | frame[4];
   // simplified (65536 instead of 65535) integer version of:
   // humidity = (shum * 100.0f) / 65535.0f;
   shum = (625 * shum) >> 12;
-  humidity = (float)shum / 100.0f;
+  *humidity_out = (float)shum / 100.0f;
 
   return true;
 }
 
+/**
+ * Internal function to perform a temp + humidity read.
+ *
+ * @return True if successful, otherwise false.
+ */
+bool Adafruit_SHT31::readTempHum(void)
+{
+  uint8_t readbuffer[6];
+  readI2C(SHT31_MEAS_HIGHREP, readbuffer, 6, 20.0);
+
+  return decodeTempHum(readbuffer, &temp, &humidity);
+}
+
 /**
  * Internal function to perform and I2C write.
  *
@@ -0,0 +1,678 @@
+#include "ApiRoutes.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "CommandBatch.hpp"
+#include "Dashboard.hpp"
+#include "HistoryExport.hpp"
+#include "Log.hpp"
+
+#include <iomanip>
+#include <sstream>
+#include <nlohmann/json.hpp>
+#include <fmt/format.h>
+
+using json = nlohmann::json;
+
+// Most history buckets one aggregate request may ask for
+static const int64_t MAX_AGGREGATE_BUCKETS = 1000;
+// Most points one chart request may ask for
+static const size_t MAX_CHART_POINTS = 4000;
+// Dashboard pollers share sensor readings up to this old
+static const std::chrono::seconds DASHBOARD_READING_MAX_AGE(2);
+// Journal events in the dashboard's events section
+static const uint64_t DASHBOARD_EVENTS = 20;
+
+// The from and to query parameters (unix seconds), by default the last day
+static void timeRange(const httplib::Request& req, SampleHistory::Clock::time_point& from, SampleHistory::Clock::time_point& to)
+{
+    to = SampleHistory::Clock::now();
+    from = to - std::chrono::hours(24);
+    if (req.has_param("from"))
+    {
+        from = SampleHistory::Clock::from_time_t(std::strtoll(req.get_param_value("from").c_str(), nullptr, 10));
+    }
+    if (req.has_param("to"))
+    {
+        to = SampleHistory::Clock::from_time_t(std::strtoll(req.get_param_value("to").c_str(), nullptr, 10));
+    }
+}
+
+// The points query parameter of a chart, 500 by default
+static size_t chartPoints(const httplib::Request& req)
+{
+    size_t points = 500;
+    if (req.has_param("points"))
+    {
+        points = std::strtoul(req.get_param_value("points").c_str(), nullptr, 10);
+    }
+    return std::min(std::max<size_t>(points, 3), MAX_CHART_POINTS);
+}
+
+// Nulls for a bucket of nothing but failed readings
+static json seriesJson(const SampleHistory::SeriesSummary& series)
+{
+    if (series.count == 0) return {{"min", nullptr}, {"max", nullptr}, {"mean", nullptr}};
+    return {{"min", series.min}, {"max", series.max}, {"mean", series.sum / series.count}};
+}
+
+// Switch states and flow meter counts by input name
+static json inputsJson(const GpioInputs& gpioInputs)
+{
+    auto inputs = json::object();
+    for (size_t i = 0; i < gpioInputs.Count(); i++)
+    {
+        const auto& input = gpioInputs.Get(i);
+        if (input.type == GpioInputs::Type::Counter)
+        {
+            uint64_t pulses = input.pulses.load(std::memory_order_relaxed);
+            inputs[input.name] = {
+                {"pulses", pulses},
+                {"liters", pulses / input.pulsesPerLiter},
+                {"litersPerMinute", gpioInputs.PulseRate(i) * 60.0 / input.pulsesPerLiter}
+            };
+        }
+        else
+        {
+            inputs[input.name] = {{"active", input.active.load(std::memory_order_relaxed)}};
+        }
+    }
+    return inputs;
+}
+
+static json eventJson(const std::vector<OutputChannel>& channels, const EventJournal::Record& record, uint64_t cursor)
+{
+    auto names = json::array();
+    for (size_t i = 0; i < channels.size(); i++)
+    {
+        if ((record.channels & (1u << i)) != 0) names.push_back(channels[i].name);
+    }
+    return {
+        {"cursor", cursor},
+        {"time", record.timeNs / 1e9},
+        {"type", EventJournal::TypeName(record.type)},
+        {"channels", names},
+        {"key", record.key},
+        {"value", record.value}
+    };
+}
+
+// The sources of the dashboard's sections in single process mode
+static Dashboard::Sources dashboardSources(HttpService& httpService, Silvanus& silvanus)
+{
+    Dashboard::Sources sources;
+    sources.status = [&silvanus](Dashboard::Status& status)
+    {
+        silvanus.CachedReading(DASHBOARD_READING_MAX_AGE, status.temperature, status.humidity);
+        status.channels = silvanus.GetChannels();
+        status.interlocked = silvanus.InterlockedChannels();
+        for (size_t i = 0; i < Silvanus::MaxChannels; i++)
+        {
+            status.dimmerLevels[i] = i < silvanus.Channels().size() ? silvanus.Dimming().Level((int)i) : -1.0f;
+        }
+        return true;
+    };
+    sources.inputs = [&silvanus](std::string& body)
+    {
+        body += inputsJson(silvanus.Inputs()).dump();
+    };
+    sources.history = [&silvanus](SampleHistory::Series series, const Dashboard::Options& options, std::string& body)
+    {
+        auto out = std::back_inserter(body);
+        body += "[";
+        bool first = true;
+        for (const auto& point : silvanus.History().Chart(series, options.from, options.to, options.points))
+        {
+            fmt::format_to(out, first ? "[{},{}]" : ",[{},{}]", point.timeNs / 1e9, point.value);
+            first = false;
+        }
+        body += "]";
+    };
+    sources.events = [&silvanus](std::string& body)
+    {
+        uint64_t end = silvanus.Journal().End();
+        uint64_t cursor = end > DASHBOARD_EVENTS ? end - DASHBOARD_EVENTS : 0;
+        auto events = json::array();
+        for (const auto& record : silvanus.Journal().Read(cursor, DASHBOARD_EVENTS))
+        {
+            events.push_back(eventJson(silvanus.Channels(), record, cursor++));
+        }
+        body += events.dump();
+    };
+    sources.health = [&httpService, &silvanus](Dashboard::Health& health)
+    {
+        health.deadlineMisses = silvanus.DeadlineMissCount();
+        health.httpRejected = httpService.Admission().RejectedCount();
+        health.logDropped = Log::DroppedCount();
+        health.realtime = silvanus.PulseThreadRealtime();
+    };
+    return sources;
+}
+
+void RegisterApiRoutes(HttpService& httpService, 
+                       Silvanus& silvanus, 
+                       PlantSchedule& schedule,
+                       SceneTable& scenes,
+                       RuleEngine& rules,
+                       std::function<void()> onRestart)
+{
+    httpService.Post("/system/restart", [=](const httplib::Request& req, httplib::Response& res) 
+    {
+        onRestart();
+    }, RoutePriority::Control);
+
+    httpService.Patch("/system/settings", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        std::string error;
+        if (!config.ParseAndApplyPatch(req.body, error))
+        {
+            res.status = 400;
+            res.body = error;
+            return;
+        }
+
+        // Save the changed config and determine if the 
+        config.SaveConfig();
+        schedule.Prime();
+    });
+
+    httpService.Get("/system/settings", [=](const httplib::Request& req, httplib::Response& res) 
+    {
+        std::stringstream ss;
+        ss << std::setw(4) << config.GetConfigSnapshot();
+        res.body = ss.str();
+    });
+
+    httpService.Get("/status", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        auto status = json::object();
+        status["temperature"] = silvanus.GetTemperature();
+        status["humidity"] = silvanus.GetHumidity();
+        status["light-on"] = silvanus.GetLight();
+        status["pump-on"] = silvanus.GetPump();
+        uint32_t channelState = silvanus.GetChannels();
+        auto& channels = status["channels"] = json::object();
+        for (size_t i = 0; i < silvanus.Channels().size(); i++)
+        {
+            channels[silvanus.Channels()[i].name] = (channelState & (1u << i)) != 0;
+        }
+        auto& dimmers = status["dimmers"] = json::object();
+        for (size_t i = 0; i < silvanus.Channels().size(); i++)
+        {
+            float level = silvanus.Dimming().Level((int)i);
+            if (level >= 0) dimmers[silvanus.Channels()[i].name] = level;
+        }
+        status["inputs"] = inputsJson(silvanus.Inputs());
+        status["interlocked"] = silvanus.InterlockedChannels();
+        std::stringstream ss;
+        ss << std::setw(4) << status;
+        HttpService::SendTagged(req, res, ss.str());
+    });
+
+    // Any mix of status, settings, history, events and health fields in one response, see Dashboard
+    auto dashboard = std::make_shared<Dashboard>(silvanus.Channels(), dashboardSources(httpService, silvanus));
+    httpService.Get("/dashboard", [&silvanus, dashboard](const httplib::Request& req, httplib::Response& res)
+    {
+        Dashboard::Options options;
+        timeRange(req, options.from, options.to);
+        options.points = chartPoints(req);
+        std::string body;
+        std::string error;
+        switch (dashboard->Serialize(req.has_param("fields") ? req.get_param_value("fields") : "status", options, body, error))
+        {
+            case Dashboard::Result::Ok:
+                HttpService::SendTagged(req, res, std::move(body));
+                break;
+            case Dashboard::Result::BadFields:
+                res.status = 400;
+                res.body = error;
+                break;
+            case Dashboard::Result::Unavailable:
+                res.status = 503;
+                res.body = "Error: the status is not available.";
+                break;
+        }
+    });
+
+    // Prometheus text format, so it can be scraped as is
+    httpService.Get("/metrics", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        const LatencyHistogram& lateness = silvanus.OffDeadlineLateness();
+        const HttpAdmission& admission = httpService.Admission();
+        std::string body;
+        body += "# HELP silvanus_actuator_off_lateness_seconds How late relays were switched off after their pulse deadline.\n";
+        body += "# TYPE silvanus_actuator_off_lateness_seconds summary\n";
+        for (double q : {0.5, 0.99, 0.999})
+        {
+            body += fmt::format("silvanus_actuator_off_lateness_seconds{{quantile=\"{}\"}} {:.6f}\n", q, lateness.Percentile(q) / 1e6);
+        }
+        body += fmt::format("silvanus_actuator_off_lateness_seconds_sum {:.6f}\n", lateness.Mean() * lateness.Count() / 1e6);
+        body += fmt::format("silvanus_actuator_off_lateness_seconds_count {}\n", lateness.Count());
+        body += "# HELP silvanus_actuator_off_lateness_max_seconds Worst off-deadline lateness since startup.\n";
+        body += "# TYPE silvanus_actuator_off_lateness_max_seconds gauge\n";
+        body += fmt::format("silvanus_actuator_off_lateness_max_seconds {:.6f}\n", lateness.Max() / 1e6);
+        body += "# HELP silvanus_actuator_deadline_misses_total Off-deadlines later than actuatorDeadlineTolerance.\n";
+        body += "# TYPE silvanus_actuator_deadline_misses_total counter\n";
+        body += fmt::format("silvanus_actuator_deadline_misses_total {}\n", silvanus.DeadlineMissCount());
+        body += "# HELP silvanus_actuator_deadline_tolerance_seconds Lateness allowed before an off-deadline counts as missed.\n";
+        body += "# TYPE silvanus_actuator_deadline_tolerance_seconds gauge\n";
+        body += fmt::format("silvanus_actuator_deadline_tolerance_seconds {:.6f}\n", silvanus.DeadlineTolerance().count() / 1e6);
+        body += "# HELP silvanus_actuator_realtime Whether the pulse thread runs with SCHED_FIFO priority.\n";
+        body += "# TYPE silvanus_actuator_realtime gauge\n";
+        body += fmt::format("silvanus_actuator_realtime {}\n", silvanus.PulseThreadRealtime() ? 1 : 0);
+        body += "# HELP silvanus_http_rejected_total Requests answered with 503 by admission control.\n";
+        body += "# TYPE silvanus_http_rejected_total counter\n";
+        body += fmt::format("silvanus_http_rejected_total {}\n", admission.RejectedCount());
+        body += "# HELP silvanus_http_shed_connections_total Connections that arrived while the queue was full.\n";
+        body += "# TYPE silvanus_http_shed_connections_total counter\n";
+        body += fmt::format("silvanus_http_shed_connections_total {}\n", admission.ShedConnectionCount());
+        body += "# HELP silvanus_http_dropped_connections_total Connections that arrived while both queues were full.\n";
+        body += "# TYPE silvanus_http_dropped_connections_total counter\n";
+        body += fmt::format("silvanus_http_dropped_connections_total {}\n", admission.DroppedConnectionCount());
+        auto filters = silvanus.FilterStatus();
+        body += "# HELP silvanus_sensor_variance Variance of the recent raw and filtered readings of each sensor.\n";
+        body += "# TYPE silvanus_sensor_variance gauge\n";
+        for (auto& sensor : filters.items())
+        {
+            body += fmt::format("silvanus_sensor_variance{{sensor=\"{}\",stage=\"raw\"}} {}\n", sensor.key(), sensor.value()["rawVariance"].get<float>());
+            body += fmt::format("silvanus_sensor_variance{{sensor=\"{}\",stage=\"filtered\"}} {}\n", sensor.key(), sensor.value()["filteredVariance"].get<float>());
+        }
+        body += "# HELP silvanus_sensor_filter_delay_samples How many samples the filtered reading lags behind the sensor.\n";
+        body += "# TYPE silvanus_sensor_filter_delay_samples gauge\n";
+        for (auto& sensor : filters.items())
+        {
+            body += fmt::format("silvanus_sensor_filter_delay_samples{{sensor=\"{}\"}} {}\n", sensor.key(), sensor.value()["delaySamples"].get<float>());
+        }
+        body += "# HELP silvanus_sensor_filter_max_seconds Longest time spent filtering one reading.\n";
+        body += "# TYPE silvanus_sensor_filter_max_seconds gauge\n";
+        for (auto& sensor : filters.items())
+        {
+            body += fmt::format("silvanus_sensor_filter_max_seconds{{sensor=\"{}\"}} {:.9f}\n", sensor.key(), sensor.value()["maxNs"].get<uint64_t>() / 1e9);
+        }
+        body += "# HELP silvanus_log_dropped_total Log messages dropped because the log ring was full.\n";
+        body += "# TYPE silvanus_log_dropped_total counter\n";
+        body += fmt::format("silvanus_log_dropped_total {}\n", Log::DroppedCount());
+        res.set_content(body, "text/plain; version=0.0.4");
+    });
+
+    // Ordered operations checked up front and applied together, see CommandBatch.hpp
+    httpService.Post("/batch", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        CommandBatch batch;
+        json results;
+        std::string error;
+        bool valid = batch.Parse(json::parse(req.body, nullptr, false), silvanus, results, error);
+        if (!error.empty())
+        {
+            res.status = 400;
+            res.body = error;
+            return;
+        }
+        if (!valid)
+        {
+            res.status = 400;
+            res.body = json{{"applied", false}, {"results", std::move(results)}}.dump();
+            return;
+        }
+        if (!batch.Apply(silvanus, schedule, error))
+        {
+            res.status = 500;
+            res.body = json{{"applied", false}, {"error", error}, {"results", std::move(results)}}.dump();
+            return;
+        }
+        res.body = json{{"applied", true}, {"results", std::move(results)}}.dump();
+    }, RoutePriority::Control);
+
+    httpService.Post("/water-now", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        schedule.WaterNow();
+    }, RoutePriority::Control);
+
+    httpService.Post("/auto-light", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        // Evaluate if the light should be on already
+        // Resets the light behavior to auto
+        schedule.Prime();
+    }, RoutePriority::Control);
+
+    httpService.Get("/channels", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        uint32_t channelState = silvanus.GetChannels();
+        auto body = json::array();
+        for (size_t i = 0; i < silvanus.Channels().size(); i++)
+        {
+            const auto& channel = silvanus.Channels()[i];
+            body.push_back({
+                {"name", channel.name},
+                {"role", channel.role},
+                {"gpio", channel.gpio},
+                {"activeLow", channel.activeLow},
+                {"on", (channelState & (1u << i)) != 0}
+            });
+        }
+        std::stringstream ss;
+        ss << std::setw(4) << body;
+        res.body = ss.str();
+    }, RoutePriority::Control);
+
+    // Switch any number of channels at once: {"light": true, "fan": false}
+    httpService.Put("/channels", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        auto body = json::parse(req.body, nullptr, false);
+        if (!body.is_object())
+        {
+            res.status = 400;
+            res.body = "Error: Endpoint /channels expects a json object of channel names to bool values.";
+            return;
+        }
+        uint32_t onMask = 0;
+        uint32_t offMask = 0;
+        for (auto& kvp : body.items())
+        {
+            int channel = silvanus.FindChannel(kvp.key());
+            if (channel < 0 || !kvp.value().is_boolean())
+            {
+                res.status = 400;
+                res.body = fmt::format("Error: {} is not a channel name with a bool value.", kvp.key());
+                return;
+            }
+            (kvp.value().get<bool>() ? onMask : offMask) |= 1u << channel;
+        }
+        silvanus.SetChannels(onMask, offMask);
+    }, RoutePriority::Control);
+
+    // Next events to fire, ?count= (default 20)
+    httpService.Get("/schedule", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        size_t count = 20;
+        if (req.has_param("count"))
+        {
+            count = std::min<size_t>(1000, std::strtoul(req.get_param_value("count").c_str(), nullptr, 10));
+        }
+        std::stringstream ss;
+        ss << std::setw(4) << schedule.Upcoming(count);
+        res.body = ss.str();
+    });
+
+    // Sensor samples between from and to (seconds since the epoch), the last day by default
+    httpService.Get("/history", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        SampleHistory::Clock::time_point from, to;
+        timeRange(req, from, to);
+        size_t limit = 1000;
+        if (req.has_param("limit"))
+        {
+            limit = std::min<size_t>(RuntimeState::SampleCapacity, std::strtoul(req.get_param_value("limit").c_str(), nullptr, 10));
+        }
+
+        auto samples = json::array();
+        for (const auto& sample : silvanus.History().Range(from, to, limit))
+        {
+            samples.push_back({
+                {"time", sample.timeNs / 1e9},
+                {"temperature", sample.temperature},
+                {"humidity", sample.humidity}
+            });
+        }
+        json body = {{"samples", samples}};
+        HttpService::SendTagged(req, res, body.dump());
+    });
+
+    // Min/max/mean per step seconds (by default 100 buckets over the range)
+    httpService.Get("/history/aggregate", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        SampleHistory::Clock::time_point from, to;
+        timeRange(req, from, to);
+        auto step = std::chrono::duration_cast<std::chrono::seconds>(to - from) / 100;
+        if (req.has_param("step"))
+        {
+            step = std::chrono::seconds(std::strtoll(req.get_param_value("step").c_str(), nullptr, 10));
+        }
+        step = std::max(step, std::chrono::seconds(1));
+        if (to <= from || (to - from) / step > MAX_AGGREGATE_BUCKETS)
+        {
+            res.status = 400;
+            res.body = fmt::format("Error: Endpoint /history/aggregate needs from < to and at most {} steps between them.", MAX_AGGREGATE_BUCKETS);
+            return;
+        }
+
+        auto buckets = json::array();
+        for (const auto& bucket : silvanus.History().Aggregate(from, to, step))
+        {
+            buckets.push_back({
+                {"time", bucket.timeNs / 1e9},
+                {"count", bucket.summary.count},
+                {"temperature", seriesJson(bucket.summary.temperature)},
+                {"humidity", seriesJson(bucket.summary.humidity)}
+            });
+        }
+        json body = {{"step", step.count()}, {"buckets", buckets}};
+        HttpService::SendTagged(req, res, body.dump());
+    });
+
+    // Chart-ready downsampling: at most `points` [time, value] pairs of one series
+    httpService.Get("/history/chart", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        std::string seriesName = req.has_param("series") ? req.get_param_value("series") : "temperature";
+        SampleHistory::Series series;
+        if (seriesName == "temperature") series = SampleHistory::Series::Temperature;
+        else if (seriesName == "humidity") series = SampleHistory::Series::Humidity;
+        else
+        {
+            res.status = 400;
+            res.body = "Error: Endpoint /history/chart expects series=temperature or series=humidity.";
+            return;
+        }
+        SampleHistory::Clock::time_point from, to;
+        timeRange(req, from, to);
+        size_t points = chartPoints(req);
+
+        auto pairs = json::array();
+        for (const auto& point : silvanus.History().Chart(series, from, to, points))
+        {
+            pairs.push_back({point.timeNs / 1e9, point.value});
+        }
+        json body = {{"series", seriesName}, {"points", pairs}};
+        HttpService::SendTagged(req, res, body.dump());
+    });
+
+    // Every sample or journal event in the range as a download, streamed a batch at a time
+    httpService.Get("/export", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        std::string data = req.has_param("data") ? req.get_param_value("data") : "samples";
+        if (data != "samples" && data != "events")
+        {
+            res.status = 400;
+            res.body = "Error: Endpoint /export expects data=samples or data=events.";
+            return;
+        }
+        std::string formatName = req.has_param("format") ? req.get_param_value("format") : "csv";
+        HistoryExport::Format format;
+        if (formatName == "csv") format = HistoryExport::Format::Csv;
+        else if (formatName == "ndjson") format = HistoryExport::Format::Ndjson;
+        else
+        {
+            res.status = 400;
+            res.body = "Error: Endpoint /export expects format=csv or format=ndjson.";
+            return;
+        }
+        SampleHistory::Clock::time_point from, to;
+        timeRange(req, from, to);
+        bool gzip = req.get_header_value("Accept-Encoding").find("gzip") != std::string::npos;
+
+        std::shared_ptr<HistoryExport> stream;
+        if (data == "events")
+        {
+            std::vector<std::string> channelNames;
+            for (const auto& channel : silvanus.Channels())
+            {
+                channelNames.push_back(channel.name);
+            }
+            stream = std::make_shared<HistoryExport>(silvanus.Journal(), std::move(channelNames), format, from, to, gzip);
+        }
+        else
+        {
+            stream = std::make_shared<HistoryExport>(silvanus.History(), format, from, to, gzip);
+        }
+        if (stream->Compressed())
+        {
+            res.set_header("Content-Encoding", "gzip");
+        }
+        res.set_header("Content-Disposition", fmt::format("attachment; filename=\"silvanus-{}.{}\"",
+                                                          data == "events" ? "events" : "history", formatName));
+        res.set_chunked_content_provider(HistoryExport::ContentType(format), [stream](size_t offset, httplib::DataSink& sink)
+        {
+            return stream->WriteNext(sink);
+        });
+    });
+
+    // Compiled rules with whether their condition holds and how often they fired
+    httpService.Get("/rules", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        std::stringstream ss;
+        ss << std::setw(4) << rules.Status();
+        res.body = ss.str();
+    });
+
+    // Each sensor's filter stages, last raw and filtered reading, their variance and the time spent filtering
+    httpService.Get("/filters", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        std::stringstream ss;
+        ss << std::setw(4) << silvanus.FilterStatus();
+        res.body = ss.str();
+    });
+
+    // Journal records from cursor `since` on, pass `next` back as since for the next page
+    httpService.Get("/events", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        uint64_t since = 0;
+        size_t limit = 100;
+        if (req.has_param("since"))
+        {
+            since = std::strtoull(req.get_param_value("since").c_str(), nullptr, 10);
+        }
+        if (req.has_param("limit"))
+        {
+            limit = std::min<size_t>(1000, std::strtoul(req.get_param_value("limit").c_str(), nullptr, 10));
+        }
+
+        auto events = json::array();
+        uint64_t cursor = since;
+        for (const auto& record : silvanus.Journal().Read(since, limit))
+        {
+            events.push_back(eventJson(silvanus.Channels(), record, cursor++));
+        }
+        json body = {{"events", events}, {"next", cursor}, {"end", silvanus.Journal().End()}};
+        res.body = body.dump();
+    });
+
+    // Brightness outside sunrise/sunset ramps: {"light": 0.5}
+    httpService.Put("/dimmers", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        auto body = json::parse(req.body, nullptr, false);
+        if (!body.is_object())
+        {
+            res.status = 400;
+            res.body = "Error: Endpoint /dimmers expects a json object of channel names to levels from 0 to 1.";
+            return;
+        }
+        // Check every key first so a bad one sets none of the levels
+        for (auto& kvp : body.items())
+        {
+            int channel = silvanus.FindChannel(kvp.key());
+            if (channel < 0 || !kvp.value().is_number() || (silvanus.Dimming().DimmedMask() & (1u << channel)) == 0)
+            {
+                res.status = 400;
+                res.body = fmt::format("Error: {} is not a dimmed channel with a numeric level.", kvp.key());
+                return;
+            }
+        }
+        for (auto& kvp : body.items())
+        {
+            silvanus.Dimming().SetBaseLevel(silvanus.FindChannel(kvp.key()), kvp.value().get<float>());
+        }
+    }, RoutePriority::Control);
+
+    httpService.Get("/scenes", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        json body = scenes.Names();
+        std::stringstream ss;
+        ss << std::setw(4) << body;
+        res.body = ss.str();
+    });
+
+    // Optional body: {"duration": <milliseconds>}
+    httpService.Post("/scene/([^/]+)", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        std::chrono::milliseconds duration(0);
+        if (!req.body.empty())
+        {
+            auto body = json::parse(req.body, nullptr, false);
+            if (!body.is_object() || (body.contains("duration") && !body["duration"].is_number_integer()))
+            {
+                res.status = 400;
+                res.body = "Error: Endpoint /scene expects an empty body or {\"duration\": <milliseconds>}.";
+                return;
+            }
+            duration = std::chrono::milliseconds(body.value("duration", (int64_t)0));
+        }
+
+        switch (scenes.Apply(req.matches[1], duration))
+        {
+            case SceneTable::ApplyResult::Applied:
+                break;
+            case SceneTable::ApplyResult::UnknownScene:
+                res.status = 404;
+                res.body = fmt::format("Error: there is no scene named {}.", req.matches[1].str());
+                break;
+            case SceneTable::ApplyResult::BadDuration:
+                res.status = 400;
+                res.body = fmt::format("Error: duration must be from 0 to {} milliseconds and not end before the scene's last step.",
+                                       silvanus.MaxPulseDuration().count());
+                break;
+        }
+    }, RoutePriority::Control);
+
+    httpService.Put("/light", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        bool on;
+        if (HttpService::ParseBool(req.body, on))
+        {
+            silvanus.SetLight(on);
+        }
+        else
+        {
+            res.status = 400;
+            res.body = "Error: Endpoint /light expects json bool value.";
+        }
+    }, RoutePriority::Control);
+
+    httpService.Get("/light", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        json body = silvanus.GetLight();
+        std::stringstream ss;
+        ss << std::setw(4) << body;
+        res.body = ss.str();
+    }, RoutePriority::Control);
+
+    httpService.Put("/pump", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        bool on;
+        if (HttpService::ParseBool(req.body, on))
+        {
+            silvanus.SetPump(on);
+        }
+        else
+        {
+            res.status = 400;
+            res.body = "Error: Endpoint /pump expects json bool value.";
+        }
+    }, RoutePriority::Control);
+
+    httpService.Get("/pump", [&](const httplib::Request& req, httplib::Response& res) 
+    {
+        json body = silvanus.GetPump();
+        std::stringstream ss;
+        ss << std::setw(4) << body;
+        res.body = ss.str();
+    }, RoutePriority::Control);
+}
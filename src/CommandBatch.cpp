@@ -0,0 +1,153 @@
+#include "CommandBatch.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+
+#include <iterator>
+#include <fmt/format.h>
+
+using json = nlohmann::json;
+
+CommandBatch::CommandBatch() : patch_(json::object()), prime_(false)
+{
+}
+
+bool CommandBatch::Parse(const json& ops, const Silvanus& silvanus, json& results, std::string& error)
+{
+    if (!ops.is_array() || ops.size() > MaxOperations)
+    {
+        error = fmt::format("Error: Endpoint /batch expects a json array of at most {} operations.", MaxOperations);
+        return false;
+    }
+
+    // Check all of them so the client sees every problem at once
+    bool valid = true;
+    results = json::array();
+    for (const auto& op : ops)
+    {
+        json result = {{"op", op.is_object() ? op.value("op", json()) : json()}};
+        std::string opError;
+        if (parseOperation(op, silvanus, opError))
+        {
+            result["ok"] = true;
+        }
+        else
+        {
+            result["ok"] = false;
+            result["error"] = opError;
+            valid = false;
+        }
+        results.push_back(std::move(result));
+    }
+    return valid;
+}
+
+bool CommandBatch::parseOperation(const json& op, const Silvanus& silvanus, std::string& error)
+{
+    if (!op.is_object() || !op.contains("op") || !op["op"].is_string())
+    {
+        error = "Error: every operation needs an \"op\" name.";
+        return false;
+    }
+    const std::string name = op["op"].get<std::string>();
+    static const json none;
+    const json& value = op.contains("value") ? op["value"] : none;
+
+    if (name == "settings")
+    {
+        if (!config.CheckPatch(value, error)) return false;
+        json merged = patch_;
+        for (auto& kvp : value.items())
+        {
+            // A later key replaces everything inside it set earlier in the batch
+            const std::string inner = kvp.key() + ".";
+            for (auto it = merged.begin(); it != merged.end();)
+            {
+                it = it.key().compare(0, inner.size(), inner) == 0 ? merged.erase(it) : std::next(it);
+            }
+            merged[kvp.key()] = kvp.value();
+        }
+        // A key inside one set earlier in the batch is still a conflict
+        if (!config.CheckPatch(merged, error)) return false;
+        patch_ = std::move(merged);
+        prime_ = true;
+        return true;
+    }
+    if (name == "channels")
+    {
+        if (!value.is_object())
+        {
+            error = "Error: channels expects a json object of channel names to bool values.";
+            return false;
+        }
+        ChannelChange change{0, 0, std::chrono::milliseconds(0)};
+        for (auto& kvp : value.items())
+        {
+            int channel = silvanus.FindChannel(kvp.key());
+            if (channel < 0 || !kvp.value().is_boolean())
+            {
+                error = fmt::format("Error: {} is not a channel name with a bool value.", kvp.key());
+                return false;
+            }
+            (kvp.value().get<bool>() ? change.onMask : change.offMask) |= 1u << channel;
+        }
+        changes_.push_back(change);
+        return true;
+    }
+    if (name == "light" || name == "pump")
+    {
+        int channel = silvanus.FindChannelByRole(name);
+        if (channel < 0)
+        {
+            error = fmt::format("Error: there is no {} channel.", name);
+            return false;
+        }
+        if (!value.is_boolean())
+        {
+            error = fmt::format("Error: {} expects a json bool value.", name);
+            return false;
+        }
+        uint32_t mask = 1u << channel;
+        changes_.push_back(ChannelChange{value.get<bool>() ? mask : 0, value.get<bool>() ? 0 : mask, std::chrono::milliseconds(0)});
+        return true;
+    }
+    if (name == "pulse")
+    {
+        int channel = op.contains("channel") && op["channel"].is_string() ? silvanus.FindChannel(op["channel"].get<std::string>()) : -1;
+        if (channel < 0)
+        {
+            error = "Error: pulse expects a \"channel\" name.";
+            return false;
+        }
+        if (!op.contains("duration") || !op["duration"].is_number_integer() || op["duration"].get<int64_t>() <= 0 ||
+            op["duration"].get<int64_t>() > silvanus.MaxPulseDuration().count())
+        {
+            error = fmt::format("Error: pulse expects a positive \"duration\" of at most {} milliseconds.", silvanus.MaxPulseDuration().count());
+            return false;
+        }
+        changes_.push_back(ChannelChange{1u << channel, 0, std::chrono::milliseconds(op["duration"].get<int64_t>())});
+        return true;
+    }
+    if (name == "auto-light")
+    {
+        prime_ = true;
+        return true;
+    }
+    error = fmt::format("Error: {} is not a batch operation.", name);
+    return false;
+}
+
+bool CommandBatch::Apply(Silvanus& silvanus, PlantSchedule& schedule, std::string& error)
+{
+    // Checked in Parse, but the settings may have changed since
+    if (!patch_.empty())
+    {
+        if (!config.ApplyPatch(patch_, error)) return false;
+        config.SaveConfig();
+    }
+    if (prime_)
+    {
+        schedule.Prime();
+    }
+    silvanus.ApplyChanges(changes_);
+    return true;
+}
@@ -1,10 +1,12 @@
 #include "ConfigService.hpp"
+#include "Log.hpp"
 
 #include <math.h>
+#include <array>
 #include <filesystem>
-#include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <fmt/format.h>
 
 using json = nlohmann::json;
 
@@ -15,13 +17,169 @@ static const std::string CONFIG_PATH = "SilvanusConfig.json";
 #endif
 static const std::string DEFAULT_RESOURCES_PATH = "resources";
 
+// Most nesting a settings patch value may have
+static const size_t MAX_PATCH_DEPTH = 32;
+
+// Setting a key and one inside it in one patch would leave the inner entry dangling
+static bool keyInside(const std::string& inner, const std::string& outer)
+{
+  return inner.size() > outer.size() && inner.compare(0, outer.size(), outer) == 0 && inner[outer.size()] == '.';
+}
+
+// Reads a settings patch straight from the request body with nlohmann's
+// SAX parser, checking each key and value type as it arrives: an unknown
+// key or a wrong type stops the parse there, and only values of known
+// settings are ever built. find(key) returns the setting's entry in the
+// config or nullptr, so call with the config mutex held.
+template <typename Find>
+class PatchSaxHandler : public json::json_sax_t
+{
+public:
+    struct Setting
+    {
+        std::string key;
+        json* entry;
+        json value;
+    };
+
+    PatchSaxHandler(Find find, std::vector<Setting>& settings, std::string& error) :
+        find_(find), settings_(settings), error_(error), level_(0), expectValue_(false)
+    {
+    }
+
+    bool null() override { return add(json(nullptr)); }
+    bool boolean(bool value) override { return add(json(value)); }
+    bool number_integer(number_integer_t value) override { return add(json(value)); }
+    bool number_unsigned(number_unsigned_t value) override { return add(json(value)); }
+    bool number_float(number_float_t value, const string_t&) override { return add(json(value)); }
+    bool string(string_t& value) override { return add(json(std::move(value))); }
+    bool binary(binary_t& value) override { return add(json::binary(std::move(value))); }
+
+    bool start_object(std::size_t) override
+    {
+        if (level_ == 0)
+        {
+            level_ = 1;
+            return true;
+        }
+        return open(json::object());
+    }
+    bool end_object() override
+    {
+        level_--;
+        return true;
+    }
+    bool start_array(std::size_t) override
+    {
+        return open(json::array());
+    }
+    bool end_array() override
+    {
+        level_--;
+        return true;
+    }
+
+    bool key(string_t& key) override
+    {
+        if (level_ > 1)
+        {
+            nestedKey_ = std::move(key);
+            return true;
+        }
+        json* entry = find_(key);
+        if (entry == nullptr)
+        {
+            error_ = fmt::format("Bad patch request, settings key {} is invalid.", key);
+            return false;
+        }
+        settings_.push_back(Setting{std::move(key), entry, json()});
+        expectValue_ = true;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override
+    {
+        error_ = fmt::format("Bad patch request, {}", ex.what());
+        return false;
+    }
+private:
+    // Numbers of any kind match numeric settings, anything else must be the same type
+    static bool typeMatches(const json& entry, const json& value)
+    {
+        return (entry.is_number() && value.is_number()) || entry.type() == value.type();
+    }
+
+    // Store a value, returning where it ended up or nullptr on a type mismatch
+    json* place(json&& value)
+    {
+        if (level_ == 0)
+        {
+            error_ = "Bad patch request, expected a json object of settings.";
+            return nullptr;
+        }
+        if (level_ == 1)
+        {
+            Setting& setting = settings_.back();
+            if (!expectValue_ || !typeMatches(*setting.entry, value))
+            {
+                error_ = fmt::format("Bad patch request, value {} was an incorrect type.", setting.key);
+                return nullptr;
+            }
+            expectValue_ = false;
+            setting.value = std::move(value);
+            return &setting.value;
+        }
+        json& parent = *containers_[level_ - 2];
+        if (parent.is_array())
+        {
+            parent.push_back(std::move(value));
+            return &parent.back();
+        }
+        return &(parent[nestedKey_] = std::move(value));
+    }
+
+    bool add(json&& value)
+    {
+        return place(std::move(value)) != nullptr;
+    }
+
+    bool open(json&& container)
+    {
+        if (level_ >= MAX_PATCH_DEPTH)
+        {
+            error_ = "Bad patch request, values are nested too deeply.";
+            return false;
+        }
+        json* placed = place(std::move(container));
+        if (placed == nullptr) return false;
+        containers_[level_ - 1] = placed;
+        level_++;
+        return true;
+    }
+
+    Find find_;
+    std::vector<Setting>& settings_;
+    std::string& error_;
+    // 1 inside the patch object, one more per open container below it
+    size_t level_;
+    bool expectValue_;
+    std::array<json*, MAX_PATCH_DEPTH> containers_;
+    std::string nestedKey_;
+};
+
 ConfigService ConfigService::global;
 
-ConfigService::ConfigService()
+ConfigService::ConfigService() : configPath_(CONFIG_PATH)
 {
     _initDone = false;
 }
 
+void ConfigService::SetConfigPath(const std::string& path)
+{
+    if (_initDone) throw std::runtime_error("The config path must be set before Init!");
+    configPath_ = path;
+}
+
 ConfigService::~ConfigService()
 {
   
@@ -105,12 +263,14 @@ static const nlohmann::json& getJsonValueRecursive(const std::vector<std::string
 bool ConfigService::HasKey(const std::string& key)
 {
     if (!_initDone) throw std::runtime_error("Config service is not initialized!");
+    const std::lock_guard<std::recursive_mutex> lock(_mutex);
     return hasJsonValue(key);
 }
 
 bool ConfigService::ValueTypeMatches(const std::string& key, const nlohmann::json& value)
 {
     if (!_initDone) throw std::runtime_error("Config service is not initialized!");
+    const std::lock_guard<std::recursive_mutex> lock(_mutex);
     if (!HasKey(key)) return false;
 
     // Numeric types can be finnicky. If both are numbers, just say its a match.
@@ -149,6 +309,7 @@ void ConfigService::Init()
 void ConfigService::Subscribe(const std::function <void (const ConfigUpdateEventArg&)>& handler) 
 {
     if (!_initDone) throw std::runtime_error("Config service is not initialized!");
+    const std::lock_guard<std::recursive_mutex> lock(_mutex);
     ConfigUpdateEventArg arg(*this, "", true);
     handler(arg);
     OnSettingChanged.connect(handler);
@@ -167,9 +328,17 @@ const json& ConfigService::GetConfigJson(const std::string& key) const
     return getJsonValue(key);
 }
 
+json ConfigService::GetConfigSnapshot(const std::string& key) const
+{
+    if (!_initDone) throw std::runtime_error("Config service is not initialized!");
+    const std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return getJsonValue(key);
+}
+
 template <>
 void ConfigService::SetConfigValue(const std::string& key, const json& value)
 {
+    const std::lock_guard<std::recursive_mutex> lock(_mutex);
     try
     {
         json& entry = getJsonValue(key, true);
@@ -189,9 +358,158 @@ void ConfigService::SetConfigValue(const std::string& key, const json& value)
 
 void ConfigService::SaveConfig()
 {
+  const std::lock_guard<std::recursive_mutex> lock(_mutex);
   if (_settingsReadOK) writeConfig();
 }
 
+bool ConfigService::Reload()
+{
+  if (!_initDone) throw std::runtime_error("Config service is not initialized!");
+
+  // Parse before touching the current settings so a bad file changes nothing
+  json config;
+  try
+  {
+    std::ifstream ifs(configPath_);
+    config = json::parse(ifs);
+  }
+  catch (...)
+  {
+    LOG_ERROR("Failed to reload the config file, keeping the current settings.");
+    return false;
+  }
+  if (!config.is_object())
+  {
+    LOG_ERROR("Reloaded config was parsed but invalid, keeping the current settings.");
+    return false;
+  }
+
+  const std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _config = std::move(config);
+  OnSettingChanged(ConfigUpdateEventArg(*this, "", true));
+  return true;
+}
+
+bool ConfigService::CheckPatch(const json& patch, std::string& error)
+{
+  if (!patch.is_object())
+  {
+    error = "Bad patch request, expected a json object of settings.";
+    return false;
+  }
+
+  const std::lock_guard<std::recursive_mutex> lock(_mutex);
+  for (auto& kvp : patch.items())
+  {
+    if (!HasKey(kvp.key()))
+    {
+      error = fmt::format("Bad patch request, settings key {} is invalid.", kvp.key());
+      return false;
+    }
+    if (!ValueTypeMatches(kvp.key(), kvp.value()))
+    {
+      error = fmt::format("Bad patch request, value {} was an incorrect type.", kvp.key());
+      return false;
+    }
+  }
+  for (auto& outer : patch.items())
+  {
+    for (auto& inner : patch.items())
+    {
+      if (keyInside(inner.key(), outer.key()))
+      {
+        error = fmt::format("Bad patch request, settings key {} is inside {}.", inner.key(), outer.key());
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool ConfigService::ApplyPatch(const json& patch, std::string& error)
+{
+  const std::lock_guard<std::recursive_mutex> lock(_mutex);
+  if (!CheckPatch(patch, error))
+  {
+    return false;
+  }
+  // Set it all before telling subscribers, each changed key once
+  std::vector<const std::string*> changed;
+  changed.reserve(patch.size());
+  for (auto& kvp : patch.items())
+  {
+    json& entry = getJsonValue(kvp.key(), false);
+    if (entry != kvp.value())
+    {
+      entry = kvp.value();
+      changed.push_back(&kvp.key());
+    }
+  }
+  for (const std::string* key : changed)
+  {
+    OnSettingChanged(ConfigUpdateEventArg(*this, *key, false));
+  }
+  return true;
+}
+
+bool ConfigService::ParseAndApplyPatch(const std::string& body, std::string& error)
+{
+  if (!_initDone) throw std::runtime_error("Config service is not initialized!");
+
+  const std::lock_guard<std::recursive_mutex> lock(_mutex);
+  auto find = [this](const std::string& key) -> json*
+  {
+    // An empty path would be the whole config
+    if (key.empty()) return nullptr;
+    try
+    {
+      return &getJsonValue(key, false);
+    }
+    catch (...)
+    {
+      return nullptr;
+    }
+  };
+  std::vector<PatchSaxHandler<decltype(find)>::Setting> settings;
+  settings.reserve(8);
+  PatchSaxHandler<decltype(find)> handler(find, settings, error);
+  if (!json::sax_parse(body, &handler))
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < settings.size(); i++)
+  {
+    for (size_t j = 0; j < settings.size(); j++)
+    {
+      const std::string& outer = settings[i].key;
+      const std::string& inner = settings[j].key;
+      if (keyInside(inner, outer))
+      {
+        error = fmt::format("Bad patch request, settings key {} is inside {}.", inner, outer);
+        return false;
+      }
+    }
+  }
+
+  // Everything checked out, set it all before telling subscribers
+  std::vector<const std::string*> changed;
+  changed.reserve(settings.size());
+  for (auto& setting : settings)
+  {
+    if (*setting.entry != setting.value)
+    {
+      *setting.entry = std::move(setting.value);
+      changed.push_back(&setting.key);
+    }
+  }
+  for (const std::string* key : changed)
+  {
+    OnSettingChanged(ConfigUpdateEventArg(*this, *key, false));
+  }
+  return true;
+}
+
 std::string ConfigService::GetSharedResourcePath(const std::string& resourceName) const
 {
   if (!_initDone) throw std::runtime_error("Config service is not initialized!");
@@ -210,32 +528,32 @@ bool ConfigService::readConfig()
   
   // If the config file doesn't exist, then we are done. 
   // Consider it "read" so we can overwrite the file.
-  if (!std::filesystem::exists(CONFIG_PATH))
+  if (!std::filesystem::exists(configPath_))
   {
-    std::cout << "Config file missing, using defaults." << std::endl;
+    LOG_INFO("Config file missing, using defaults.");
     return true;
   }
   
   // Try to read the file
   try
   {
-    std::ifstream ifs(CONFIG_PATH);
+    std::ifstream ifs(configPath_);
     _config = json::parse(ifs);
     ifs.close();
-    std::cout << "Read and parsed config file!" << std::endl;
+    LOG_INFO("Read and parsed config file!");
   }
   catch (...)
   {
-    std::cout << "Failed to read or parse config file!" << std::endl;
-    std::cout << "Delete it or fix permissions to generate a new one." << std::endl;
+    LOG_ERROR("Failed to read or parse config file!");
+    LOG_ERROR("Delete it or fix permissions to generate a new one.");
     return false;
   }
   
   // If the config is some nonsense, clear it
   if (!_config.is_object()) 
   {
-    std::cout << "Config was parsed but invalid!" << std::endl;
-    std::cout << "Delete it to generate a new one." << std::endl;
+    LOG_ERROR("Config was parsed but invalid!");
+    LOG_ERROR("Delete it to generate a new one.");
     _config = json::object();
     return false;
   }	
@@ -247,24 +565,24 @@ void ConfigService::writeConfig()
 {
   try
   {
-    std::ofstream ofs(CONFIG_PATH, std::ofstream::out | std::ofstream::trunc);
+    std::ofstream ofs(configPath_, std::ofstream::out | std::ofstream::trunc);
     ofs << std::setw(4) << _config;
     ofs.flush();
     ofs.close();
     
     if ( (ofs.rdstate() & std::ifstream::failbit ) != 0 )
     {
-      std::cout << "Failed to write config file!" << std::endl;
+      LOG_ERROR("Failed to write config file!");
     }
     else
     {
-      std::cout << "Wrote config file!" << std::endl;
+      LOG_INFO("Wrote config file!");
     }
     //std::cout << _config << std::endl;
   }
   catch (...)
   {
-    std::cout << "Failed to write config file!" << std::endl;
+    LOG_ERROR("Failed to write config file!");
   }
 }
 
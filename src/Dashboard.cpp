@@ -0,0 +1,259 @@
+#include "Dashboard.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <tuple>
+#include <nlohmann/json.hpp>
+#include <fmt/format.h>
+
+using json = nlohmann::json;
+
+// Distinct field sets kept compiled, the cache starts over beyond this
+static const size_t MAX_CACHED_PLANS = 64;
+
+static const char* const SECTIONS[] = {"status", "settings", "history", "events", "health"};
+
+Dashboard::Dashboard(const std::vector<OutputChannel>& channels, Sources sources) :
+    sources_(std::move(sources)), lightMask_(0), pumpMask_(0)
+{
+    for (size_t i = 0; i < channels.size(); i++)
+    {
+        channelKeys_.push_back(json(channels[i].name).dump() + ":");
+        if (channels[i].role == "light" && lightMask_ == 0) lightMask_ = 1u << i;
+        if (channels[i].role == "pump" && pumpMask_ == 0) pumpMask_ = 1u << i;
+    }
+}
+
+Dashboard::Result Dashboard::Serialize(const std::string& fields, const Options& options, std::string& body, std::string& error)
+{
+    auto compiled = plan(fields, error);
+    if (compiled == nullptr) return Result::BadFields;
+
+    Status status{};
+    Health health{};
+    if (compiled->needsStatus && !sources_.status(status)) return Result::Unavailable;
+    if (compiled->needsHealth) sources_.health(health);
+
+    body.clear();
+    body.reserve(compiled->sizeHint.load(std::memory_order_relaxed));
+    for (const Step& step : compiled->steps)
+    {
+        body += step.prefix;
+        writeValue(step, status, health, options, body);
+    }
+    body += compiled->suffix;
+    compiled->sizeHint.store(body.size(), std::memory_order_relaxed);
+    return Result::Ok;
+}
+
+std::shared_ptr<const Dashboard::Plan> Dashboard::plan(const std::string& fields, std::string& error)
+{
+    {
+        const std::shared_lock<std::shared_mutex> lock(plansMutex_);
+        auto it = plans_.find(fields);
+        if (it != plans_.end()) return it->second;
+    }
+
+    auto compiled = compile(fields, error);
+    if (compiled == nullptr) return nullptr;
+    const std::unique_lock<std::shared_mutex> lock(plansMutex_);
+    if (plans_.size() >= MAX_CACHED_PLANS) plans_.clear();
+    plans_.emplace(fields, compiled);
+    return compiled;
+}
+
+std::shared_ptr<const Dashboard::Plan> Dashboard::compile(const std::string& fields, std::string& error) const
+{
+    struct Known
+    {
+        size_t section;
+        const char* name;
+        Field field;
+    };
+    // In the order they are written, settings and events take no names
+    static const Known known[] = {
+        {0, "temperature", Field::Temperature},
+        {0, "humidity", Field::Humidity},
+        {0, "light-on", Field::Light},
+        {0, "pump-on", Field::Pump},
+        {0, "channels", Field::Channels},
+        {0, "dimmers", Field::Dimmers},
+        {0, "inputs", Field::Inputs},
+        {0, "interlocked", Field::Interlocked},
+        {2, "temperature", Field::TemperatureHistory},
+        {2, "humidity", Field::HumidityHistory},
+        {4, "deadlineMisses", Field::DeadlineMisses},
+        {4, "httpRejected", Field::HttpRejected},
+        {4, "logDropped", Field::LogDropped},
+        {4, "realtime", Field::Realtime}
+    };
+    const size_t knownCount = std::size(known);
+
+    // Requested fields as (section, position in known, settings key)
+    struct Wanted
+    {
+        size_t section;
+        size_t order;
+        Field field;
+        std::string key;
+    };
+    std::vector<Wanted> wanted;
+    size_t start = 0;
+    while (start <= fields.size())
+    {
+        size_t end = std::min(fields.find(',', start), fields.size());
+        std::string token = fields.substr(start, end - start);
+        start = end + 1;
+        token.erase(0, token.find_first_not_of(' '));
+        token.erase(token.find_last_not_of(' ') + 1);
+        if (token.empty()) continue;
+
+        size_t dot = token.find('.');
+        std::string section = token.substr(0, dot);
+        std::string name = dot == std::string::npos ? "" : token.substr(dot + 1);
+        auto sectionIt = std::find_if(std::begin(SECTIONS), std::end(SECTIONS), [&](const char* s) { return section == s; });
+        if (sectionIt == std::end(SECTIONS))
+        {
+            error = fmt::format("Error: {} is not a dashboard field.", token);
+            return nullptr;
+        }
+        size_t sectionIndex = sectionIt - std::begin(SECTIONS);
+        if ((sectionIndex == 2 && !sources_.history) || (sectionIndex == 3 && !sources_.events) || (sectionIndex == 4 && !sources_.health))
+        {
+            error = fmt::format("Error: the {} section is not served here.", section);
+            return nullptr;
+        }
+
+        if (sectionIndex == 1)
+        {
+            wanted.push_back(Wanted{sectionIndex, knownCount, name.empty() ? Field::AllSettings : Field::Setting, name});
+            continue;
+        }
+        if (sectionIndex == 3 && name.empty())
+        {
+            wanted.push_back(Wanted{sectionIndex, knownCount, Field::Events, ""});
+            continue;
+        }
+        bool matched = false;
+        for (size_t i = 0; i < knownCount; i++)
+        {
+            if (known[i].section == sectionIndex && (name.empty() || name == known[i].name))
+            {
+                if (known[i].field == Field::Inputs && !sources_.inputs)
+                {
+                    if (name.empty()) continue;
+                    error = "Error: inputs are not served here.";
+                    return nullptr;
+                }
+                wanted.push_back(Wanted{sectionIndex, i, known[i].field, ""});
+                matched = true;
+            }
+        }
+        if (!matched)
+        {
+            error = fmt::format("Error: {} is not a dashboard field.", token);
+            return nullptr;
+        }
+    }
+
+    // Group by section, drop repeats, and all settings cover single ones
+    auto order = [](const Wanted& w) { return std::tie(w.section, w.order, w.key); };
+    std::sort(wanted.begin(), wanted.end(), [&](const Wanted& a, const Wanted& b) { return order(a) < order(b); });
+    wanted.erase(std::unique(wanted.begin(), wanted.end(), [&](const Wanted& a, const Wanted& b) { return order(a) == order(b); }), wanted.end());
+    if (std::any_of(wanted.begin(), wanted.end(), [](const Wanted& w) { return w.field == Field::AllSettings; }))
+    {
+        wanted.erase(std::remove_if(wanted.begin(), wanted.end(), [](const Wanted& w) { return w.field == Field::Setting; }), wanted.end());
+    }
+
+    auto compiled = std::make_shared<Plan>();
+    compiled->needsStatus = false;
+    compiled->needsHealth = false;
+    compiled->sizeHint = 0;
+    std::string text = "{";
+    size_t current = std::size(SECTIONS);
+    bool whole = false;     // The value is the whole section (all settings, events)
+    for (const Wanted& w : wanted)
+    {
+        if (w.section != current)
+        {
+            if (current != std::size(SECTIONS)) text += whole ? "," : "},";
+            text += fmt::format("\"{}\":", SECTIONS[w.section]);
+            whole = w.field == Field::AllSettings || w.field == Field::Events;
+            if (!whole) text += "{";
+            current = w.section;
+        }
+        else
+        {
+            text += ",";
+        }
+        if (!whole) text += json(w.field == Field::Setting ? w.key : std::string(known[w.order].name)).dump() + ":";
+        compiled->steps.push_back(Step{w.field, std::move(text), w.key});
+        text.clear();
+        compiled->needsStatus |= w.section == 0 && w.field != Field::Inputs;
+        compiled->needsHealth |= w.section == 4;
+    }
+    if (current != std::size(SECTIONS) && !whole) text += "}";
+    text += "}";
+    compiled->suffix = std::move(text);
+    return compiled;
+}
+
+void Dashboard::writeValue(const Step& step, const Status& status, const Health& health, const Options& options, std::string& body) const
+{
+    auto out = std::back_inserter(body);
+    auto number = [&](float value)
+    {
+        if (std::isfinite(value)) fmt::format_to(out, "{}", value);
+        else body += "null";
+    };
+    auto boolean = [&](bool value) { body += value ? "true" : "false"; };
+
+    switch (step.field)
+    {
+        case Field::Temperature: number(status.temperature); break;
+        case Field::Humidity: number(status.humidity); break;
+        case Field::Light: boolean((status.channels & lightMask_) != 0); break;
+        case Field::Pump: boolean((status.channels & pumpMask_) != 0); break;
+        case Field::Channels:
+            body += "{";
+            for (size_t i = 0; i < channelKeys_.size(); i++)
+            {
+                if (i > 0) body += ",";
+                body += channelKeys_[i];
+                boolean((status.channels & (1u << i)) != 0);
+            }
+            body += "}";
+            break;
+        case Field::Dimmers:
+        {
+            body += "{";
+            bool first = true;
+            for (size_t i = 0; i < channelKeys_.size(); i++)
+            {
+                if (status.dimmerLevels[i] < 0) continue;
+                if (!first) body += ",";
+                first = false;
+                body += channelKeys_[i];
+                number(status.dimmerLevels[i]);
+            }
+            body += "}";
+            break;
+        }
+        case Field::Inputs: sources_.inputs(body); break;
+        case Field::Interlocked: fmt::format_to(out, "{}", status.interlocked); break;
+        case Field::Setting:
+            body += config.HasKey(step.key) ? config.GetConfigSnapshot(step.key).dump() : "null";
+            break;
+        case Field::AllSettings: body += config.GetConfigSnapshot().dump(); break;
+        case Field::TemperatureHistory: sources_.history(SampleHistory::Series::Temperature, options, body); break;
+        case Field::HumidityHistory: sources_.history(SampleHistory::Series::Humidity, options, body); break;
+        case Field::Events: sources_.events(body); break;
+        case Field::DeadlineMisses: fmt::format_to(out, "{}", health.deadlineMisses); break;
+        case Field::HttpRejected: fmt::format_to(out, "{}", health.httpRejected); break;
+        case Field::LogDropped: fmt::format_to(out, "{}", health.logDropped); break;
+        case Field::Realtime: boolean(health.realtime); break;
+    }
+}
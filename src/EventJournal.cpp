@@ -0,0 +1,262 @@
+#include "EventJournal.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t RECORD_MAGIC = 0x4a564c53; // "SLVJ"
+static const size_t SCAN_BLOCK = 256;
+
+// CRC-32 (IEEE) of the record up to its crc field
+static uint32_t recordCrc(const EventJournal::Record& record)
+{
+    static const auto table = []()
+    {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&record);
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < offsetof(EventJournal::Record, crc); i++)
+    {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+static bool recordValid(const EventJournal::Record& record)
+{
+    return record.magic == RECORD_MAGIC && record.crc == recordCrc(record);
+}
+
+EventJournal::EventJournal(const std::string& path, std::chrono::milliseconds syncInterval) :
+    fd_(-1), end_(0), written_(0), exit_(false), syncInterval_(syncInterval)
+{
+    if (path.empty()) return;
+
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        LOG_ERROR("Could not open the event journal {}, events will not be recorded.", path);
+        return;
+    }
+
+    // A crash can leave a partial record, or garbage if the last block
+    // never made it to disk. Keep everything up to the last good record.
+    struct stat st;
+    fstat(fd_, &st);
+    uint64_t records = st.st_size / sizeof(Record);
+    while (records > 0)
+    {
+        Record record;
+        if (pread(fd_, &record, sizeof(record), (records - 1) * sizeof(Record)) == sizeof(record) && recordValid(record))
+            break;
+        records--;
+    }
+    if ((off_t)(records * sizeof(Record)) != st.st_size)
+    {
+        LOG_WARNING("Dropping {} bytes of torn or corrupt records from the end of the event journal.", st.st_size - records * sizeof(Record));
+        if (ftruncate(fd_, records * sizeof(Record)) != 0) { }
+    }
+    end_ = records;
+    written_ = records;
+    pending_.resize(PendingCapacity);
+
+    syncThread_ = std::make_unique<std::thread>(&EventJournal::syncThreadFunc, this);
+    Append(Type::Startup);
+    Sync();
+}
+
+EventJournal::~EventJournal()
+{
+    if (syncThread_ != nullptr)
+    {
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            exit_ = true;
+        }
+        cv_.notify_one();
+        syncThread_->join();
+    }
+    if (fd_ >= 0) close(fd_);
+}
+
+bool EventJournal::Enabled() const
+{
+    return fd_ >= 0;
+}
+
+void EventJournal::Append(Type type, uint32_t channels, uint32_t key, uint32_t value)
+{
+    if (fd_ < 0) return;
+
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    record.type = (uint32_t)type;
+    record.channels = channels;
+    record.key = key;
+    record.value = value;
+    record.magic = RECORD_MAGIC;
+    record.crc = recordCrc(record);
+
+    bool wasEmpty;
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t cursor = end_.load(std::memory_order_relaxed);
+        if (cursor - written_ >= PendingCapacity)
+        {
+            LOG_ERROR_EVERY(60000, "The event journal can't keep up, dropping records.");
+            return;
+        }
+        pending_[cursor % PendingCapacity] = record;
+        end_.store(cursor + 1, std::memory_order_release);
+        wasEmpty = cursor == written_;
+    }
+    if (wasEmpty) cv_.notify_one();
+}
+
+void EventJournal::Sync()
+{
+    if (fd_ < 0) return;
+    flush();
+}
+
+void EventJournal::flush()
+{
+    const std::lock_guard<std::mutex> writeLock(writeMutex_);
+    // Copy out under the lock, the slots stay ours until written_ moves on
+    std::vector<Record> batch;
+    uint64_t from;
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        from = written_;
+        for (uint64_t cursor = from; cursor < end_.load(std::memory_order_relaxed); cursor++)
+        {
+            batch.push_back(pending_[cursor % PendingCapacity]);
+        }
+    }
+    if (!batch.empty())
+    {
+        ssize_t bytes = batch.size() * sizeof(Record);
+        if (pwrite(fd_, batch.data(), bytes, from * sizeof(Record)) != bytes)
+        {
+            LOG_ERROR_EVERY(60000, "Failed to append to the event journal.");
+        }
+        const std::lock_guard<std::mutex> lock(mutex_);
+        written_ = from + batch.size();
+    }
+    fdatasync(fd_);
+}
+
+void EventJournal::syncThreadFunc()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!exit_)
+    {
+        cv_.wait(lock, [this]() { return written_ != end_.load(std::memory_order_relaxed) || exit_; });
+        // Let appends pile up for one interval, then pay for a single write and fsync
+        cv_.wait_for(lock, syncInterval_, [this]() { return exit_; });
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+    lock.unlock();
+    flush();
+}
+
+uint64_t EventJournal::End() const
+{
+    return end_.load(std::memory_order_acquire);
+}
+
+uint64_t EventJournal::Seek(std::chrono::system_clock::time_point time) const
+{
+    uint64_t timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    uint64_t first = 0;
+    uint64_t last = End();
+    while (first < last)
+    {
+        uint64_t middle = first + (last - first) / 2;
+        std::vector<Record> record = Read(middle, 1);
+        if (record.empty()) return middle;
+        if (record[0].timeNs < timeNs)
+        {
+            first = middle + 1;
+        }
+        else
+        {
+            last = middle;
+        }
+    }
+    return first;
+}
+
+std::vector<EventJournal::Record> EventJournal::Read(uint64_t cursor, size_t count) const
+{
+    std::vector<Record> records;
+    uint64_t end = End();
+    if (fd_ < 0 || cursor >= end) return records;
+
+    records.resize(std::min<uint64_t>(count, end - cursor));
+    // The tail may still be waiting in the ring, the rest is on disk
+    uint64_t onDisk;
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        onDisk = std::min<uint64_t>(std::max(written_, cursor), cursor + records.size()) - cursor;
+        for (uint64_t i = onDisk; i < records.size(); i++)
+        {
+            records[i] = pending_[(cursor + i) % PendingCapacity];
+        }
+    }
+    if (onDisk > 0)
+    {
+        ssize_t bytes = pread(fd_, records.data(), onDisk * sizeof(Record), cursor * sizeof(Record));
+        if (bytes != (ssize_t)(onDisk * sizeof(Record)))
+        {
+            records.resize(bytes > 0 ? bytes / sizeof(Record) : 0);
+        }
+    }
+    return records;
+}
+
+void EventJournal::ScanBackward(const std::function<bool(const Record&)>& visit) const
+{
+    uint64_t cursor = End();
+    std::vector<Record> block;
+    while (cursor > 0)
+    {
+        uint64_t start = cursor > SCAN_BLOCK ? cursor - SCAN_BLOCK : 0;
+        block = Read(start, cursor - start);
+        for (auto it = block.rbegin(); it != block.rend(); ++it)
+        {
+            if (recordValid(*it) && !visit(*it)) return;
+        }
+        cursor = start;
+    }
+}
+
+const char* EventJournal::TypeName(uint32_t type)
+{
+    switch ((Type)type)
+    {
+        case Type::Startup: return "startup";
+        case Type::ChannelOn: return "channel-on";
+        case Type::ChannelOff: return "channel-off";
+        case Type::EventFired: return "event-fired";
+        case Type::CatchUp: return "catch-up";
+    }
+    return "unknown";
+}
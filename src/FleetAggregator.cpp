@@ -0,0 +1,371 @@
+#include "FleetAggregator.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "FleetAnnouncer.hpp"
+#include "Log.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <fmt/format.h>
+
+using json = nlohmann::json;
+
+// Failing nodes are retried less and less often, up to this
+static const std::chrono::seconds MAX_BACKOFF(60);
+
+FleetAggregator::FleetAggregator() : dirty_(true), exit_(false), discoverySocket_(-1)
+{
+    // The fleet settings cannot change so no need to subscribe
+    pollInterval_ = std::chrono::milliseconds(config.GetConfigValue("fleetPollInterval", 5000));
+    historyInterval_ = std::chrono::seconds(config.GetConfigValue("fleetHistoryInterval", 60));
+    peerExpiry_ = std::chrono::seconds(config.GetConfigValue("fleetPeerExpiry", 60));
+    maxNodes_ = config.GetConfigValue("fleetMaxNodes", 1024);
+    size_t maxInFlight = std::max(1, config.GetConfigValue("fleetMaxInFlight", 8));
+    bool discovery = config.GetConfigValue("fleetDiscovery", true);
+    std::string group = config.GetConfigValue("fleetMulticastGroup", std::string(FleetAnnouncer::DefaultGroup));
+    int groupPort = config.GetConfigValue("fleetMulticastPort", FleetAnnouncer::DefaultPort);
+
+    // Static peers are "host" or "host:port"
+    for (const auto& entry : config.GetConfigValue("fleetPeers", json::array()))
+    {
+        if (!entry.is_string())
+        {
+            LOG_WARNING("Ignoring fleet peer {}, expected \"host:port\".", entry.dump());
+            continue;
+        }
+        std::string address = entry.get<std::string>();
+        size_t colon = address.rfind(':');
+        int port = colon == std::string::npos ? 80 : std::atoi(address.c_str() + colon + 1);
+        std::string host = address.substr(0, colon);
+        addPeer(address, host, port, false);
+    }
+
+    if (discovery)
+    {
+        discoverySocket_ = socket(AF_INET, SOCK_DGRAM, 0);
+        int reuse = 1;
+        timeval timeout = {1, 0};
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(groupPort);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        ip_mreq membership;
+        memset(&membership, 0, sizeof(membership));
+        membership.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (discoverySocket_ < 0 ||
+            inet_pton(AF_INET, group.c_str(), &membership.imr_multiaddr) != 1 ||
+            setsockopt(discoverySocket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+            setsockopt(discoverySocket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+            bind(discoverySocket_, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+            setsockopt(discoverySocket_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0)
+        {
+            LOG_ERROR("Fleet discovery on {}:{} failed ({}), only polling the configured peers.", group, groupPort, strerror(errno));
+            if (discoverySocket_ >= 0) close(discoverySocket_);
+            discoverySocket_ = -1;
+        }
+        else
+        {
+            LOG_INFO("Discovering fleet nodes on {}:{}", group, groupPort);
+            discovery_ = std::make_unique<std::thread>(&FleetAggregator::discoveryFunc, this);
+        }
+    }
+
+    for (size_t i = 0; i < maxInFlight; i++)
+    {
+        workers_.emplace_back(&FleetAggregator::workerFunc, this);
+    }
+}
+
+FleetAggregator::~FleetAggregator()
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        exit_ = true;
+    }
+    due_.notify_all();
+    // Workers finish the request they are in, bounded by the client timeouts
+    for (auto& worker : workers_)
+    {
+        worker.join();
+    }
+    if (discovery_ != nullptr)
+    {
+        discovery_->join();
+    }
+    if (discoverySocket_ >= 0)
+    {
+        close(discoverySocket_);
+    }
+}
+
+void FleetAggregator::addPeer(const std::string& name, const std::string& host, int port, bool discovered)
+{
+    std::string address = fmt::format("{}:{}", host, port);
+    const std::lock_guard<std::mutex> lock(mutex_);
+    auto it = peers_.find(address);
+    if (it != peers_.end())
+    {
+        const PeerPtr& peer = it->second;
+        peer->lastAnnounced = Clock::now();
+        if (peer->discovered && peer->name != name)
+        {
+            peer->name = name;
+            dirty_ = true;
+        }
+        return;
+    }
+    if (peers_.size() >= maxNodes_)
+    {
+        LOG_WARNING_EVERY(60000, "Ignoring fleet node {}, already tracking fleetMaxNodes={} nodes.", address, maxNodes_);
+        return;
+    }
+
+    auto peer = std::make_shared<Peer>();
+    peer->address = address;
+    peer->host = host;
+    peer->port = port;
+    peer->discovered = discovered;
+    peer->removed = false;
+    peer->client = std::make_unique<httplib::Client>(host, port);
+    peer->client->set_keep_alive(true);
+    peer->client->set_connection_timeout(1, 0);
+    peer->client->set_read_timeout(2, 0);
+    peer->nextHistory = Clock::now();
+    peer->name = name;
+    peer->lastAnnounced = Clock::now();
+    peer->failures = 0;
+
+    peers_.emplace(address, peer);
+    timeline_.emplace(Clock::now(), peer);
+    dirty_ = true;
+    due_.notify_one();
+    LOG_INFO("Fleet node {} at {} added.", name, address);
+}
+
+void FleetAggregator::expirePeers()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    auto now = Clock::now();
+    for (auto it = peers_.begin(); it != peers_.end();)
+    {
+        const PeerPtr& peer = it->second;
+        if (!peer->discovered || now - peer->lastAnnounced < peerExpiry_)
+        {
+            ++it;
+            continue;
+        }
+        LOG_INFO("Fleet node {} at {} stopped announcing, removed.", peer->name, peer->address);
+        // A worker that has the peer right now sees removed and drops it
+        peer->removed = true;
+        for (auto entry = timeline_.begin(); entry != timeline_.end(); ++entry)
+        {
+            if (entry->second == peer)
+            {
+                timeline_.erase(entry);
+                break;
+            }
+        }
+        it = peers_.erase(it);
+        dirty_ = true;
+    }
+}
+
+FleetAggregator::Clock::time_point FleetAggregator::nextPoll(const Peer& peer) const
+{
+    if (peer.failures == 0)
+    {
+        return Clock::now() + pollInterval_;
+    }
+    auto backoff = pollInterval_ * (1 << std::min(peer.failures, 6));
+    return Clock::now() + std::min<std::chrono::milliseconds>(backoff, MAX_BACKOFF);
+}
+
+void FleetAggregator::poll(const PeerPtr& peer)
+{
+    httplib::Headers headers;
+    if (!peer->statusTag.empty())
+    {
+        headers.emplace("If-None-Match", peer->statusTag);
+    }
+    auto result = peer->client->Get("/status", headers);
+    if (!result || (result->status != 200 && result->status != 304))
+    {
+        std::string error = result ? fmt::format("HTTP {}", result->status) : httplib::to_string(result.error());
+        const std::lock_guard<std::mutex> lock(mutex_);
+        if (peer->failures++ == 0)
+        {
+            LOG_WARNING("Fleet node {} at {} is not answering: {}", peer->name, peer->address, error);
+        }
+        peer->error = error;
+        dirty_ = true;
+        return;
+    }
+
+    // Parse outside the lock, a 304 means what we have is still current
+    json status;
+    bool statusChanged = result->status == 200;
+    if (statusChanged)
+    {
+        status = json::parse(result->body, nullptr, false);
+        peer->statusTag = result->get_header_value("ETag");
+    }
+
+    std::string history;
+    bool historyChanged = false;
+    if (Clock::now() >= peer->nextHistory)
+    {
+        peer->nextHistory = Clock::now() + historyInterval_;
+        httplib::Headers historyHeaders;
+        if (!peer->historyTag.empty())
+        {
+            historyHeaders.emplace("If-None-Match", peer->historyTag);
+        }
+        // Nodes in front end mode have no history, they just keep an empty one
+        auto historyResult = peer->client->Get("/history", historyHeaders);
+        if (historyResult && historyResult->status == 200)
+        {
+            history = std::move(historyResult->body);
+            peer->historyTag = historyResult->get_header_value("ETag");
+            historyChanged = true;
+        }
+    }
+
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (peer->failures > 0)
+    {
+        LOG_INFO("Fleet node {} at {} is back.", peer->name, peer->address);
+    }
+    peer->failures = 0;
+    peer->error.clear();
+    peer->lastSeen = std::chrono::system_clock::now();
+    if (statusChanged)
+    {
+        peer->status = status.is_discarded() ? json() : std::move(status);
+    }
+    if (historyChanged)
+    {
+        peer->history = std::move(history);
+    }
+    dirty_ = true;
+}
+
+void FleetAggregator::workerFunc()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!exit_)
+    {
+        if (timeline_.empty())
+        {
+            due_.wait(lock);
+            continue;
+        }
+        auto first = timeline_.begin();
+        if (first->first > Clock::now())
+        {
+            due_.wait_until(lock, first->first);
+            continue;
+        }
+
+        // Off the timeline while we poll, so no other worker picks it up
+        PeerPtr peer = first->second;
+        timeline_.erase(first);
+        lock.unlock();
+        poll(peer);
+        lock.lock();
+        if (!peer->removed)
+        {
+            timeline_.emplace(nextPoll(*peer), peer);
+        }
+    }
+}
+
+void FleetAggregator::discoveryFunc()
+{
+    char buffer[512];
+    while (true)
+    {
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            if (exit_) break;
+        }
+
+        sockaddr_in sender;
+        socklen_t senderSize = sizeof(sender);
+        ssize_t size = recvfrom(discoverySocket_, buffer, sizeof(buffer), 0, (sockaddr*)&sender, &senderSize);
+        if (size > 0)
+        {
+            auto announcement = json::parse(buffer, buffer + size, nullptr, false);
+            char host[INET_ADDRSTRLEN];
+            if (announcement.is_object() && announcement.contains("port") && announcement["port"].is_number_integer() &&
+                inet_ntop(AF_INET, &sender.sin_addr, host, sizeof(host)) != nullptr)
+            {
+                int port = announcement["port"].get<int>();
+                std::string name = announcement.value("name", std::string(host));
+                if (port > 0 && port < 65536)
+                {
+                    addPeer(name, host, port, true);
+                }
+            }
+        }
+        expirePeers();
+    }
+}
+
+std::string FleetAggregator::Nodes()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (!dirty_)
+    {
+        return nodes_;
+    }
+
+    // Rebuilt at most once per change, however many dashboards are polling
+    auto nodes = json::array();
+    for (const auto& [address, peer] : peers_)
+    {
+        json node = {
+            {"name", peer->name},
+            {"address", address},
+            {"online", peer->failures == 0 && peer->lastSeen.time_since_epoch().count() != 0},
+            {"status", peer->status}
+        };
+        if (peer->lastSeen.time_since_epoch().count() != 0)
+        {
+            node["lastSeen"] = std::chrono::duration<double>(peer->lastSeen.time_since_epoch()).count();
+        }
+        if (!peer->error.empty())
+        {
+            node["error"] = peer->error;
+        }
+        nodes.push_back(std::move(node));
+    }
+    nodes_ = json({{"nodes", nodes}}).dump();
+    dirty_ = false;
+    return nodes_;
+}
+
+bool FleetAggregator::History(const std::string& node, std::string& body)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [address, peer] : peers_)
+    {
+        if (address == node || peer->name == node)
+        {
+            if (peer->history.empty()) return false;
+            body = peer->history;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t FleetAggregator::NodeCount()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return peers_.size();
+}
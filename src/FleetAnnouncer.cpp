@@ -0,0 +1,89 @@
+#include "FleetAnnouncer.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "Log.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <nlohmann/json.hpp>
+
+// Aggregators expire nodes after a minute of silence, so a few lost datagrams don't matter
+static const std::chrono::seconds ANNOUNCE_INTERVAL(10);
+
+static std::string hostName()
+{
+    char name[256] = {0};
+    if (gethostname(name, sizeof(name) - 1) != 0)
+    {
+        return "silvanus";
+    }
+    return name;
+}
+
+FleetAnnouncer::FleetAnnouncer(int httpPort) : exit_(false)
+{
+    // The node name and multicast group cannot change so no need to subscribe
+    nlohmann::json message = {
+        {"name", config.GetConfigValue("nodeName", hostName())},
+        {"port", httpPort}
+    };
+    message_ = message.dump();
+    group_ = config.GetConfigValue("fleetMulticastGroup", std::string(DefaultGroup));
+    port_ = config.GetConfigValue("fleetMulticastPort", DefaultPort);
+
+    socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket_ < 0)
+    {
+        LOG_ERROR("Fleet announcer could not open a socket: {}", strerror(errno));
+        return;
+    }
+    // Stay on the local network
+    unsigned char ttl = 1;
+    setsockopt(socket_, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+    thread_ = std::make_unique<std::thread>(&FleetAnnouncer::threadFunc, this);
+}
+
+FleetAnnouncer::~FleetAnnouncer()
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        exit_ = true;
+    }
+    wake_.notify_all();
+    if (thread_ != nullptr)
+    {
+        thread_->join();
+    }
+    if (socket_ >= 0)
+    {
+        close(socket_);
+    }
+}
+
+void FleetAnnouncer::threadFunc()
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port_);
+    if (inet_pton(AF_INET, group_.c_str(), &addr.sin_addr) != 1)
+    {
+        LOG_ERROR("Fleet announcer: {} is not an IPv4 multicast group.", group_);
+        return;
+    }
+    LOG_INFO("Announcing this node to {}:{}", group_, port_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!exit_)
+    {
+        if (sendto(socket_, message_.data(), message_.size(), 0, (sockaddr*)&addr, sizeof(addr)) < 0)
+        {
+            LOG_WARNING_EVERY(60000, "Fleet announcement failed: {}", strerror(errno));
+        }
+        wake_.wait_for(lock, ANNOUNCE_INTERVAL, [this]() { return exit_; });
+    }
+}
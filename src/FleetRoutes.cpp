@@ -0,0 +1,30 @@
+#include "FleetRoutes.hpp"
+
+#include <fmt/format.h>
+
+void RegisterFleetRoutes(HttpService& httpService, FleetAggregator& fleet)
+{
+    // The aggregator has no hardware of its own, its dashboard is the fleet
+    httpService.Get("/", [](const httplib::Request& req, httplib::Response& res)
+    {
+        res.set_redirect("/fleet.html");
+    }, RoutePriority::Static);
+
+    httpService.Get("/fleet", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        HttpService::SendTagged(req, res, fleet.Nodes());
+    });
+
+    httpService.Get("/fleet/history", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        std::string node = req.get_param_value("node");
+        std::string body;
+        if (!fleet.History(node, body))
+        {
+            res.status = 404;
+            res.body = fmt::format("Error: there is no history of node {} yet.", node);
+            return;
+        }
+        HttpService::SendTagged(req, res, std::move(body));
+    });
+}
@@ -0,0 +1,344 @@
+#include "FrontEndRoutes.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "Dashboard.hpp"
+#include "Log.hpp"
+#include "Silvanus.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <fmt/format.h>
+
+using json = nlohmann::json;
+
+// Commands that take longer than this count as a dead daemon
+static const std::chrono::milliseconds COMMAND_TIMEOUT(2000);
+// A state older than this means the daemon stopped publishing
+static const std::chrono::seconds STATE_MAX_AGE(5);
+
+static LinkCommand makeCommand(LinkCommandType type)
+{
+    LinkCommand command;
+    memset(&command, 0, sizeof(command));
+    command.type = type;
+    return command;
+}
+
+// Answer for a command that did not run, false if it did
+static bool failed(LinkResult result, httplib::Response& res)
+{
+    switch (result)
+    {
+        case LinkResult::Ok:
+            return false;
+        case LinkResult::Rejected:
+            res.status = 400;
+            res.body = "Error: the hardware daemon rejected the request.";
+            break;
+        case LinkResult::UnknownScene:
+            res.status = 404;
+            res.body = "Error: there is no scene by that name.";
+            break;
+        case LinkResult::QueueFull:
+            res.status = 503;
+            res.set_header("Retry-After", "1");
+            res.body = "Error: the hardware daemon is busy.";
+            break;
+        case LinkResult::Unavailable:
+        case LinkResult::Timeout:
+            res.status = 503;
+            res.body = "Error: the hardware daemon is not responding.";
+            break;
+    }
+    return true;
+}
+
+// Latest state from the daemon, false if it isn't publishing
+static bool freshState(HardwareLink& link, LinkState& state)
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return link.ReadState(state) && now - std::chrono::nanoseconds(state.updatedNs) <= STATE_MAX_AGE;
+}
+
+// Latest state from the daemon, answers 503 and returns false if there is none
+static bool readState(HardwareLink& link, LinkState& state, httplib::Response& res)
+{
+    if (!freshState(link, state))
+    {
+        res.status = 503;
+        res.body = "Error: the hardware daemon is not running.";
+        return false;
+    }
+    return true;
+}
+
+void RegisterFrontEndRoutes(HttpService& httpService,
+                            HardwareLink& link,
+                            std::function<void()> onRestart)
+{
+    // The channel table cannot change so no need to subscribe
+    auto channels = std::make_shared<std::vector<OutputChannel>>(Silvanus::ParseChannels(config.GetConfigValue("outputChannels", Silvanus::DefaultChannels())));
+    auto findChannel = [channels](const std::string& name)
+    {
+        for (size_t i = 0; i < channels->size(); i++)
+        {
+            if ((*channels)[i].name == name) return (int)i;
+        }
+        return -1;
+    };
+    auto roleMask = [channels](const std::string& role)
+    {
+        for (size_t i = 0; i < channels->size(); i++)
+        {
+            if ((*channels)[i].role == role) return 1u << i;
+        }
+        return 0u;
+    };
+
+    httpService.Post("/system/restart", [=](const httplib::Request& req, httplib::Response& res)
+    {
+        onRestart();
+    }, RoutePriority::Control);
+
+    // The daemon owns the config file, it applies and saves the patch and we re-read it
+    httpService.Patch("/system/settings", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        auto command = makeCommand(LinkCommandType::PatchSettings);
+        if (req.body.size() >= sizeof(command.payload))
+        {
+            res.status = 413;
+            res.body = fmt::format("Bad patch request, settings patches are limited to {} bytes.", sizeof(command.payload) - 1);
+            return;
+        }
+        memcpy(command.payload, req.body.data(), req.body.size());
+        if (failed(link.Send(command, COMMAND_TIMEOUT), res)) return;
+        config.Reload();
+    });
+
+    httpService.Get("/system/settings", [=](const httplib::Request& req, httplib::Response& res)
+    {
+        std::stringstream ss;
+        ss << std::setw(4) << config.GetConfigSnapshot();
+        res.body = ss.str();
+    });
+
+    httpService.Get("/status", [&link, channels, roleMask](const httplib::Request& req, httplib::Response& res)
+    {
+        LinkState state;
+        if (!readState(link, state, res)) return;
+
+        auto status = json::object();
+        status["temperature"] = state.temperature;
+        status["humidity"] = state.humidity;
+        status["light-on"] = (state.channels & roleMask("light")) != 0;
+        status["pump-on"] = (state.channels & roleMask("pump")) != 0;
+        auto& channelStatus = status["channels"] = json::object();
+        auto& dimmers = status["dimmers"] = json::object();
+        for (size_t i = 0; i < channels->size(); i++)
+        {
+            channelStatus[(*channels)[i].name] = (state.channels & (1u << i)) != 0;
+            if (state.dimmerLevels[i] >= 0) dimmers[(*channels)[i].name] = state.dimmerLevels[i];
+        }
+        status["interlocked"] = state.interlocked;
+        std::stringstream ss;
+        ss << std::setw(4) << status;
+        HttpService::SendTagged(req, res, ss.str());
+    });
+
+    // Status and settings fields in one response, the other sections live in the daemon
+    Dashboard::Sources sources;
+    sources.status = [&link](Dashboard::Status& status)
+    {
+        LinkState state;
+        if (!freshState(link, state)) return false;
+        status.temperature = state.temperature;
+        status.humidity = state.humidity;
+        status.channels = state.channels;
+        status.interlocked = state.interlocked;
+        std::copy(std::begin(state.dimmerLevels), std::end(state.dimmerLevels), status.dimmerLevels.begin());
+        return true;
+    };
+    auto dashboard = std::make_shared<Dashboard>(*channels, std::move(sources));
+    httpService.Get("/dashboard", [dashboard](const httplib::Request& req, httplib::Response& res)
+    {
+        Dashboard::Options options{};
+        std::string body;
+        std::string error;
+        switch (dashboard->Serialize(req.has_param("fields") ? req.get_param_value("fields") : "status", options, body, error))
+        {
+            case Dashboard::Result::Ok:
+                HttpService::SendTagged(req, res, std::move(body));
+                break;
+            case Dashboard::Result::BadFields:
+                res.status = 400;
+                res.body = error;
+                break;
+            case Dashboard::Result::Unavailable:
+                res.status = 503;
+                res.body = "Error: the hardware daemon is not running.";
+                break;
+        }
+    });
+
+    httpService.Post("/water-now", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        failed(link.Send(makeCommand(LinkCommandType::WaterNow), COMMAND_TIMEOUT), res);
+    }, RoutePriority::Control);
+
+    httpService.Post("/auto-light", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        failed(link.Send(makeCommand(LinkCommandType::AutoLight), COMMAND_TIMEOUT), res);
+    }, RoutePriority::Control);
+
+    httpService.Get("/channels", [&link, channels](const httplib::Request& req, httplib::Response& res)
+    {
+        LinkState state;
+        if (!readState(link, state, res)) return;
+
+        auto body = json::array();
+        for (size_t i = 0; i < channels->size(); i++)
+        {
+            const auto& channel = (*channels)[i];
+            body.push_back({
+                {"name", channel.name},
+                {"role", channel.role},
+                {"gpio", channel.gpio},
+                {"activeLow", channel.activeLow},
+                {"on", (state.channels & (1u << i)) != 0}
+            });
+        }
+        std::stringstream ss;
+        ss << std::setw(4) << body;
+        res.body = ss.str();
+    }, RoutePriority::Control);
+
+    // Switch any number of channels at once: {"light": true, "fan": false}
+    httpService.Put("/channels", [&link, findChannel](const httplib::Request& req, httplib::Response& res)
+    {
+        auto body = json::parse(req.body, nullptr, false);
+        if (!body.is_object())
+        {
+            res.status = 400;
+            res.body = "Error: Endpoint /channels expects a json object of channel names to bool values.";
+            return;
+        }
+        auto command = makeCommand(LinkCommandType::SetChannels);
+        for (auto& kvp : body.items())
+        {
+            int channel = findChannel(kvp.key());
+            if (channel < 0 || !kvp.value().is_boolean())
+            {
+                res.status = 400;
+                res.body = fmt::format("Error: {} is not a channel name with a bool value.", kvp.key());
+                return;
+            }
+            (kvp.value().get<bool>() ? command.channels : command.offChannels) |= 1u << channel;
+        }
+        failed(link.Send(command, COMMAND_TIMEOUT), res);
+    }, RoutePriority::Control);
+
+    // Brightness outside sunrise/sunset ramps: {"light": 0.5}
+    httpService.Put("/dimmers", [&link, findChannel](const httplib::Request& req, httplib::Response& res)
+    {
+        auto body = json::parse(req.body, nullptr, false);
+        if (!body.is_object())
+        {
+            res.status = 400;
+            res.body = "Error: Endpoint /dimmers expects a json object of channel names to levels from 0 to 1.";
+            return;
+        }
+        // Check every key first so a bad one sends none of the levels, the
+        // state says which channels have a dimmer
+        LinkState state;
+        if (!readState(link, state, res)) return;
+        std::vector<std::pair<int, float>> levels;
+        for (auto& kvp : body.items())
+        {
+            int channel = findChannel(kvp.key());
+            if (channel < 0 || !kvp.value().is_number() || state.dimmerLevels[channel] < 0)
+            {
+                res.status = 400;
+                res.body = fmt::format("Error: {} is not a dimmed channel with a numeric level.", kvp.key());
+                return;
+            }
+            levels.emplace_back(channel, kvp.value().get<float>());
+        }
+        for (const auto& level : levels)
+        {
+            auto command = makeCommand(LinkCommandType::SetDimmer);
+            command.channels = 1u << level.first;
+            command.level = level.second;
+            if (failed(link.Send(command, COMMAND_TIMEOUT), res)) return;
+        }
+    }, RoutePriority::Control);
+
+    httpService.Get("/scenes", [=](const httplib::Request& req, httplib::Response& res)
+    {
+        auto body = json::array();
+        for (auto& scene : config.GetConfigValue("scenes", json::object()).items())
+        {
+            body.push_back(scene.key());
+        }
+        std::stringstream ss;
+        ss << std::setw(4) << body;
+        res.body = ss.str();
+    });
+
+    // Optional body: {"duration": <milliseconds>}
+    httpService.Post("/scene/([^/]+)", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        auto command = makeCommand(LinkCommandType::ApplyScene);
+        if (!req.body.empty())
+        {
+            auto body = json::parse(req.body, nullptr, false);
+            if (!body.is_object() || (body.contains("duration") && !body["duration"].is_number_integer()))
+            {
+                res.status = 400;
+                res.body = "Error: Endpoint /scene expects an empty body or {\"duration\": <milliseconds>}.";
+                return;
+            }
+            command.durationMs = body.value("duration", (int64_t)0);
+        }
+        std::string name = req.matches[1];
+        if (name.size() >= sizeof(command.payload))
+        {
+            res.status = 404;
+            res.body = "Error: there is no scene by that name.";
+            return;
+        }
+        memcpy(command.payload, name.data(), name.size());
+        failed(link.Send(command, COMMAND_TIMEOUT), res);
+    }, RoutePriority::Control);
+
+    for (const std::string role : {"light", "pump"})
+    {
+        httpService.Put("/" + role, [&link, roleMask, role](const httplib::Request& req, httplib::Response& res)
+        {
+            bool on;
+            if (!HttpService::ParseBool(req.body, on))
+            {
+                res.status = 400;
+                res.body = fmt::format("Error: Endpoint /{} expects json bool value.", role);
+                return;
+            }
+            auto command = makeCommand(LinkCommandType::SetChannels);
+            (on ? command.channels : command.offChannels) = roleMask(role);
+            failed(link.Send(command, COMMAND_TIMEOUT), res);
+        }, RoutePriority::Control);
+
+        httpService.Get("/" + role, [&link, roleMask, role](const httplib::Request& req, httplib::Response& res)
+        {
+            LinkState state;
+            if (!readState(link, state, res)) return;
+            json body = (state.channels & roleMask(role)) != 0;
+            std::stringstream ss;
+            ss << std::setw(4) << body;
+            res.body = ss.str();
+        }, RoutePriority::Control);
+    }
+}
@@ -0,0 +1,88 @@
+#include "GpioBackend.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "Log.hpp"
+
+#include <stdexcept>
+#include <string>
+
+// Defines the register pointers, so this is the only file to include it
+#include <minimal_gpio.h>
+
+#if PI_HOST
+static const char* DEFAULT_BACKEND = "pi";
+#else
+static const char* DEFAULT_BACKEND = "simulated";
+#endif
+
+MmapGpio::MmapGpio()
+{
+    if (gpioInitialise() < 0)
+    {
+        throw std::runtime_error("Failed to setup GPIO\n");
+    }
+    gpio_ = gpioReg;
+}
+
+void MmapGpio::SetOutput(unsigned gpio, bool level)
+{
+    gpioWrite(gpio, level ? 1 : 0);
+    gpioSetMode(gpio, PI_OUTPUT);
+}
+
+PwmDimmer::Registers MmapGpio::PwmRegisters() const
+{
+    return PwmDimmer::Registers{pwmReg, clkReg, gpioReg};
+}
+
+uint32_t MmapGpio::OscillatorHz() const
+{
+    return pi_is_2711 ? 54000000 : 19200000;
+}
+
+SimulatedGpio::SimulatedGpio() : levels_(0)
+{
+}
+
+void SimulatedGpio::SetOutput(unsigned gpio, bool level)
+{
+    if (level) SetBank1(1u << gpio);
+    else ClearBank1(1u << gpio);
+}
+
+void SimulatedGpio::SetBank1(uint32_t bits)
+{
+    LOG_DEBUG("[Simulator] Set GPIOs {:#x}", bits);
+    levels_ |= bits;
+}
+
+void SimulatedGpio::ClearBank1(uint32_t bits)
+{
+    LOG_DEBUG("[Simulator] Clear GPIOs {:#x}", bits);
+    levels_ &= ~bits;
+}
+
+PwmDimmer::Registers SimulatedGpio::PwmRegisters()
+{
+    return registers_.Map();
+}
+
+uint32_t SimulatedGpio::OscillatorHz() const
+{
+    return 19200000;
+}
+
+uint32_t SimulatedGpio::Levels() const
+{
+    return levels_;
+}
+
+RuntimeGpio::RuntimeGpio()
+{
+    // The backend cannot change so no need to subscribe
+    std::string backend = config.GetConfigValue("hardwareBackend", std::string(DEFAULT_BACKEND));
+    if (backend == "pi" || backend == "record")
+    {
+        gpio_.emplace<MmapGpio>();
+    }
+}
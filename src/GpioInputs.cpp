@@ -0,0 +1,285 @@
+#include "GpioInputs.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "Log.hpp"
+#include "Silvanus.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/gpio.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#endif
+
+using json = nlohmann::json;
+
+static uint64_t monotonicNs()
+{
+    // Same clock the kernel stamps line events with
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+GpioInputs::GpioInputs(const std::vector<OutputChannel>& channels, std::function<void()> onSwitchChange) :
+    onSwitchChange_(std::move(onSwitchChange)), lineFd_(-1), wakeFd_(-1)
+{
+    // The input table cannot change so no need to subscribe
+    inputs_ = ParseInputs(config.GetConfigValue("inputs", json::array()), channels);
+    std::string chipPath = config.GetConfigValue("gpioChip", std::string("/dev/gpiochip0"));
+    if (inputs_.empty()) return;
+
+    if (!requestLines(chipPath))
+    {
+        LOG_ERROR("Could not watch the input pins on {}, inputs are disabled.", chipPath);
+        return;
+    }
+    thread_ = std::make_unique<std::thread>(&GpioInputs::threadFunc, this);
+}
+
+GpioInputs::~GpioInputs()
+{
+    if (thread_ != nullptr)
+    {
+        uint64_t one = 1;
+        if (write(wakeFd_, &one, sizeof(one)) < 0) { }
+        thread_->join();
+    }
+    if (lineFd_ >= 0) close(lineFd_);
+    if (wakeFd_ >= 0) close(wakeFd_);
+}
+
+std::vector<std::unique_ptr<GpioInputs::Input>> GpioInputs::ParseInputs(const json& table, const std::vector<OutputChannel>& channels)
+{
+    std::vector<std::unique_ptr<Input>> inputs;
+    if (!table.is_array())
+    {
+        LOG_ERROR("inputs must be an array, no inputs configured.");
+        return inputs;
+    }
+
+    for (const auto& entry : table)
+    {
+        auto input = std::make_unique<Input>();
+        try
+        {
+            input->name = entry.at("name").get<std::string>();
+            input->gpio = entry.at("gpio").get<unsigned>();
+            std::string type = entry.value("type", std::string("switch"));
+            if (type == "counter") input->type = Type::Counter;
+            else if (type == "switch") input->type = Type::Switch;
+            else throw std::runtime_error("type must be counter or switch");
+            input->activeLow = entry.value("activeLow", false);
+            std::string pull = entry.value("pull", std::string("none"));
+            if (pull == "none") input->pull = Pull::None;
+            else if (pull == "down") input->pull = Pull::Down;
+            else if (pull == "up") input->pull = Pull::Up;
+            else throw std::runtime_error("pull must be none, down or up");
+            input->debounce = std::chrono::milliseconds(entry.value("debounce", 50));
+            input->pulsesPerLiter = entry.value("pulsesPerLiter", 450.0);
+            input->interlockMask = 0;
+            for (const auto& name : entry.value("interlock", json::array()))
+            {
+                auto it = std::find_if(channels.begin(), channels.end(), [&](const OutputChannel& c) { return c.name == name.get<std::string>(); });
+                if (it == channels.end()) throw std::runtime_error(name.get<std::string>() + " is not a channel");
+                input->interlockMask |= 1u << (it - channels.begin());
+            }
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("Skipping input {}: {}.", entry.dump(), e.what());
+            continue;
+        }
+
+        if (std::any_of(inputs.begin(), inputs.end(), [&](const auto& other) { return other->gpio == input->gpio; }))
+        {
+            LOG_ERROR("Skipping input {}, GPIO {} is already used.", input->name, input->gpio);
+            continue;
+        }
+        input->pending = false;
+        input->pendingHigh = false;
+        input->pendingSinceNs = 0;
+        inputs.push_back(std::move(input));
+    }
+    return inputs;
+}
+
+bool GpioInputs::requestLines(const std::string& chipPath)
+{
+    #ifdef __linux__
+    if (inputs_.size() > GPIO_V2_LINES_MAX) return false;
+
+    int chipFd = open(chipPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (chipFd < 0) return false;
+
+    gpio_v2_line_request request;
+    memset(&request, 0, sizeof(request));
+    strncpy(request.consumer, "silvanus", sizeof(request.consumer) - 1);
+    request.num_lines = inputs_.size();
+    // Room for bursts from every flow meter while the thread is descheduled
+    request.event_buffer_size = 1024;
+
+    uint64_t baseFlags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    request.config.flags = baseFlags;
+    uint64_t pullUpLines = 0;
+    uint64_t pullDownLines = 0;
+    for (size_t i = 0; i < inputs_.size(); i++)
+    {
+        request.offsets[i] = inputs_[i]->gpio;
+        if (inputs_[i]->pull == Pull::Up) pullUpLines |= 1ull << i;
+        if (inputs_[i]->pull == Pull::Down) pullDownLines |= 1ull << i;
+    }
+    for (auto [lines, bias] : {std::make_pair(pullUpLines, (uint64_t)GPIO_V2_LINE_FLAG_BIAS_PULL_UP),
+                               std::make_pair(pullDownLines, (uint64_t)GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN)})
+    {
+        if (lines == 0) continue;
+        auto& attr = request.config.attrs[request.config.num_attrs++];
+        attr.attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+        attr.attr.flags = baseFlags | bias;
+        attr.mask = lines;
+    }
+
+    int result = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &request);
+    close(chipFd);
+    if (result < 0) return false;
+    lineFd_ = request.fd;
+
+    // Start from the current levels, edges only tell us about changes
+    gpio_v2_line_values values;
+    values.mask = inputs_.size() >= 64 ? ~0ull : (1ull << inputs_.size()) - 1;
+    values.bits = 0;
+    if (ioctl(lineFd_, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) == 0)
+    {
+        for (size_t i = 0; i < inputs_.size(); i++)
+        {
+            bool high = (values.bits >> i) & 1;
+            inputs_[i]->active = high != inputs_[i]->activeLow;
+        }
+    }
+
+    wakeFd_ = eventfd(0, EFD_CLOEXEC);
+    return wakeFd_ >= 0;
+    #else
+    return false;
+    #endif
+}
+
+void GpioInputs::handleEdge(Input& input, bool high, uint64_t timestampNs)
+{
+    if (input.type == Type::Counter)
+    {
+        if (!high) return;
+        uint64_t last = input.lastPulseNs.load(std::memory_order_relaxed);
+        if (last != 0) input.lastPeriodNs.store(timestampNs - last, std::memory_order_relaxed);
+        input.lastPulseNs.store(timestampNs, std::memory_order_relaxed);
+        input.pulses.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        // Restart the debounce timer on every bounce
+        input.pending = true;
+        input.pendingHigh = high;
+        input.pendingSinceNs = timestampNs;
+    }
+}
+
+int GpioInputs::settleSwitches(uint64_t nowNs)
+{
+    bool changed = false;
+    int64_t nextDueMs = -1;
+    for (auto& input : inputs_)
+    {
+        if (!input->pending) continue;
+        uint64_t dueNs = input->pendingSinceNs + std::chrono::duration_cast<std::chrono::nanoseconds>(input->debounce).count();
+        if (nowNs >= dueNs)
+        {
+            input->pending = false;
+            bool active = input->pendingHigh != input->activeLow;
+            if (input->active.exchange(active) != active)
+            {
+                LOG_INFO("Input {} is now {}.", input->name, active ? "active" : "inactive");
+                changed = true;
+            }
+        }
+        else
+        {
+            int64_t waitMs = (int64_t)((dueNs - nowNs + 999999) / 1000000);
+            nextDueMs = nextDueMs < 0 ? waitMs : std::min(nextDueMs, waitMs);
+        }
+    }
+    if (changed && onSwitchChange_) onSwitchChange_();
+    return (int)nextDueMs;
+}
+
+void GpioInputs::threadFunc()
+{
+    #ifdef __linux__
+    gpio_v2_line_event events[64];
+    pollfd fds[2] = {{lineFd_, POLLIN, 0}, {wakeFd_, POLLIN, 0}};
+    int timeoutMs = -1;
+    while (true)
+    {
+        int ready = poll(fds, 2, timeoutMs);
+        if (ready < 0 && errno != EINTR) break;
+        if (fds[1].revents != 0) break;
+
+        if (fds[0].revents & POLLIN)
+        {
+            ssize_t bytes = read(lineFd_, events, sizeof(events));
+            for (ssize_t i = 0; i < bytes / (ssize_t)sizeof(gpio_v2_line_event); i++)
+            {
+                for (auto& input : inputs_)
+                {
+                    if (input->gpio == events[i].offset)
+                    {
+                        handleEdge(*input, events[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE, events[i].timestamp_ns);
+                        break;
+                    }
+                }
+            }
+        }
+        timeoutMs = settleSwitches(monotonicNs());
+    }
+    #endif
+}
+
+size_t GpioInputs::Count() const
+{
+    return inputs_.size();
+}
+
+const GpioInputs::Input& GpioInputs::Get(size_t input) const
+{
+    return *inputs_[input];
+}
+
+double GpioInputs::PulseRate(size_t input) const
+{
+    const Input& in = *inputs_[input];
+    uint64_t last = in.lastPulseNs.load(std::memory_order_relaxed);
+    uint64_t period = in.lastPeriodNs.load(std::memory_order_relaxed);
+    if (last == 0 || period == 0 || monotonicNs() - last > 1000000000ull) return 0.0;
+    return 1e9 / period;
+}
+
+uint32_t GpioInputs::InterlockMask() const
+{
+    uint32_t mask = 0;
+    for (const auto& input : inputs_)
+    {
+        if (input->type == Type::Switch && input->active.load(std::memory_order_relaxed))
+        {
+            mask |= input->interlockMask;
+        }
+    }
+    return mask;
+}
+
+bool GpioInputs::Watching() const
+{
+    return thread_ != nullptr;
+}
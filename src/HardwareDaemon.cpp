@@ -0,0 +1,127 @@
+#include "HardwareDaemon.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "Log.hpp"
+
+#include <cstring>
+#include <unistd.h>
+
+// Publishing once a second shares one sensor transaction between two or three states
+static const std::chrono::seconds PUBLISH_READING_MAX_AGE(2);
+
+HardwareDaemon::HardwareDaemon(Silvanus& silvanus, PlantSchedule& schedule, SceneTable& scenes) :
+    silvanus_(silvanus), schedule_(schedule), scenes_(scenes), temperature_(0.0f), humidity_(0.0f), exit_(false)
+{
+    // The link name cannot change so no need to subscribe
+    link_ = std::make_unique<HardwareLink>(config.GetConfigValue("hardwareLink", std::string("/silvanus-link")), HardwareLink::Role::Daemon);
+    publish(true);
+    thread_ = std::make_unique<std::thread>(&HardwareDaemon::threadFunc, this);
+}
+
+HardwareDaemon::~HardwareDaemon()
+{
+    exit_ = true;
+    link_->Interrupt();
+    thread_->join();
+}
+
+void HardwareDaemon::Publish()
+{
+    publish(true);
+}
+
+void HardwareDaemon::publish(bool readSensors)
+{
+    // Slow I2C reads happen before taking the lock so command results aren't held up
+    float temperature = 0.0f;
+    float humidity = 0.0f;
+    if (readSensors)
+    {
+        silvanus_.CachedReading(PUBLISH_READING_MAX_AGE, temperature, humidity);
+    }
+
+    const std::lock_guard<std::mutex> lock(publishMutex_);
+    if (readSensors)
+    {
+        temperature_ = temperature;
+        humidity_ = humidity;
+    }
+
+    LinkState state;
+    memset(&state, 0, sizeof(state));
+    state.updatedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    state.daemonPid = getpid();
+    state.channels = silvanus_.GetChannels();
+    state.interlocked = silvanus_.InterlockedChannels();
+    state.temperature = temperature_;
+    state.humidity = humidity_;
+    for (size_t i = 0; i < Silvanus::MaxChannels; i++)
+    {
+        state.dimmerLevels[i] = i < silvanus_.Channels().size() ? silvanus_.Dimming().Level((int)i) : -1.0f;
+    }
+    state.deadlineMisses = silvanus_.DeadlineMissCount();
+    link_->PublishState(state);
+}
+
+LinkResult HardwareDaemon::execute(const LinkCommand& command)
+{
+    // Never trust the front end to have terminated the payload
+    std::string payload(command.payload, strnlen(command.payload, sizeof(command.payload)));
+
+    switch (command.type)
+    {
+        case LinkCommandType::SetChannels:
+            silvanus_.SetChannels(command.channels, command.offChannels);
+            return LinkResult::Ok;
+        case LinkCommandType::PulseChannels:
+            if (command.durationMs < 0 || command.durationMs > silvanus_.MaxPulseDuration().count()) return LinkResult::Rejected;
+            silvanus_.PulseChannels(command.channels, std::chrono::milliseconds(command.durationMs));
+            return LinkResult::Ok;
+        case LinkCommandType::WaterNow:
+            schedule_.WaterNow();
+            return LinkResult::Ok;
+        case LinkCommandType::AutoLight:
+            schedule_.Prime();
+            return LinkResult::Ok;
+        case LinkCommandType::ApplyScene:
+            switch (scenes_.Apply(payload, std::chrono::milliseconds(command.durationMs)))
+            {
+                case SceneTable::ApplyResult::Applied: return LinkResult::Ok;
+                case SceneTable::ApplyResult::UnknownScene: return LinkResult::UnknownScene;
+                case SceneTable::ApplyResult::BadDuration: return LinkResult::Rejected;
+            }
+            return LinkResult::Rejected;
+        case LinkCommandType::SetDimmer:
+            if ((command.channels & ~silvanus_.Dimming().DimmedMask()) != 0) return LinkResult::Rejected;
+            for (uint32_t pending = command.channels; pending != 0; pending &= pending - 1)
+            {
+                if (!silvanus_.Dimming().SetBaseLevel(__builtin_ctz(pending), command.level)) return LinkResult::Rejected;
+            }
+            return LinkResult::Ok;
+        case LinkCommandType::PatchSettings:
+        {
+            std::string error;
+            if (!config.ParseAndApplyPatch(payload, error)) return LinkResult::Rejected;
+            config.SaveConfig();
+            schedule_.Prime();
+            return LinkResult::Ok;
+        }
+    }
+    return LinkResult::Rejected;
+}
+
+void HardwareDaemon::threadFunc()
+{
+    while (!exit_)
+    {
+        size_t served = link_->Serve(std::chrono::milliseconds(500), [this](const LinkCommand& command)
+        {
+            return execute(command);
+        });
+        if (served > 0)
+        {
+            // Let the front end see what the commands did without waiting for the next sensor read
+            publish(false);
+        }
+    }
+}
@@ -0,0 +1,191 @@
+#include "HardwareLink.hpp"
+#include "Log.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const uint64_t LINK_MAGIC = 0x4b4e494c534c5653; // "SVLSLINK"
+static const uint32_t LINK_VERSION = 1;
+// Tries at a consistent state copy before ReadState gives up
+static const int STATE_READ_ATTEMPTS = 1000;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "Futex words must be plain 32 bit integers");
+
+// Shared (not FUTEX_PRIVATE) so the other process can wake us
+static void futexWait(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::nanoseconds timeout)
+{
+    timespec ts;
+    ts.tv_sec = timeout.count() / 1000000000;
+    ts.tv_nsec = timeout.count() % 1000000000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+static void futexWake(std::atomic<uint32_t>& word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+HardwareLink::HardwareLink(const std::string& name, Role role) :
+    name_(name), role_(role), region_(nullptr)
+{
+    if (!attach() && role_ == Role::Daemon)
+    {
+        LOG_ERROR("Could not create the hardware link {}, the web front end will not be able to reach us.", name_);
+    }
+}
+
+HardwareLink::~HardwareLink()
+{
+    if (region_ != nullptr)
+    {
+        munmap(region_, sizeof(Region));
+    }
+}
+
+bool HardwareLink::attach()
+{
+    if (region_ != nullptr) return true;
+
+    // The daemon keeps the object across its restarts so an attached front end stays attached
+    int fd = shm_open(name_.c_str(), role_ == Role::Daemon ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDWR | O_CLOEXEC, 0660);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok && role_ == Role::Daemon)
+    {
+        // Readable by the web front end's user through the group, regardless of umask
+        if (fchmod(fd, 0660) != 0) { }
+        if (st.st_size != (off_t)sizeof(Region)) ok = ftruncate(fd, sizeof(Region)) == 0;
+    }
+    else if (ok)
+    {
+        ok = st.st_size == (off_t)sizeof(Region);
+    }
+    void* memory = ok ? mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (memory == MAP_FAILED) return false;
+    Region* region = static_cast<Region*>(memory);
+
+    if (role_ == Role::Daemon)
+    {
+        if (region->magic != LINK_MAGIC || region->version != LINK_VERSION || region->size != sizeof(Region))
+        {
+            memset(memory, 0, sizeof(Region));
+            new (region) Region();
+            region->version = LINK_VERSION;
+            region->size = sizeof(Region);
+            std::atomic_thread_fence(std::memory_order_release);
+            region->magic = LINK_MAGIC;
+        }
+        // A daemon killed mid-publish leaves the sequence odd, which would
+        // keep every later state looking torn
+        region->stateSeq.store((region->stateSeq.load(std::memory_order_relaxed) + 1) & ~1u, std::memory_order_release);
+        // Commands queued for a previous daemon are stale, their senders gave up
+        region->tail.store(region->head.load(std::memory_order_acquire), std::memory_order_release);
+        region->completed.store((uint32_t)region->head.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+    else if (region->magic != LINK_MAGIC || region->version != LINK_VERSION || region->size != sizeof(Region))
+    {
+        LOG_ERROR_EVERY(60000, "The hardware link {} is from a different version of Silvanus.", name_);
+        munmap(memory, sizeof(Region));
+        return false;
+    }
+    region_ = region;
+    return true;
+}
+
+LinkResult HardwareLink::Send(const LinkCommand& command, std::chrono::milliseconds timeout)
+{
+    const std::lock_guard<std::mutex> lock(sendMutex_);
+    if (!attach()) return LinkResult::Unavailable;
+
+    uint64_t head = region_->head.load(std::memory_order_relaxed);
+    if (head - region_->tail.load(std::memory_order_acquire) >= RingCapacity)
+    {
+        return LinkResult::QueueFull;
+    }
+    size_t slot = head % RingCapacity;
+    region_->commands[slot] = command;
+    region_->head.store(head + 1, std::memory_order_release);
+    region_->doorbell.fetch_add(1, std::memory_order_release);
+    futexWake(region_->doorbell);
+
+    // Holding sendMutex_ until the result is in keeps the slot ours
+    uint32_t target = (uint32_t)(head + 1);
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true)
+    {
+        uint32_t done = region_->completed.load(std::memory_order_acquire);
+        if ((int32_t)(done - target) >= 0)
+        {
+            return region_->results[slot];
+        }
+        auto remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining <= std::chrono::nanoseconds(0))
+        {
+            return LinkResult::Timeout;
+        }
+        futexWait(region_->completed, done, remaining);
+    }
+}
+
+bool HardwareLink::ReadState(LinkState& state)
+{
+    {
+        const std::lock_guard<std::mutex> lock(sendMutex_);
+        if (!attach()) return false;
+    }
+
+    // A publish takes microseconds, give up if the daemon died in the middle of one
+    for (int attempt = 0; attempt < STATE_READ_ATTEMPTS; attempt++)
+    {
+        uint32_t before = region_->stateSeq.load(std::memory_order_acquire);
+        if ((before & 1) == 0)
+        {
+            memcpy(&state, &region_->state, sizeof(state));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (region_->stateSeq.load(std::memory_order_relaxed) == before) return state.updatedNs != 0;
+        }
+        std::this_thread::yield();
+    }
+    LOG_WARNING_EVERY(60000, "The hardware link state stayed torn, is the daemon stuck?");
+    return false;
+}
+
+void HardwareLink::PublishState(const LinkState& state)
+{
+    if (region_ == nullptr) return;
+    uint32_t seq = region_->stateSeq.load(std::memory_order_relaxed);
+    region_->stateSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&region_->state, &state, sizeof(state));
+    region_->stateSeq.store(seq + 2, std::memory_order_release);
+}
+
+void HardwareLink::Interrupt()
+{
+    if (region_ == nullptr) return;
+    region_->doorbell.fetch_add(1, std::memory_order_release);
+    futexWake(region_->doorbell);
+}
+
+void HardwareLink::waitDoorbell(uint32_t bell, std::chrono::milliseconds wait)
+{
+    futexWait(region_->doorbell, bell, wait);
+}
+
+void HardwareLink::complete(uint32_t tail)
+{
+    region_->completed.store(tail, std::memory_order_release);
+    futexWake(region_->completed);
+}
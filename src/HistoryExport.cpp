@@ -0,0 +1,197 @@
+#include "HistoryExport.hpp"
+#include "Log.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+HistoryExport::HistoryExport(const SampleHistory& history, Format format,
+                             SampleHistory::Clock::time_point from, SampleHistory::Clock::time_point to, bool gzip) :
+    history_(&history), journal_(nullptr), format_(format), cursor_(history.Seek(from)), to_(to), gzip_(gzip), headerWritten_(false)
+{
+    startGzip();
+}
+
+HistoryExport::HistoryExport(const EventJournal& journal, std::vector<std::string> channelNames, Format format,
+                             SampleHistory::Clock::time_point from, SampleHistory::Clock::time_point to, bool gzip) :
+    history_(nullptr), journal_(&journal), channelNames_(std::move(channelNames)), format_(format),
+    cursor_(journal.Seek(from)), to_(to), gzip_(gzip), headerWritten_(false)
+{
+    startGzip();
+}
+
+void HistoryExport::startGzip()
+{
+    if (gzip_)
+    {
+        memset(&zstream_, 0, sizeof(zstream_));
+        // 16 + 15 window bits writes a gzip header, the fastest level is plenty for text this repetitive
+        if (deflateInit2(&zstream_, Z_BEST_SPEED, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            LOG_ERROR("Could not start gzip for a history export.");
+            gzip_ = false;
+        }
+    }
+}
+
+HistoryExport::~HistoryExport()
+{
+    if (gzip_)
+    {
+        deflateEnd(&zstream_);
+    }
+}
+
+const char* HistoryExport::ContentType(Format format)
+{
+    return format == Format::Csv ? "text/csv" : "application/x-ndjson";
+}
+
+bool HistoryExport::Compressed() const
+{
+    return gzip_;
+}
+
+void HistoryExport::formatReading(float value)
+{
+    if (std::isnan(value))
+    {
+        text_ += format_ == Format::Csv ? "" : "null";
+        return;
+    }
+    fmt::format_to(std::back_inserter(text_), "{:.2f}", value);
+}
+
+void HistoryExport::format(const StateSample& sample)
+{
+    auto out = std::back_inserter(text_);
+    if (format_ == Format::Csv)
+    {
+        fmt::format_to(out, "{:.3f},", sample.timeNs / 1e9);
+        formatReading(sample.temperature);
+        text_ += ',';
+        formatReading(sample.humidity);
+        text_ += '\n';
+    }
+    else
+    {
+        fmt::format_to(out, "{{\"time\":{:.3f},\"temperature\":", sample.timeNs / 1e9);
+        formatReading(sample.temperature);
+        text_ += ",\"humidity\":";
+        formatReading(sample.humidity);
+        text_ += "}\n";
+    }
+}
+
+void HistoryExport::format(const EventJournal::Record& record)
+{
+    auto out = std::back_inserter(text_);
+    const char* type = EventJournal::TypeName(record.type);
+    if (format_ == Format::Csv)
+    {
+        // Channel names separated by spaces so the field needs no quoting
+        fmt::format_to(out, "{:.3f},{},", record.timeNs / 1e9, type);
+        const char* separator = "";
+        for (size_t i = 0; i < channelNames_.size(); i++)
+        {
+            if ((record.channels & (1u << i)) == 0) continue;
+            fmt::format_to(out, "{}{}", separator, channelNames_[i]);
+            separator = " ";
+        }
+        fmt::format_to(out, ",{},{}\n", record.key, record.value);
+    }
+    else
+    {
+        auto names = nlohmann::json::array();
+        for (size_t i = 0; i < channelNames_.size(); i++)
+        {
+            if ((record.channels & (1u << i)) != 0) names.push_back(channelNames_[i]);
+        }
+        fmt::format_to(out, "{{\"time\":{:.3f},\"type\":\"{}\",\"channels\":{},\"key\":{},\"value\":{}}}\n",
+                       record.timeNs / 1e9, type, names.dump(), record.key, record.value);
+    }
+}
+
+bool HistoryExport::formatSamples()
+{
+    size_t count = history_->Read(cursor_, to_, batch_, BatchSize);
+    for (size_t i = 0; i < count; i++)
+    {
+        format(batch_[i]);
+    }
+    return count < BatchSize;
+}
+
+bool HistoryExport::formatEvents()
+{
+    uint64_t toNs = std::chrono::duration_cast<std::chrono::nanoseconds>(to_.time_since_epoch()).count();
+    std::vector<EventJournal::Record> records = journal_->Read(cursor_, BatchSize);
+    for (const auto& record : records)
+    {
+        if (record.timeNs >= toNs) return true;
+        format(record);
+        cursor_++;
+    }
+    return records.size() < BatchSize;
+}
+
+bool HistoryExport::emit(httplib::DataSink& sink, bool last)
+{
+    if (!gzip_)
+    {
+        return text_.empty() || sink.write(text_.data(), text_.size());
+    }
+
+    zstream_.next_in = (Bytef*)text_.data();
+    zstream_.avail_in = (uInt)text_.size();
+    int flush = last ? Z_FINISH : Z_NO_FLUSH;
+    int result;
+    do
+    {
+        compressed_.resize(16384);
+        zstream_.next_out = (Bytef*)&compressed_[0];
+        zstream_.avail_out = (uInt)compressed_.size();
+        result = deflate(&zstream_, flush);
+        if (result == Z_STREAM_ERROR)
+        {
+            return false;
+        }
+        size_t produced = compressed_.size() - zstream_.avail_out;
+        if (produced > 0 && !sink.write(compressed_.data(), produced))
+        {
+            return false;
+        }
+    } while (zstream_.avail_out == 0 || (last && result != Z_STREAM_END));
+    return true;
+}
+
+bool HistoryExport::WriteNext(httplib::DataSink& sink)
+{
+    if (!sink.is_writable())
+    {
+        return false;
+    }
+
+    text_.clear();
+    if (!headerWritten_)
+    {
+        if (format_ == Format::Csv)
+        {
+            text_ += journal_ != nullptr ? "time,type,channels,key,value\n" : "time,temperature,humidity\n";
+        }
+        headerWritten_ = true;
+    }
+
+    bool last = journal_ != nullptr ? formatEvents() : formatSamples();
+    if (!emit(sink, last))
+    {
+        return false;
+    }
+    if (last)
+    {
+        sink.done();
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+#include "HttpRouteTable.hpp"
+
+bool HttpRouteTable::IsExactPath(const std::string& pattern)
+{
+    return pattern.find_first_of("()[]{}*+?\\|^$:") == std::string::npos;
+}
+
+int HttpRouteTable::methodIndex(const std::string& method)
+{
+    if (method == "GET" || method == "HEAD") return 0;
+    if (method == "POST") return 1;
+    if (method == "PUT") return 2;
+    if (method == "PATCH") return 3;
+    if (method == "DELETE") return 4;
+    if (method == "OPTIONS") return 5;
+    return -1;
+}
+
+bool HttpRouteTable::Add(const std::string& method, const std::string& path, Route route)
+{
+    int index = methodIndex(method);
+    if (index < 0)
+        return false;
+    routes_[index][path] = std::make_shared<const Route>(std::move(route));
+    return true;
+}
+
+std::shared_ptr<const HttpRouteTable::Route> HttpRouteTable::Find(const std::string& method, const std::string& path) const
+{
+    int index = methodIndex(method);
+    if (index < 0)
+        return nullptr;
+    auto it = routes_[index].find(path);
+    if (it == routes_[index].end())
+        return nullptr;
+    return it->second;
+}
+
+size_t HttpRouteTable::Size() const
+{
+    size_t size = 0;
+    for (const auto& routes : routes_)
+    {
+        size += routes.size();
+    }
+    return size;
+}
@@ -1,41 +1,25 @@
 #include "HttpService.hpp"
 #include "ConfigService.hpp"
 static auto& config = ConfigService::global;
+#include "Log.hpp"
+#include "TlsSetup.hpp"
 
 #include <sys/types.h>
 #include <ifaddrs.h>
 #include <filesystem>
+#include <string_view>
 #include <nlohmann/json.hpp>
 #include <fmt/format.h>
 
 using json = nlohmann::json;
 
-static bool endsWith (const std::string& fullString, const std::string& ending) 
-{
-    if (fullString.length() >= ending.length()) 
-    {
-        return (0 == fullString.compare(fullString.length() - ending.length(), ending.length(), ending));
-    } 
-    return false;
-}
-
-static std::string getMimeType(const std::string& filename)
-{
-    if (endsWith(filename, ".html") || endsWith(filename, ".htm"))
-    {
-        return "text/html";
-    }
-    else if (endsWith(filename, ".css"))
-    {
-        return "text/css";
-    }
-    else if (endsWith(filename, ".js"))
-    {
-        return "text/javascript";
-    }
-
-    return "text/plain";
-}
+#if PI_HOST
+static const char* TLS_CERT_PATH = "/var/lib/silvanus/silvanus-cert.pem";
+static const char* TLS_KEY_PATH = "/var/lib/silvanus/silvanus-key.pem";
+#else
+static const char* TLS_CERT_PATH = "silvanus-cert.pem";
+static const char* TLS_KEY_PATH = "silvanus-key.pem";
+#endif
 
 static std::string getFirstExternalHostAddr()
 {
@@ -82,33 +66,31 @@ static std::string getFirstExternalHostAddr()
     return hostAddr;
 }
 
-HttpService::HttpService()
+// Figure out the port and bind address for the server
+// These cannot change so no need to subscribe
+HttpService::HttpService() : 
+    HttpService(config.GetConfigValue("httpServiceAddress", std::string("0.0.0.0")),
+                config.GetConfigValue("httpServicePort", 80))
 {
-    std::filesystem::path webDir = std::filesystem::path(config.resourcePath()) / "Web";
-    for (const auto & entry : std::filesystem::directory_iterator(webDir))
+    if (config.GetConfigValue("httpsEnabled", false))
     {
-        if (entry.is_regular_file() && (entry.path().extension() == ".html" || 
-                                        entry.path().extension() == ".htm" || 
-                                        entry.path().extension() == ".css" || 
-                                        entry.path().extension() == ".js"))
-        {
-            std::ifstream t(entry.path());
-            std::stringstream buffer;
-            buffer << t.rdbuf();
-            web[entry.path().filename()] = buffer.str();
-        }
+        startTls(config.GetConfigValue("httpServiceAddress", std::string("0.0.0.0")));
     }
+}
+
+HttpService::HttpService(const std::string& addr, int port) : tlsPort_(0)
+{
+    std::filesystem::path webDir = std::filesystem::path(config.resourcePath()) / "Web";
+    web.Load(webDir);
         
     srv = std::make_unique<httplib::Server>();
 
+    // Bound the worker pool and shed load before it starves the actuators
+    setupAdmission();
+
     // Setup the HTTP API
     setupCallbacks();
 
-    // Figure out the port and bind address for the server
-    // These cannot change so no need to subscribe
-    int port = config.GetConfigValue("httpServicePort", 80);
-    std::string addr = config.GetConfigValue("httpServiceAddress", std::string("0.0.0.0"));
-    
     if (port == 0)
     {
       port = srv->bind_to_any_port(addr.c_str());
@@ -132,6 +114,7 @@ HttpService::HttpService()
     while (srv->is_valid() && !srv->is_running() && i < 10)
     {
       std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      i++;
     }
 
     if (!srv->is_valid() || i == 10)
@@ -141,6 +124,7 @@ HttpService::HttpService()
       throw std::runtime_error("Mock server did not start!");
     }
 
+    port_ = port;
     listeningInterface = getFirstExternalHostAddr();
 }
 
@@ -150,11 +134,66 @@ HttpService::~HttpService()
     {
         srv->stop();
     }
+    if (tlsSrv_ != nullptr)
+    {
+        tlsSrv_->stop();
+    }
 
     if (serverThread != nullptr)
     {
         serverThread->join();
     }
+    if (tlsThread_ != nullptr)
+    {
+        tlsThread_->join();
+    }
+}
+
+void HttpService::startTls(const std::string& addr)
+{
+    // These cannot change so no need to subscribe
+    int port = config.GetConfigValue("httpsPort", 443);
+    std::string certPath = config.GetConfigValue("httpsCertPath", std::string(TLS_CERT_PATH));
+    std::string keyPath = config.GetConfigValue("httpsKeyPath", std::string(TLS_KEY_PATH));
+    int validDays = config.GetConfigValue("httpsCertValidDays", 365);
+    int renewDays = config.GetConfigValue("httpsCertRenewDays", 30);
+    long cacheSize = config.GetConfigValue("httpsSessionCacheSize", 256);
+    long sessionTimeout = config.GetConfigValue("httpsSessionTimeout", 86400);
+
+    // HTTPS is an extra, plain HTTP keeps working if it can't start
+    if (!TlsSetup::EnsureCertificate(certPath, keyPath, validDays, renewDays))
+    {
+        LOG_ERROR("HTTPS disabled, there is no usable certificate.");
+        return;
+    }
+    auto tls = std::make_unique<httplib::SSLServer>([&](SSL_CTX& ctx)
+    {
+        return TlsSetup::ConfigureServer(ctx, certPath, keyPath, cacheSize, sessionTimeout);
+    });
+    if (!tls->is_valid())
+    {
+        LOG_ERROR("HTTPS disabled, the TLS context could not be set up.");
+        return;
+    }
+    tlsSrv_ = std::move(tls);
+    setupDispatch(*tlsSrv_);
+
+    tlsThread_ = std::make_unique<std::thread>([this, addr, port]()
+    {
+        if (!tlsSrv_->listen(addr.c_str(), port))
+        {
+            LOG_ERROR("HTTPS could not listen on {}:{}.", addr, port);
+        }
+    });
+    for (int i = 0; i < 10 && !tlsSrv_->is_running(); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (tlsSrv_->is_running())
+    {
+        tlsPort_ = port;
+        LOG_INFO("Serving HTTPS on port {}.", port);
+    }
 }
 
 static json getRequestPayload(const httplib::Request& req)
@@ -175,33 +214,182 @@ static json getRequestPayload(const httplib::Request& req)
     return payload;
 }
 
+void HttpService::setupAdmission()
+{
+    // These cannot change so no need to subscribe
+    HttpAdmission::Limits limits;
+    int workers = config.GetConfigValue("httpWorkerCount", (int)std::max(2u, std::thread::hardware_concurrency()));
+    limits.workers = std::max(1, workers);
+    limits.queueLimit = std::max(1, config.GetConfigValue("httpQueueLimit", 32));
+    // By default keep one worker free for Control routes, and let static files use at most half
+    limits.apiBudget = std::max(1, config.GetConfigValue("httpApiBudget", std::max(1, workers - 1)));
+    limits.staticBudget = std::max(1, config.GetConfigValue("httpStaticBudget", std::max(1, workers / 2)));
+    limits.retryAfterSec = config.GetConfigValue("httpRetryAfter", 1);
+    admission_ = std::make_unique<HttpAdmission>(limits);
+    setupDispatch(*srv);
+}
+
+void HttpService::setupDispatch(httplib::Server& server)
+{
+    // Every listener shares the admission limits
+    server.new_task_queue = [this]()
+    {
+        return new HttpWorkerPool(*admission_);
+    };
+
+    // Fixed path routes are dispatched from here, anything else
+    // goes on to httplib's regex routing
+    server.set_pre_routing_handler([this](const httplib::Request& req, httplib::Response& res)
+    {
+        std::shared_ptr<const HttpRouteTable::Route> route;
+        {
+            const std::shared_lock<std::shared_mutex> lock(routesMutex_);
+            route = routes_.Find(req.method, req.path);
+        }
+        if (route == nullptr)
+        {
+            return httplib::Server::HandlerResponse::Unhandled;
+        }
+
+        if (admission_->Admit(route->priority))
+        {
+            route->handler(req, res);
+        }
+        else
+        {
+            setBusyResponse(res);
+        }
+        return httplib::Server::HandlerResponse::Handled;
+    });
+}
+
+void HttpService::setBusyResponse(httplib::Response& res)
+{
+    res.status = 503;
+    res.set_header("Retry-After", std::to_string(admission_->GetLimits().retryAfterSec));
+    res.set_header("Connection", "close");
+    res.set_content("Server busy, retry later.", "text/plain");
+}
+
+void HttpService::SendTagged(const httplib::Request& req, httplib::Response& res, std::string body)
+{
+    // FNV-1a, only has to change when the body does
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : body)
+    {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    std::string etag = fmt::format("\"{:016x}\"", hash);
+    res.set_header("ETag", etag);
+    if (req.get_header_value("If-None-Match") == etag)
+    {
+        res.status = 304;
+        return;
+    }
+    res.body = std::move(body);
+}
+
+bool HttpService::ParseBool(const std::string& body, bool& value)
+{
+    // Json allows whitespace around the literal
+    size_t first = body.find_first_not_of(" \t\r\n");
+    size_t last = body.find_last_not_of(" \t\r\n");
+    if (first == std::string::npos) return false;
+    std::string_view literal(body.data() + first, last - first + 1);
+    if (literal != "true" && literal != "false") return false;
+    value = literal == "true";
+    return true;
+}
+
+void HttpService::addRoute(const std::string& method, const std::string& pattern, httplib::Server::Handler handler, RoutePriority priority)
+{
+    if (HttpRouteTable::IsExactPath(pattern))
+    {
+        const std::unique_lock<std::shared_mutex> lock(routesMutex_);
+        if (routes_.Add(method, pattern, HttpRouteTable::Route{handler, priority}))
+            return;
+    }
+
+    // Regex routes are only known to match once httplib has picked them,
+    // so they are admitted from inside the handler
+    auto admitted = [this, handler, priority](const httplib::Request& req, httplib::Response& res)
+    {
+        if (admission_->Admit(priority))
+        {
+            handler(req, res);
+        }
+        else
+        {
+            setBusyResponse(res);
+        }
+    };
+
+    for (httplib::Server* server : {srv.get(), tlsSrv_.get()})
+    {
+        if (server == nullptr) continue;
+        if (method == "GET") server->Get(pattern, admitted);
+        else if (method == "POST") server->Post(pattern, admitted);
+        else if (method == "PUT") server->Put(pattern, admitted);
+        else if (method == "PATCH") server->Patch(pattern, admitted);
+        else if (method == "DELETE") server->Delete(pattern, admitted);
+        else throw std::runtime_error("Unsupported HTTP method " + method);
+    }
+}
+
+void HttpService::Get(const std::string& pattern, httplib::Server::Handler handler, RoutePriority priority)
+{
+    addRoute("GET", pattern, handler, priority);
+}
+
+void HttpService::Post(const std::string& pattern, httplib::Server::Handler handler, RoutePriority priority)
+{
+    addRoute("POST", pattern, handler, priority);
+}
+
+void HttpService::Put(const std::string& pattern, httplib::Server::Handler handler, RoutePriority priority)
+{
+    addRoute("PUT", pattern, handler, priority);
+}
+
+void HttpService::Patch(const std::string& pattern, httplib::Server::Handler handler, RoutePriority priority)
+{
+    addRoute("PATCH", pattern, handler, priority);
+}
+
+void HttpService::Delete(const std::string& pattern, httplib::Server::Handler handler, RoutePriority priority)
+{
+    addRoute("DELETE", pattern, handler, priority);
+}
+
+const HttpAdmission& HttpService::Admission() const
+{
+    return *admission_;
+}
+
 void HttpService::setupCallbacks()
 {
     // Serve everything in the web server cache
-    for (const auto& [filename, text] : web )
+    for (const auto& [filename, file] : web.Files())
     {
-        std::string name = filename;
-        std::string mimetype = getMimeType(name);
-        srv->Get(fmt::format("/{}", filename), [this, name, mimetype](const httplib::Request& req, httplib::Response& res) 
+        const StaticFileCache::File* cached = &file;
+        Get(fmt::format("/{}", filename), [cached](const httplib::Request& req, httplib::Response& res) 
         {
-            res.set_content(web[name], mimetype);
-        });
+            res.set_content(cached->content, cached->mimeType);
+        }, RoutePriority::Static);
     }
 
     // Add the default index handler
-    if (web.count("index.html"))
+    const StaticFileCache::File* index = web.Find("index.html");
+    if (index == nullptr)
     {
-        srv->Get("/", [=](const httplib::Request& req, httplib::Response& res) 
-        {
-            res.set_content(web["index.html"], getMimeType("index.html"));
-        });
+        index = web.Find("index.htm");
     }
-    else if (web.count("index.htm"))
+    if (index != nullptr)
     {
-        srv->Get("/", [=](const httplib::Request& req, httplib::Response& res) 
+        Get("/", [index](const httplib::Request& req, httplib::Response& res) 
         {
-            res.set_content(web["index.htm"], getMimeType("index.htm"));
-        });
+            res.set_content(index->content, index->mimeType);
+        }, RoutePriority::Static);
     }
 }
 
@@ -210,6 +398,16 @@ std::string HttpService::ListeningInterface()
     return listeningInterface;
 }
 
+int HttpService::Port()
+{
+    return port_;
+}
+
+int HttpService::TlsPort()
+{
+    return tlsPort_;
+}
+
 bool HttpService::Running()
 {
     return srv->is_running();
@@ -0,0 +1,236 @@
+#include "HttpWorkerPool.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    // What the current worker thread is busy with
+    struct WorkerState
+    {
+        HttpAdmission* owner = nullptr;
+        int priority = -1;
+        bool shed = false;
+        bool dropped = false;
+    };
+    thread_local WorkerState workerState;
+
+    // Lets enqueue() compile against both flavors of httplib::TaskQueue
+    template <typename R>
+    R enqueueResult(bool accepted)
+    {
+        if constexpr (std::is_void_v<R>)
+            return;
+        else
+            return accepted;
+    }
+}
+
+HttpAdmission::HttpAdmission(const Limits& limits) : limits_(limits)
+{
+    for (auto& busy : busy_)
+    {
+        busy = 0;
+    }
+    rejected_ = 0;
+    shedConnections_ = 0;
+    droppedConnections_ = 0;
+}
+
+const HttpAdmission::Limits& HttpAdmission::GetLimits() const
+{
+    return limits_;
+}
+
+bool HttpAdmission::Admit(RoutePriority priority)
+{
+    // A keep-alive connection handles requests back to back, so
+    // let go of whatever the previous request on this worker was counted as
+    Release();
+
+    int p = (int)priority;
+    // Past both queues not even Control routes are served
+    if (workerState.dropped)
+    {
+        rejected_++;
+        return false;
+    }
+    if (priority == RoutePriority::Control)
+    {
+        busy_[p]++;
+        workerState.owner = this;
+        workerState.priority = p;
+        return true;
+    }
+
+    if (workerState.shed)
+    {
+        rejected_++;
+        return false;
+    }
+
+    busy_[p]++;
+    size_t nonControl = busy_[(int)RoutePriority::Api] + busy_[(int)RoutePriority::Static];
+    bool admitted = nonControl <= limits_.apiBudget &&
+                    (priority != RoutePriority::Static || busy_[p] <= limits_.staticBudget);
+    if (!admitted)
+    {
+        busy_[p]--;
+        rejected_++;
+        return false;
+    }
+
+    workerState.owner = this;
+    workerState.priority = p;
+    return true;
+}
+
+void HttpAdmission::Release()
+{
+    if (workerState.owner == this && workerState.priority >= 0)
+    {
+        busy_[workerState.priority]--;
+    }
+    workerState.owner = nullptr;
+    workerState.priority = -1;
+}
+
+void HttpAdmission::SetShed(bool shed)
+{
+    workerState.shed = shed;
+}
+
+void HttpAdmission::SetDropped(bool dropped)
+{
+    workerState.dropped = dropped;
+}
+
+uint64_t HttpAdmission::RejectedCount() const
+{
+    return rejected_;
+}
+
+uint64_t HttpAdmission::ShedConnectionCount() const
+{
+    return shedConnections_;
+}
+
+void HttpAdmission::CountShedConnection()
+{
+    shedConnections_++;
+}
+
+uint64_t HttpAdmission::DroppedConnectionCount() const
+{
+    return droppedConnections_;
+}
+
+void HttpAdmission::CountDroppedConnection()
+{
+    droppedConnections_++;
+}
+
+HttpWorkerPool::HttpWorkerPool(HttpAdmission& admission) : admission_(admission)
+{
+    shutdown_ = false;
+    takeShed_ = false;
+    size_t workers = std::max<size_t>(1, admission_.GetLimits().workers);
+    for (size_t i = 0; i < workers; i++)
+    {
+        workers_.emplace_back(&HttpWorkerPool::workerThreadFunc, this);
+    }
+}
+
+HttpWorkerPool::~HttpWorkerPool()
+{
+    shutdown();
+}
+
+HttpWorkerPool::EnqueueResult HttpWorkerPool::enqueue(std::function<void()> fn)
+{
+    size_t queueLimit = admission_.GetLimits().queueLimit;
+    bool dropped = false;
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.size() < queueLimit)
+        {
+            queue_.push_back(std::move(fn));
+        }
+        else if (shedQueue_.size() < queueLimit)
+        {
+            shedQueue_.push_back(std::move(fn));
+            admission_.CountShedConnection();
+        }
+        else
+        {
+            admission_.CountDroppedConnection();
+            dropped = true;
+        }
+    }
+    if (!dropped)
+    {
+        cv_.notify_one();
+        return enqueueResult<EnqueueResult>(true);
+    }
+
+    // Too far over budget to even queue. Newer httplib closes the socket
+    // when we refuse it, older can't be refused and holds the socket inside
+    // fn, so the listener thread answers it with a 503 itself. That also
+    // stops it accepting more until the 503 is out.
+    if constexpr (std::is_void_v<EnqueueResult>)
+    {
+        HttpAdmission::SetDropped(true);
+        fn();
+        admission_.Release();
+        HttpAdmission::SetDropped(false);
+    }
+    return enqueueResult<EnqueueResult>(false);
+}
+
+void HttpWorkerPool::shutdown()
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        if (shutdown_) return;
+        shutdown_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+void HttpWorkerPool::workerThreadFunc()
+{
+    while (true)
+    {
+        std::function<void()> fn;
+        bool shed = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return shutdown_ || !queue_.empty() || !shedQueue_.empty(); });
+            if (shutdown_ && queue_.empty() && shedQueue_.empty()) break;
+
+            // Take turns between the queues: shed connections are answered
+            // quickly (or are Control requests), but a steady stream of them
+            // mustn't starve the Control requests waiting in queue_
+            shed = queue_.empty() || (takeShed_ && !shedQueue_.empty());
+            takeShed_ = !shed;
+            if (shed)
+            {
+                fn = std::move(shedQueue_.front());
+                shedQueue_.pop_front();
+            }
+            else
+            {
+                fn = std::move(queue_.front());
+                queue_.pop_front();
+            }
+        }
+
+        HttpAdmission::SetShed(shed);
+        fn();
+        admission_.Release();
+        HttpAdmission::SetShed(false);
+    }
+}
@@ -0,0 +1,156 @@
+#include "I2CBackend.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "Log.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+#if PI_HOST
+static const char* DEFAULT_BACKEND = "pi";
+#else
+static const char* DEFAULT_BACKEND = "simulated";
+#endif
+
+LinuxI2CBus::LinuxI2CBus(uint8_t deviceId, const std::string& deviceName)
+{
+  if ((fd_ = open(deviceName.c_str(), O_RDWR)) < 0)
+  {
+    throw std::runtime_error("Failed to open the i2c bus");
+  }
+  if (ioctl(fd_, I2C_SLAVE, deviceId) < 0)
+  {
+    close(fd_);
+    throw std::runtime_error("Failed to acquire bus access and/or talk to device.\n");
+  }
+}
+
+LinuxI2CBus::LinuxI2CBus(OpenFile file) : fd_(file.fd)
+{
+}
+
+LinuxI2CBus::LinuxI2CBus(LinuxI2CBus&& other) noexcept : fd_(other.fd_)
+{
+  other.fd_ = -1;
+}
+
+LinuxI2CBus::~LinuxI2CBus()
+{
+  if (fd_ != -1)
+  {
+    close(fd_);
+  }
+}
+
+bool LinuxI2CBus::Write(const uint8_t* buf, size_t len)
+{
+  // write() returns the number of bytes actually written, if it doesn't match then an error occurred (e.g. no response from the device)
+  return write(fd_, buf, len) == (ssize_t)len;
+}
+
+bool LinuxI2CBus::Read(uint8_t* buf, size_t len)
+{
+  // read() returns the number of bytes actually read, if it doesn't match then an error occurred (e.g. no response from the device)
+  return read(fd_, buf, len) == (ssize_t)len;
+}
+
+SimulatedI2CBus::SimulatedI2CBus(uint8_t deviceId, const std::string& deviceName)
+{
+}
+
+bool SimulatedI2CBus::Write(const uint8_t* buf, size_t len)
+{
+  return true;
+}
+
+bool SimulatedI2CBus::Read(uint8_t* buf, size_t len)
+{
+  memset(buf, 0, len);
+  return true;
+}
+
+ReplayI2CBus::ReplayI2CBus(const std::string& path) : next_(0)
+{
+  std::ifstream in(path);
+  std::string line;
+  bool anyReads = false;
+  while (std::getline(in, line))
+  {
+    if (line.size() < 2 || (line[0] != 'r' && line[0] != 'w') || line[1] != ' ' || line.size() % 2 != 0)
+    {
+      continue;
+    }
+    Transfer transfer;
+    transfer.read = line[0] == 'r';
+    for (size_t i = 2; i + 1 < line.size(); i += 2)
+    {
+      transfer.data.push_back((uint8_t)std::stoul(line.substr(i, 2), nullptr, 16));
+    }
+    anyReads |= transfer.read;
+    transfers_.push_back(std::move(transfer));
+  }
+  if (!anyReads)
+  {
+    throw std::runtime_error("The i2c recording " + path + " holds no reads");
+  }
+}
+
+bool ReplayI2CBus::Write(const uint8_t* buf, size_t len)
+{
+  if (!transfers_[next_].read)
+  {
+    next_ = (next_ + 1) % transfers_.size();
+  }
+  return true;
+}
+
+bool ReplayI2CBus::Read(uint8_t* buf, size_t len)
+{
+  while (!transfers_[next_].read)
+  {
+    next_ = (next_ + 1) % transfers_.size();
+  }
+  const auto& data = transfers_[next_].data;
+  next_ = (next_ + 1) % transfers_.size();
+  if (data.size() != len)
+  {
+    return false;
+  }
+  memcpy(buf, data.data(), len);
+  return true;
+}
+
+RuntimeI2CBus::RuntimeI2CBus(uint8_t deviceId, const std::string& deviceName) : bus_(open(deviceId, deviceName))
+{
+}
+
+RuntimeI2CBus::Variant RuntimeI2CBus::open(uint8_t deviceId, const std::string& deviceName)
+{
+  // The backend cannot change so no need to subscribe
+  std::string backend = config.GetConfigValue("hardwareBackend", std::string(DEFAULT_BACKEND));
+  std::string recording = config.GetConfigValue("i2cRecording", std::string("SilvanusI2C.rec"));
+  if (backend == "pi")
+  {
+    return Variant(std::in_place_type<LinuxI2CBus>, deviceId, deviceName);
+  }
+  if (backend == "record")
+  {
+    LOG_INFO("Recording i2c transfers to {}.", recording);
+    return Variant(std::in_place_type<RecordingI2CBus<LinuxI2CBus>>, LinuxI2CBus(deviceId, deviceName), recording);
+  }
+  if (backend == "replay")
+  {
+    LOG_INFO("Replaying i2c transfers from {}.", recording);
+    return Variant(std::in_place_type<ReplayI2CBus>, recording);
+  }
+  if (backend != "simulated")
+  {
+    LOG_WARNING("Unknown hardwareBackend {}, simulating the i2c bus.", backend);
+  }
+  return Variant(std::in_place_type<SimulatedI2CBus>, deviceId, deviceName);
+}
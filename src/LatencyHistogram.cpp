@@ -0,0 +1,84 @@
+#include "LatencyHistogram.hpp"
+
+LatencyHistogram::LatencyHistogram()
+{
+    Reset();
+}
+
+int LatencyHistogram::bucketIndex(uint64_t micros)
+{
+    if (micros < SubBuckets)
+        return (int)micros;
+    int exponent = 63 - __builtin_clzll(micros);
+    int sub = (int)((micros >> (exponent - SubBucketBits)) & (SubBuckets - 1));
+    return SubBuckets + (exponent - SubBucketBits) * SubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperEdge(int index)
+{
+    if (index < SubBuckets)
+        return (uint64_t)index;
+    int exponent = (index - SubBuckets) / SubBuckets + SubBucketBits;
+    uint64_t sub = (uint64_t)((index - SubBuckets) % SubBuckets);
+    uint64_t width = 1ull << (exponent - SubBucketBits);
+    return ((SubBuckets + sub) << (exponent - SubBucketBits)) + width - 1;
+}
+
+void LatencyHistogram::Record(uint64_t micros)
+{
+    buckets_[bucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(micros, std::memory_order_relaxed);
+    uint64_t prevMax = max_.load(std::memory_order_relaxed);
+    while (micros > prevMax && !max_.compare_exchange_weak(prevMax, micros, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::Reset()
+{
+    for (auto& bucket : buckets_)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Count() const
+{
+    return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Max() const
+{
+    return max_.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Mean() const
+{
+    uint64_t count = Count();
+    return count == 0 ? 0.0 : (double)sum_.load(std::memory_order_relaxed) / count;
+}
+
+uint64_t LatencyHistogram::Percentile(double p) const
+{
+    uint64_t count = Count();
+    if (count == 0)
+        return 0;
+    uint64_t target = (uint64_t)(p * count);
+    if (target >= count) target = count - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BucketCount; i++)
+    {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen > target)
+        {
+            uint64_t edge = bucketUpperEdge(i);
+            return edge < Max() ? edge : Max();
+        }
+    }
+    return Max();
+}
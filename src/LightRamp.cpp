@@ -0,0 +1,234 @@
+#include "LightRamp.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "Log.hpp"
+#include "Silvanus.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using json = nlohmann::json;
+
+// Finest duty resolution asked of the PWM clock
+static const uint32_t MAX_RANGE = 4096;
+// Fastest ramp update, finer steps than this aren't visible
+static const std::chrono::milliseconds MIN_STEP(20);
+
+LightRamp::LightRamp(PwmDimmer& dimmer, const std::vector<OutputChannel>& channels) : pwm_(dimmer)
+{
+    dimmerCount_ = 0;
+    dimmedMask_ = 0;
+    exit_ = false;
+    sunrise_ = std::chrono::seconds(1800);
+    sunset_ = std::chrono::seconds(1800);
+    curve_ = Curve::Perceptual;
+
+    // The dimmer table and frequency cannot change so no need to subscribe
+    json table = config.GetConfigValue("dimmers", json::array());
+    uint32_t frequency = config.GetConfigValue("dimmingFrequency", 1000);
+    if (table.is_array())
+    {
+        for (const auto& entry : table)
+        {
+            std::string name = entry.value("channel", std::string());
+            unsigned gpio = entry.value("gpio", 0u);
+            auto it = std::find_if(channels.begin(), channels.end(), [&](const OutputChannel& c) { return c.name == name; });
+            if (it == channels.end())
+            {
+                LOG_ERROR("Skipping dimmer {}, it needs the name of an output channel.", entry.dump());
+                continue;
+            }
+            if (dimmerCount_ == 0 && pwm_.Start(frequency, MAX_RANGE) == 0)
+            {
+                LOG_ERROR("Could not start the PWM clock at {} Hz, dimming is disabled.", frequency);
+                break;
+            }
+            int pwmChannel = pwm_.Attach(gpio);
+            if (pwmChannel < 0)
+            {
+                LOG_ERROR("Skipping dimmer for {}, GPIO {} is not a free PWM pin (12, 13, 18 or 19).", name, gpio);
+                continue;
+            }
+
+            Dimmer& dimmer = dimmers_[dimmerCount_++];
+            dimmer.channel = (int)(it - channels.begin());
+            dimmer.pwmChannel = pwmChannel;
+            dimmer.start = Clock::time_point::min();
+            dimmer.end = Clock::time_point::min();
+            dimmer.baseLevel = 1.0f;
+            dimmer.level = 1.0f;
+            dimmedMask_ |= 1u << dimmer.channel;
+            pwm_.SetDuty(pwmChannel, 1.0f);
+            if (dimmerCount_ == dimmers_.size()) break;
+        }
+    }
+
+    // Subscribe to settings changes (this also runs the lambda once before subscribing)
+    config.Subscribe([this](const ConfigUpdateEventArg& arg)
+    {
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            int sunrise = (int)std::chrono::duration_cast<std::chrono::seconds>(sunrise_).count();
+            int sunset = (int)std::chrono::duration_cast<std::chrono::seconds>(sunset_).count();
+            std::string curve = "perceptual";
+            if (arg.UpdateIfChanged("sunriseDuration", sunrise, 1800)) sunrise_ = std::chrono::seconds(std::max(0, sunrise));
+            if (arg.UpdateIfChanged("sunsetDuration", sunset, 1800)) sunset_ = std::chrono::seconds(std::max(0, sunset));
+            if (arg.UpdateIfChanged("rampCurve", curve, std::string("perceptual")) && !ParseCurve(curve, curve_))
+            {
+                LOG_ERROR("Unknown rampCurve {}, expected linear, smooth or perceptual.", curve);
+            }
+        }
+        cv_.notify_one();
+    });
+
+    if (dimmerCount_ > 0)
+    {
+        thread_ = std::make_unique<std::thread>(&LightRamp::threadFunc, this);
+    }
+}
+
+LightRamp::~LightRamp()
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        exit_ = true;
+    }
+    cv_.notify_one();
+    if (thread_ != nullptr)
+    {
+        thread_->join();
+    }
+}
+
+bool LightRamp::ParseCurve(const std::string& name, Curve& curve)
+{
+    if (name == "linear") curve = Curve::Linear;
+    else if (name == "smooth") curve = Curve::Smooth;
+    else if (name == "perceptual") curve = Curve::Perceptual;
+    else return false;
+    return true;
+}
+
+float LightRamp::Shape(Curve curve, float t)
+{
+    t = std::clamp(t, 0.0f, 1.0f);
+    switch (curve)
+    {
+        case Curve::Linear: return t;
+        case Curve::Smooth: return t * t * (3.0f - 2.0f * t);
+        case Curve::Perceptual: return std::pow(t, 2.2f);
+    }
+    return t;
+}
+
+uint32_t LightRamp::DimmedMask() const
+{
+    return dimmedMask_;
+}
+
+LightRamp::Dimmer* LightRamp::find(int channel)
+{
+    for (size_t i = 0; i < dimmerCount_; i++)
+    {
+        if (dimmers_[i].channel == channel) return &dimmers_[i];
+    }
+    return nullptr;
+}
+
+void LightRamp::StartWindow(uint32_t mask, Clock::time_point start, Clock::time_point end)
+{
+    if ((mask & dimmedMask_) == 0) return;
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < dimmerCount_; i++)
+        {
+            if ((mask & (1u << dimmers_[i].channel)) != 0)
+            {
+                dimmers_[i].start = start;
+                dimmers_[i].end = end;
+            }
+        }
+    }
+    cv_.notify_one();
+}
+
+void LightRamp::EndWindow(uint32_t mask)
+{
+    StartWindow(mask, Clock::time_point::min(), Clock::time_point::min());
+}
+
+bool LightRamp::SetBaseLevel(int channel, float level)
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        Dimmer* dimmer = find(channel);
+        if (dimmer == nullptr) return false;
+        dimmer->baseLevel = std::clamp(level, 0.0f, 1.0f);
+    }
+    cv_.notify_one();
+    return true;
+}
+
+float LightRamp::Level(int channel) const
+{
+    for (size_t i = 0; i < dimmerCount_; i++)
+    {
+        if (dimmers_[i].channel == channel) return dimmers_[i].level.load(std::memory_order_relaxed);
+    }
+    return -1.0f;
+}
+
+float LightRamp::levelAt(const Dimmer& dimmer, Clock::time_point now) const
+{
+    if (now < dimmer.start || now >= dimmer.end) return dimmer.baseLevel;
+
+    // Rising and falling edges multiply, so windows shorter than both ramps still work
+    float rise = sunrise_.count() > 0 ? std::chrono::duration<float>(now - dimmer.start) / sunrise_ : 1.0f;
+    float fall = sunset_.count() > 0 ? std::chrono::duration<float>(dimmer.end - now) / sunset_ : 1.0f;
+    return dimmer.baseLevel * Shape(curve_, rise) * Shape(curve_, fall);
+}
+
+LightRamp::Clock::time_point LightRamp::nextUpdate(const Dimmer& dimmer, Clock::time_point now) const
+{
+    if (now >= dimmer.end) return Clock::time_point::max();
+    if (now < dimmer.start) return dimmer.start;
+
+    auto riseEnd = dimmer.start + sunrise_;
+    auto fallStart = dimmer.end - sunset_;
+    if (now >= riseEnd && now < fallStart) return fallStart;
+
+    // Step about once per duty count, but no faster than MIN_STEP
+    auto ramp = now < riseEnd ? sunrise_ : sunset_;
+    auto step = std::max<Clock::duration>(MIN_STEP, ramp / std::max<uint32_t>(1, pwm_.Range()));
+    return std::min(now + step, dimmer.end);
+}
+
+void LightRamp::threadFunc()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!exit_)
+    {
+        auto now = Clock::now();
+        auto wake = Clock::time_point::max();
+        for (size_t i = 0; i < dimmerCount_; i++)
+        {
+            Dimmer& dimmer = dimmers_[i];
+            float level = levelAt(dimmer, now);
+            if (level != dimmer.level.load(std::memory_order_relaxed))
+            {
+                pwm_.SetDuty(dimmer.pwmChannel, level);
+                dimmer.level.store(level, std::memory_order_relaxed);
+            }
+            wake = std::min(wake, nextUpdate(dimmer, now));
+        }
+
+        if (wake == Clock::time_point::max())
+        {
+            cv_.wait(lock);
+        }
+        else
+        {
+            cv_.wait_until(lock, wake);
+        }
+    }
+}
@@ -0,0 +1,256 @@
+#include "Log.hpp"
+#include "ThreadTuning.hpp"
+
+#include <unistd.h>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+
+std::atomic<int> Log::minLevel_{0};
+
+namespace
+{
+    // Bounded MPSC ring (Vyukov style). Each slot's sequence says whose turn it is:
+    // == position: free for the producer claiming that position
+    // == position + 1: holds a finished message for the writer
+    class Writer
+    {
+    public:
+        Writer()
+        {
+            for (size_t i = 0; i < Log::SlotCount; i++)
+            {
+                slots_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            enqueuePos_ = 0;
+            dequeuePos_ = 0;
+            dropped_ = 0;
+            reportedDropped_ = 0;
+            exit_ = false;
+            // Under systemd, stdout is the journal and understands <N> priority prefixes
+            journal_ = getenv("JOURNAL_STREAM") != nullptr;
+            batch_.reserve(Log::SlotCount * (Log::MaxMessageLength + 16));
+            thread_ = std::thread(&Writer::threadFunc, this);
+        }
+
+        ~Writer()
+        {
+            {
+                const std::lock_guard<std::mutex> lock(mutex_);
+                exit_ = true;
+            }
+            cv_.notify_one();
+            thread_.join();
+        }
+
+        Log::Slot* Claim()
+        {
+            uint64_t pos = enqueuePos_.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Log::Slot* slot = &slots_[pos % Log::SlotCount];
+                uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+                int64_t diff = (int64_t)seq - (int64_t)pos;
+                if (diff == 0)
+                {
+                    if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        slot->position = pos;
+                        return slot;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    // The writer hasn't caught up, drop rather than wait
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                else
+                {
+                    pos = enqueuePos_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void Commit(Log::Slot* slot)
+        {
+            slot->sequence.store(slot->position + 1, std::memory_order_release);
+        }
+
+        void Flush()
+        {
+            uint64_t target = enqueuePos_.load(std::memory_order_acquire);
+            while (dequeuePos_.load(std::memory_order_acquire) < target)
+            {
+                cv_.notify_one();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        bool AvoidCpu(int cpu)
+        {
+            return ThreadTuning::AvoidCpu(thread_, cpu);
+        }
+
+        uint64_t Dropped() const
+        {
+            return dropped_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        const char* prefix(LogLevel level) const
+        {
+            if (journal_)
+            {
+                switch (level)
+                {
+                    case LogLevel::Debug: return "<7>";
+                    case LogLevel::Info: return "<6>";
+                    case LogLevel::Warning: return "<4>";
+                    case LogLevel::Error: return "<3>";
+                }
+            }
+            switch (level)
+            {
+                case LogLevel::Debug: return "[debug] ";
+                case LogLevel::Warning: return "[warning] ";
+                case LogLevel::Error: return "[error] ";
+                default: return "";
+            }
+        }
+
+        // Move every finished message into the batch, returns false if there were none
+        bool drain()
+        {
+            uint64_t pos = dequeuePos_.load(std::memory_order_relaxed);
+            uint64_t start = pos;
+            while (true)
+            {
+                Log::Slot* slot = &slots_[pos % Log::SlotCount];
+                if (slot->sequence.load(std::memory_order_acquire) != pos + 1)
+                    break;
+                batch_ += prefix(slot->level);
+                batch_.append(slot->text, slot->length);
+                batch_ += '\n';
+                slot->sequence.store(pos + Log::SlotCount, std::memory_order_release);
+                pos++;
+            }
+
+            uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+            if (dropped != reportedDropped_)
+            {
+                batch_ += prefix(LogLevel::Warning);
+                batch_ += fmt::format("{} log messages dropped, the log ring was full.\n", dropped - reportedDropped_);
+                reportedDropped_ = dropped;
+            }
+
+            if (!batch_.empty())
+            {
+                const char* data = batch_.data();
+                size_t remaining = batch_.size();
+                while (remaining > 0)
+                {
+                    ssize_t written = write(STDOUT_FILENO, data, remaining);
+                    if (written <= 0) break;
+                    data += written;
+                    remaining -= written;
+                }
+                batch_.clear();
+            }
+            dequeuePos_.store(pos, std::memory_order_release);
+            return pos != start;
+        }
+
+        void threadFunc()
+        {
+            while (true)
+            {
+                bool drained = drain();
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (exit_) break;
+                if (!drained)
+                {
+                    // Producers never signal (that would cost them a syscall), so poll
+                    cv_.wait_for(lock, std::chrono::milliseconds(10));
+                }
+            }
+            drain();
+        }
+
+        Log::Slot slots_[Log::SlotCount];
+        std::atomic<uint64_t> enqueuePos_;
+        std::atomic<uint64_t> dequeuePos_;
+        std::atomic<uint64_t> dropped_;
+        uint64_t reportedDropped_;
+        bool journal_;
+        std::string batch_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        bool exit_;
+        std::thread thread_;
+    };
+
+    Writer& writer()
+    {
+        static Writer instance;
+        return instance;
+    }
+}
+
+Log::Slot* Log::claimSlot()
+{
+    return writer().Claim();
+}
+
+void Log::commitSlot(Slot* slot)
+{
+    writer().Commit(slot);
+}
+
+void Log::SetLevel(LogLevel level)
+{
+    minLevel_.store((int)level, std::memory_order_relaxed);
+}
+
+bool Log::ParseLevel(const std::string& name, LogLevel& level)
+{
+    if (name == "debug") level = LogLevel::Debug;
+    else if (name == "info") level = LogLevel::Info;
+    else if (name == "warning") level = LogLevel::Warning;
+    else if (name == "error") level = LogLevel::Error;
+    else return false;
+    return true;
+}
+
+void Log::Flush()
+{
+    writer().Flush();
+}
+
+uint64_t Log::DroppedCount()
+{
+    return writer().Dropped();
+}
+
+bool Log::AvoidCpu(int cpu)
+{
+    return writer().AvoidCpu(cpu);
+}
+
+LogRateLimit::LogRateLimit(std::chrono::milliseconds interval)
+{
+    intervalNs_ = std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+    nextAllowedNs_ = 0;
+}
+
+bool LogRateLimit::Allow()
+{
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t next = nextAllowedNs_.load(std::memory_order_relaxed);
+    if (now < next)
+        return false;
+    return nextAllowedNs_.compare_exchange_strong(next, now + intervalNs_, std::memory_order_relaxed);
+}
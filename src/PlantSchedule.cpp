@@ -0,0 +1,276 @@
+#include "PlantSchedule.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "Log.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <unordered_map>
+
+using json = nlohmann::json;
+
+static const char* WEEKDAY_NAMES[] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
+PlantSchedule::PlantSchedule(Silvanus& silvanus) : silvanus_(silvanus)
+{
+    lightTime_ = 25200;
+    lightInterval_ = 43200;
+    waterTime_ = 25200;
+    waterFlowRate_ = 1.3f;
+    waterAmountPerDay_ = 100.0f;
+    zones_ = json::object();
+
+    // Subscribe to settings changes (this also runs the lambda once before subscribing)
+    config.Subscribe([this](const ConfigUpdateEventArg& arg)
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        bool changed = false;
+        changed |= arg.UpdateIfChanged("waterTime", waterTime_, 25200);
+        changed |= arg.UpdateIfChanged("waterFlowRate", waterFlowRate_, 1.3f);
+        changed |= arg.UpdateIfChanged("waterAmountPerDay", waterAmountPerDay_, 100.0f);
+        changed |= arg.UpdateIfChanged("lightTime", lightTime_, 25200); // default 7 AM
+        changed |= arg.UpdateIfChanged("lightInterval", lightInterval_, 43200); // default 12 hours
+        changed |= arg.UpdateIfChanged("zones", zones_, json::object());
+        if (changed)
+        {
+            rebuild();
+        }
+    });
+}
+
+std::vector<ScheduleEvent> PlantSchedule::ParseZones(const json& zones, const Silvanus& silvanus)
+{
+    std::vector<ScheduleEvent> events;
+    if (!zones.is_object())
+    {
+        LOG_ERROR("The zones setting must be an object of zone names to event lists.");
+        return events;
+    }
+
+    for (auto& zone : zones.items())
+    {
+        if (!zone.value().is_array())
+        {
+            LOG_ERROR("Skipping zone {}, it must be a list of events.", zone.key());
+            continue;
+        }
+        for (size_t index = 0; index < zone.value().size(); index++)
+        {
+            const json& entry = zone.value()[index];
+            ScheduleEvent event;
+            event.zone = zone.key();
+            event.key = ScheduleEngine::EventKey(zone.key(), index);
+            event.channelMask = 0;
+            event.weekdays = ScheduleEngine::EveryDay;
+            try
+            {
+                for (const auto& name : entry.at("channels"))
+                {
+                    int channel = silvanus.FindChannel(name.get<std::string>());
+                    if (channel < 0) throw std::runtime_error(name.get<std::string>() + " is not a channel");
+                    event.channelMask |= 1u << channel;
+                }
+                event.timeOfDay = entry.at("time").get<int>();
+                event.duration = std::chrono::milliseconds((int64_t)(entry.at("duration").get<double>() * 1000));
+                event.resume = entry.value("resume", false);
+                event.catchUp = entry.value("catchUp", false);
+                if (entry.contains("days"))
+                {
+                    event.weekdays = 0;
+                    for (const auto& day : entry.at("days"))
+                    {
+                        int weekday = 0;
+                        while (weekday < 7 && day.get<std::string>() != WEEKDAY_NAMES[weekday]) weekday++;
+                        if (weekday == 7) throw std::runtime_error(day.get<std::string>() + " is not a day");
+                        event.weekdays |= 1 << weekday;
+                    }
+                }
+                if (event.timeOfDay < 0 || event.timeOfDay >= 86400) throw std::runtime_error("time must be within the day");
+                if (event.duration.count() <= 0) throw std::runtime_error("duration must be positive");
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("Skipping event {} in zone {}: {}.", entry.dump(), zone.key(), e.what());
+                continue;
+            }
+            events.push_back(event);
+        }
+    }
+    return events;
+}
+
+void PlantSchedule::rebuild()
+{
+    std::vector<ScheduleEvent> events;
+
+    // The original single light and watering time
+    int lightChannel = silvanus_.FindChannelByRole("light");
+    if (lightChannel >= 0)
+    {
+        events.push_back({"default", 1u << lightChannel, lightTime_,
+                          std::chrono::seconds(lightInterval_), ScheduleEngine::EveryDay, true, false,
+                          ScheduleEngine::EventKey("default", 0)});
+    }
+    int pumpChannel = silvanus_.FindChannelByRole("pump");
+    if (pumpChannel >= 0)
+    {
+        events.push_back({"default", 1u << pumpChannel, waterTime_,
+                          std::chrono::seconds((int)(waterAmountPerDay_ * waterFlowRate_)), ScheduleEngine::EveryDay, false, true,
+                          ScheduleEngine::EventKey("default", 1)});
+    }
+
+    auto zoneEvents = ParseZones(zones_, silvanus_);
+    events.insert(events.end(), zoneEvents.begin(), zoneEvents.end());
+    engine_.SetEvents(std::move(events), ScheduleEngine::Clock::now());
+}
+
+void PlantSchedule::Prime()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+
+    auto thisEval = ScheduleEngine::Clock::now();
+    uint32_t onMask = 0;
+    uint32_t offMask = 0;
+    for (const auto& event : engine_.Events())
+    {
+        if (!event.resume) continue;
+        auto until = ScheduleEngine::OngoingUntil(event, thisEval);
+        if (until > thisEval)
+        {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(until - thisEval);
+            silvanus_.PulseChannels(event.channelMask, remaining, event.duration - remaining);
+            onMask |= event.channelMask;
+            LOG_DEBUG("Event in zone {} was ongoing at startup.", event.zone);
+        }
+        else
+        {
+            offMask |= event.channelMask;
+        }
+    }
+
+    // Channels with no ongoing window stay off
+    silvanus_.SetChannels(0, offMask & ~onMask);
+}
+
+void PlantSchedule::CatchUp()
+{
+    // These only matter at startup so no need to subscribe. Read before
+    // locking, storing a default notifies subscribers and our own one locks.
+    auto window = std::chrono::seconds(config.GetConfigValue("catchUpWindow", 86400));
+    int crashLoopStartups = config.GetConfigValue("crashLoopStartups", 3);
+    auto crashLoopWindow = std::chrono::seconds(config.GetConfigValue("crashLoopWindow", 600));
+
+    const std::lock_guard<std::mutex> lock(mutex_);
+    EventJournal& journal = silvanus_.Journal();
+    if (!journal.Enabled()) return;
+
+    struct Missed
+    {
+        const ScheduleEvent* event;
+        ScheduleEngine::Clock::time_point at;
+        bool fired;
+    };
+    auto now = ScheduleEngine::Clock::now();
+    auto oldest = now - crashLoopWindow;
+    std::unordered_map<uint32_t, Missed> missed;
+    for (const auto& event : engine_.Events())
+    {
+        if (!event.catchUp) continue;
+        auto at = ScheduleEngine::PreviousOccurrence(event, now);
+        if (at == ScheduleEngine::Clock::time_point::min() || now - at > window) continue;
+        missed[event.key] = Missed{&event, at, false};
+        oldest = std::min(oldest, at);
+    }
+    if (missed.empty()) return;
+
+    // Walk back to the oldest occurrence we care about. Nothing older than it
+    // in the journal means we weren't running before it (e.g. a fresh
+    // install), so there is nothing to say it was missed.
+    int startups = 0;
+    bool history = false;
+    auto crashLoopSince = now - crashLoopWindow;
+    journal.ScanBackward([&](const EventJournal::Record& record)
+    {
+        ScheduleEngine::Clock::time_point at{std::chrono::duration_cast<ScheduleEngine::Clock::duration>(std::chrono::nanoseconds(record.timeNs))};
+        if (at < oldest)
+        {
+            history = true;
+            return false;
+        }
+        if (record.type == (uint32_t)EventJournal::Type::Startup && at >= crashLoopSince)
+        {
+            startups++;
+        }
+        else if (record.type == (uint32_t)EventJournal::Type::EventFired || record.type == (uint32_t)EventJournal::Type::CatchUp)
+        {
+            // Anything on the same channels since the occurrence counts too, in
+            // case the event's key changed (e.g. its zone was reordered)
+            for (auto& [key, entry] : missed)
+            {
+                if (at >= entry.at && (key == record.key || record.channels == entry.event->channelMask)) entry.fired = true;
+            }
+        }
+        return true;
+    });
+
+    // Restarting over and over and watering each time could flood the plants
+    if (startups > crashLoopStartups)
+    {
+        LOG_WARNING("Started {} times in the last {} s, skipping catch-up.", startups, crashLoopWindow.count());
+        return;
+    }
+    if (!history) return;
+
+    for (const auto& [key, entry] : missed)
+    {
+        if (entry.fired) continue;
+        const ScheduleEvent& event = *entry.event;
+        LOG_INFO("Catching up on the event in zone {} missed {} min ago.", event.zone,
+                 std::chrono::duration_cast<std::chrono::minutes>(now - entry.at).count());
+        // On disk before the channels go on, so a crash now can't make us run it twice
+        journal.Append(EventJournal::Type::CatchUp, event.channelMask, event.key, (uint32_t)event.duration.count());
+        journal.Sync();
+        silvanus_.PulseChannels(event.channelMask, event.duration);
+    }
+}
+
+void PlantSchedule::Evaluate()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+
+    engine_.FireDue(ScheduleEngine::Clock::now(), [this](const ScheduleEvent& event)
+    {
+        LOG_DEBUG("Starting event in zone {} on channels {:#x}.", event.zone, event.channelMask);
+        silvanus_.Journal().Append(EventJournal::Type::EventFired, event.channelMask, event.key, (uint32_t)event.duration.count());
+        silvanus_.PulseChannels(event.channelMask, event.duration);
+    });
+}
+
+void PlantSchedule::WaterNow()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    silvanus_.PulsePump(std::chrono::seconds((int)(waterAmountPerDay_ * waterFlowRate_)));
+}
+
+json PlantSchedule::Upcoming(size_t count)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+
+    auto upcoming = json::array();
+    const auto& channels = silvanus_.Channels();
+    for (const auto& [at, event] : engine_.Upcoming(count))
+    {
+        auto names = json::array();
+        for (size_t i = 0; i < channels.size(); i++)
+        {
+            if ((event->channelMask & (1u << i)) != 0) names.push_back(channels[i].name);
+        }
+        upcoming.push_back({
+            {"zone", event->zone},
+            {"channels", names},
+            {"at", ScheduleEngine::Clock::to_time_t(at)},
+            {"duration", event->duration.count() / 1000.0}
+        });
+    }
+    return upcoming;
+}
@@ -0,0 +1,104 @@
+#include "PwmDimmer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unistd.h>
+
+// PWM registers (word offsets)
+static const int PWM_CTL = 0;
+static const int PWM_RNG1 = 4;
+static const int PWM_DAT1 = 5;
+static const int PWM_RNG2 = 8;
+static const int PWM_DAT2 = 9;
+static const uint32_t PWM_PWEN1 = 1 << 0;
+static const uint32_t PWM_MSEN1 = 1 << 7;
+static const uint32_t PWM_PWEN2 = 1 << 8;
+static const uint32_t PWM_MSEN2 = 1 << 15;
+
+// Clock manager PWM clock (word offsets)
+static const int CLK_PWMCTL = 40;
+static const int CLK_PWMDIV = 41;
+static const uint32_t CLK_PASSWD = 0x5A000000;
+static const uint32_t CLK_ENAB = 1 << 4;
+static const uint32_t CLK_BUSY = 1 << 7;
+static const uint32_t CLK_SRC_OSC = 1;
+
+static const unsigned NO_GPIO = ~0u;
+
+PwmDimmer::PwmDimmer(Registers registers, uint32_t oscillatorHz) :
+    regs_(registers), oscillatorHz_(oscillatorHz), range_(0)
+{
+    channelGpio_[0] = NO_GPIO;
+    channelGpio_[1] = NO_GPIO;
+}
+
+bool PwmDimmer::waitClockIdle()
+{
+    for (int i = 0; i < 1000; i++)
+    {
+        if ((regs_.clock[CLK_PWMCTL] & CLK_BUSY) == 0) return true;
+        usleep(10);
+    }
+    return false;
+}
+
+uint32_t PwmDimmer::Start(uint32_t frequencyHz, uint32_t maxRange)
+{
+    if (frequencyHz == 0) return 0;
+
+    // Integer divider only, 2..4095, so high frequencies trade away resolution
+    uint32_t range = std::min<uint64_t>(maxRange, oscillatorHz_ / (2ull * frequencyHz));
+    if (range < 2) return 0;
+    uint32_t divider = std::clamp<uint64_t>(oscillatorHz_ / ((uint64_t)frequencyHz * range), 2, 4095);
+
+    // The clock must be stopped (and no longer busy) before changing its divider
+    uint32_t ctl = regs_.pwm[PWM_CTL];
+    regs_.pwm[PWM_CTL] = 0;
+    regs_.clock[CLK_PWMCTL] = CLK_PASSWD | CLK_SRC_OSC;
+    if (!waitClockIdle()) return 0;
+    regs_.clock[CLK_PWMDIV] = CLK_PASSWD | (divider << 12);
+    regs_.clock[CLK_PWMCTL] = CLK_PASSWD | CLK_SRC_OSC;
+    regs_.clock[CLK_PWMCTL] = CLK_PASSWD | CLK_SRC_OSC | CLK_ENAB;
+
+    range_ = range;
+    regs_.pwm[PWM_RNG1] = range;
+    regs_.pwm[PWM_RNG2] = range;
+    regs_.pwm[PWM_CTL] = ctl;
+    return oscillatorHz_ / (divider * range);
+}
+
+int PwmDimmer::Attach(unsigned gpio)
+{
+    int channel;
+    unsigned altFunction;
+    switch (gpio)
+    {
+        case 12: channel = 0; altFunction = 4; break; // ALT0
+        case 13: channel = 1; altFunction = 4; break; // ALT0
+        case 18: channel = 0; altFunction = 2; break; // ALT5
+        case 19: channel = 1; altFunction = 2; break; // ALT5
+        default: return -1;
+    }
+    if (channelGpio_[channel] != NO_GPIO && channelGpio_[channel] != gpio) return -1;
+    channelGpio_[channel] = gpio;
+
+    regs_.pwm[channel == 0 ? PWM_DAT1 : PWM_DAT2] = 0;
+    regs_.pwm[PWM_CTL] = regs_.pwm[PWM_CTL] | (channel == 0 ? PWM_PWEN1 | PWM_MSEN1 : PWM_PWEN2 | PWM_MSEN2);
+
+    int reg = gpio / 10;
+    int shift = (gpio % 10) * 3;
+    regs_.gpio[reg] = (regs_.gpio[reg] & ~(7u << shift)) | (altFunction << shift);
+    return channel;
+}
+
+void PwmDimmer::SetDuty(int channel, float duty)
+{
+    if (channel < 0 || channel > 1) return;
+    uint32_t value = (uint32_t)std::lround(std::clamp(duty, 0.0f, 1.0f) * range_);
+    regs_.pwm[channel == 0 ? PWM_DAT1 : PWM_DAT2] = value;
+}
+
+uint32_t PwmDimmer::Range() const
+{
+    return range_;
+}
@@ -0,0 +1,576 @@
+#include "RuleEngine.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "Log.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <fmt/format.h>
+
+using json = nlohmann::json;
+
+namespace
+{
+    struct Token
+    {
+        enum class Kind
+        {
+            Word,
+            Number,
+            Duration,
+            Symbol,
+            End
+        };
+        Kind kind = Kind::End;
+        std::string text = {};
+        double number = 0.0;
+        std::chrono::milliseconds duration = std::chrono::milliseconds(0);
+    };
+
+    bool tokenize(const std::string& text, std::vector<Token>& tokens, std::string& error)
+    {
+        size_t i = 0;
+        while (i < text.size())
+        {
+            char c = text[i];
+            char next = i + 1 < text.size() ? text[i + 1] : '\0';
+            if (isspace((unsigned char)c))
+            {
+                i++;
+            }
+            else if (c == '-' && next == '>')
+            {
+                tokens.push_back({Token::Kind::Symbol, "->"});
+                i += 2;
+            }
+            else if (isdigit((unsigned char)c) || ((c == '-' || c == '.') && isdigit((unsigned char)next)))
+            {
+                char* end;
+                double number = strtod(text.c_str() + i, &end);
+                i = end - text.c_str();
+                size_t unitStart = i;
+                while (i < text.size() && isalpha((unsigned char)text[i])) i++;
+                std::string unit = text.substr(unitStart, i - unitStart);
+                if (unit.empty())
+                {
+                    tokens.push_back({Token::Kind::Number, "", number});
+                    continue;
+                }
+                double scale = unit == "ms" ? 1 : unit == "s" ? 1000 : unit == "m" ? 60000 : unit == "h" ? 3600000 : 0;
+                if (scale == 0 || number < 0)
+                {
+                    error = fmt::format("{}{} is not a duration, use ms, s, m or h", number, unit);
+                    return false;
+                }
+                tokens.push_back({Token::Kind::Duration, "", 0, std::chrono::milliseconds((int64_t)(number * scale))});
+            }
+            else if (isalpha((unsigned char)c) || c == '_')
+            {
+                size_t start = i;
+                // Names may have dashes, but not eat the start of an arrow
+                while (i < text.size() && (isalnum((unsigned char)text[i]) || text[i] == '_' || text[i] == '.' ||
+                       (text[i] == '-' && (i + 1 >= text.size() || text[i + 1] != '>'))))
+                {
+                    i++;
+                }
+                tokens.push_back({Token::Kind::Word, text.substr(start, i - start)});
+            }
+            else
+            {
+                std::string symbol(1, c);
+                if ((c == '<' || c == '>' || c == '=' || c == '!') && next == '=') symbol += next;
+                if (symbol != "<" && symbol != ">" && symbol != "<=" && symbol != ">=" && symbol != "==" &&
+                    symbol != "!=" && symbol != "(" && symbol != ")")
+                {
+                    error = fmt::format("unexpected '{}'", symbol);
+                    return false;
+                }
+                tokens.push_back({Token::Kind::Symbol, symbol});
+                i += symbol.size();
+            }
+        }
+        tokens.push_back({Token::Kind::End});
+        return true;
+    }
+
+    // Recursive descent over the tokens, emitting postfix instructions
+    class Parser
+    {
+    public:
+        Parser(const std::vector<Token>& tokens, const std::vector<std::string>& inputs,
+               const Silvanus& silvanus, RuleEngine::Rule& rule, std::string& error) :
+            tokens_(tokens), inputs_(inputs), silvanus_(silvanus), rule_(rule), error_(error), next_(0)
+        {
+        }
+
+        bool Parse()
+        {
+            if (!parseOr()) return false;
+            rule_.hold = std::chrono::milliseconds(0);
+            if (word("for"))
+            {
+                if (peek().kind != Token::Kind::Duration) return fail("\"for\" needs a duration like 10m");
+                rule_.hold = take().duration;
+            }
+            if (!symbol("->")) return fail("expected -> before the action");
+            if (!parseAction()) return false;
+            if (peek().kind != Token::Kind::End) return fail("unexpected text after the action");
+            return true;
+        }
+    private:
+        const Token& peek() const { return tokens_[next_]; }
+        const Token& take() { return tokens_[next_ < tokens_.size() - 1 ? next_++ : next_]; }
+        bool word(const char* text)
+        {
+            if (peek().kind != Token::Kind::Word || peek().text != text) return false;
+            next_++;
+            return true;
+        }
+        bool symbol(const char* text)
+        {
+            if (peek().kind != Token::Kind::Symbol || peek().text != text) return false;
+            next_++;
+            return true;
+        }
+        bool fail(const std::string& message)
+        {
+            error_ = message;
+            return false;
+        }
+        void emit(RuleEngine::Op op, uint16_t slot = 0, float value = 0.0f)
+        {
+            rule_.program.push_back({op, slot, value});
+        }
+
+        bool parseOr()
+        {
+            if (!parseAnd()) return false;
+            while (word("or"))
+            {
+                if (!parseAnd()) return false;
+                emit(RuleEngine::Op::Or);
+            }
+            return true;
+        }
+
+        bool parseAnd()
+        {
+            if (!parseNot()) return false;
+            while (word("and"))
+            {
+                if (!parseNot()) return false;
+                emit(RuleEngine::Op::And);
+            }
+            return true;
+        }
+
+        bool parseNot()
+        {
+            if (word("not"))
+            {
+                if (!parseNot()) return false;
+                emit(RuleEngine::Op::Not);
+                return true;
+            }
+            if (symbol("("))
+            {
+                if (!parseOr()) return false;
+                return symbol(")") || fail("missing )");
+            }
+            return parseComparison();
+        }
+
+        bool parseComparison()
+        {
+            if (!parseOperand()) return false;
+            static const std::pair<const char*, RuleEngine::Op> comparisons[] = {
+                {"<", RuleEngine::Op::Less}, {"<=", RuleEngine::Op::LessEqual},
+                {">", RuleEngine::Op::Greater}, {">=", RuleEngine::Op::GreaterEqual},
+                {"==", RuleEngine::Op::Equal}, {"!=", RuleEngine::Op::NotEqual}
+            };
+            for (const auto& [text, op] : comparisons)
+            {
+                if (symbol(text))
+                {
+                    if (!parseOperand()) return false;
+                    emit(op);
+                    return true;
+                }
+            }
+            return fail("expected a comparison like humidity < 40");
+        }
+
+        bool parseOperand()
+        {
+            const Token& token = take();
+            if (token.kind == Token::Kind::Number)
+            {
+                emit(RuleEngine::Op::Constant, 0, (float)token.number);
+                return true;
+            }
+            if (token.kind == Token::Kind::Word)
+            {
+                for (size_t slot = 0; slot < inputs_.size(); slot++)
+                {
+                    if (inputs_[slot] == token.text)
+                    {
+                        emit(RuleEngine::Op::Input, (uint16_t)slot);
+                        return true;
+                    }
+                }
+                return fail(fmt::format("{} is not an input", token.text));
+            }
+            return fail("expected an input name or a number");
+        }
+
+        bool parseAction()
+        {
+            RuleEngine::Action& action = rule_.action;
+            action.channelMask = 0;
+            action.duration = std::chrono::milliseconds(0);
+            if (word("relay") || word("channel"))
+            {
+                const Token& name = take();
+                int channel = name.kind == Token::Kind::Word ? silvanus_.FindChannel(name.text) : -1;
+                if (channel < 0) return fail(fmt::format("{} is not a channel", name.text));
+                action.channelMask = 1u << channel;
+                if (word("off"))
+                {
+                    action.type = RuleEngine::Action::Type::ChannelOff;
+                    return true;
+                }
+                if (!word("on")) return fail("expected on or off after the channel");
+                action.type = RuleEngine::Action::Type::ChannelOn;
+            }
+            else if (word("scene"))
+            {
+                const Token& name = take();
+                if (name.kind != Token::Kind::Word) return fail("expected a scene name");
+                action.type = RuleEngine::Action::Type::Scene;
+                action.scene = name.text;
+            }
+            else
+            {
+                return fail("the action must be relay, channel or scene");
+            }
+            if (peek().kind == Token::Kind::Duration)
+            {
+                action.duration = take().duration;
+            }
+            return true;
+        }
+
+        const std::vector<Token>& tokens_;
+        const std::vector<std::string>& inputs_;
+        const Silvanus& silvanus_;
+        RuleEngine::Rule& rule_;
+        std::string& error_;
+        size_t next_;
+    };
+
+    bool run(const std::vector<RuleEngine::Instruction>& program, const float* values)
+    {
+        float stack[RuleEngine::MaxStack];
+        size_t top = 0;
+        for (const auto& instruction : program)
+        {
+            switch (instruction.op)
+            {
+                case RuleEngine::Op::Input: stack[top++] = values[instruction.slot]; break;
+                case RuleEngine::Op::Constant: stack[top++] = instruction.value; break;
+                case RuleEngine::Op::Less: top--; stack[top - 1] = stack[top - 1] < stack[top]; break;
+                case RuleEngine::Op::LessEqual: top--; stack[top - 1] = stack[top - 1] <= stack[top]; break;
+                case RuleEngine::Op::Greater: top--; stack[top - 1] = stack[top - 1] > stack[top]; break;
+                case RuleEngine::Op::GreaterEqual: top--; stack[top - 1] = stack[top - 1] >= stack[top]; break;
+                case RuleEngine::Op::Equal: top--; stack[top - 1] = stack[top - 1] == stack[top]; break;
+                case RuleEngine::Op::NotEqual: top--; stack[top - 1] = stack[top - 1] != stack[top]; break;
+                case RuleEngine::Op::And: top--; stack[top - 1] = stack[top - 1] != 0 && stack[top] != 0; break;
+                case RuleEngine::Op::Or: top--; stack[top - 1] = stack[top - 1] != 0 || stack[top] != 0; break;
+                case RuleEngine::Op::Not: stack[top - 1] = stack[top - 1] == 0; break;
+            }
+        }
+        return stack[0] != 0;
+    }
+}
+
+RuleEngine::RuleEngine(Silvanus& silvanus, SceneTable& scenes) :
+    silvanus_(silvanus), scenes_(scenes), inputNames_(InputNames(silvanus)), exit_(false)
+{
+    // Subscribe to settings changes (this also runs the lambda once before subscribing)
+    config.Subscribe([this](const ConfigUpdateEventArg& arg)
+    {
+        json rules;
+        if (arg.UpdateIfChanged("rules", rules, json::array()))
+        {
+            load(rules);
+        }
+    });
+    timerThread_ = std::make_unique<std::thread>(&RuleEngine::timerFunc, this);
+}
+
+RuleEngine::~RuleEngine()
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        exit_ = true;
+    }
+    timerCv_.notify_all();
+    timerThread_->join();
+}
+
+std::vector<std::string> RuleEngine::InputNames(const Silvanus& silvanus)
+{
+    std::vector<std::string> names = {"temperature", "humidity"};
+    for (size_t i = 0; i < silvanus.Inputs().Count(); i++)
+    {
+        names.push_back(silvanus.Inputs().Get(i).name);
+    }
+    return names;
+}
+
+bool RuleEngine::Compile(const std::string& text, const std::vector<std::string>& inputs,
+                         const Silvanus& silvanus, Rule& rule, std::string& error)
+{
+    std::vector<Token> tokens;
+    rule = Rule();
+    rule.text = text;
+    if (!tokenize(text, tokens, error) || !Parser(tokens, inputs, silvanus, rule, error).Parse())
+    {
+        return false;
+    }
+
+    // The depth is known now, so evaluation never has to check it
+    size_t depth = 0;
+    size_t maxDepth = 0;
+    for (const auto& instruction : rule.program)
+    {
+        if (instruction.op == Op::Input || instruction.op == Op::Constant) depth++;
+        else if (instruction.op != Op::Not) depth--;
+        maxDepth = std::max(maxDepth, depth);
+        if (instruction.op == Op::Input &&
+            std::find(rule.slots.begin(), rule.slots.end(), instruction.slot) == rule.slots.end())
+        {
+            rule.slots.push_back(instruction.slot);
+        }
+    }
+    if (maxDepth > MaxStack)
+    {
+        error = "the condition is nested too deeply";
+        return false;
+    }
+    if (rule.slots.empty())
+    {
+        error = "the condition doesn't read any input";
+        return false;
+    }
+    return true;
+}
+
+void RuleEngine::load(const json& rules)
+{
+    std::vector<Rule> compiled;
+    if (rules.is_array())
+    {
+        for (const auto& text : rules)
+        {
+            Rule rule;
+            std::string error;
+            if (!text.is_string())
+            {
+                LOG_ERROR("Skipping rule {}: rules must be strings.", text.dump());
+            }
+            else if (Compile(text.get<std::string>(), inputNames_, silvanus_, rule, error))
+            {
+                compiled.push_back(std::move(rule));
+            }
+            else
+            {
+                LOG_ERROR("Skipping rule \"{}\": {}.", text.get<std::string>(), error);
+            }
+        }
+    }
+    else
+    {
+        LOG_ERROR("The rules setting must be an array of rules.");
+    }
+
+    // Start over: every rule is inactive until the next sample evaluates it
+    const std::lock_guard<std::mutex> lock(mutex_);
+    rules_ = std::move(compiled);
+    values_.assign(inputNames_.size(), std::numeric_limits<float>::quiet_NaN());
+    dependents_.assign(inputNames_.size(), {});
+    queued_.assign(rules_.size(), 0);
+    for (size_t i = 0; i < rules_.size(); i++)
+    {
+        for (uint16_t slot : rules_[i].slots)
+        {
+            dependents_[slot].push_back((uint16_t)i);
+        }
+    }
+    deadlines_.clear();
+}
+
+void RuleEngine::fire(Rule& rule)
+{
+    rule.fired++;
+    actions_.push_back(rule.action);
+    LOG_INFO("Rule fired: {}", rule.text);
+}
+
+void RuleEngine::evaluate(size_t index, std::chrono::steady_clock::time_point now)
+{
+    Rule& rule = rules_[index];
+    bool active = run(rule.program, values_.data());
+    if (active == rule.active)
+    {
+        return;
+    }
+    rule.active = active;
+
+    if (!active)
+    {
+        if (rule.pending)
+        {
+            deadlines_.erase({rule.deadline, index});
+            rule.pending = false;
+        }
+    }
+    else if (rule.hold.count() == 0)
+    {
+        fire(rule);
+    }
+    else
+    {
+        rule.pending = true;
+        rule.deadline = now + rule.hold;
+        deadlines_.emplace(rule.deadline, index);
+        timerCv_.notify_one();
+    }
+}
+
+void RuleEngine::OnSample(float temperature, float humidity)
+{
+    // Read the inputs before taking the lock
+    std::vector<float> values = {temperature, humidity};
+    const GpioInputs& inputs = silvanus_.Inputs();
+    for (size_t i = 0; i < inputs.Count(); i++)
+    {
+        const auto& input = inputs.Get(i);
+        values.push_back(input.type == GpioInputs::Type::Switch ?
+                         (input.active.load(std::memory_order_relaxed) ? 1.0f : 0.0f) :
+                         (float)(inputs.PulseRate(i) * 60.0 / input.pulsesPerLiter));
+    }
+
+    std::vector<Action> actions;
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+
+        // Only the rules reading a changed input run, and each at most once
+        for (size_t slot = 0; slot < values.size(); slot++)
+        {
+            if (values[slot] == values_[slot] || (std::isnan(values[slot]) && std::isnan(values_[slot])))
+            {
+                continue;
+            }
+            values_[slot] = values[slot];
+            for (uint16_t rule : dependents_[slot])
+            {
+                queued_[rule] = 1;
+            }
+        }
+        for (size_t rule = 0; rule < rules_.size(); rule++)
+        {
+            if (!queued_[rule]) continue;
+            queued_[rule] = 0;
+            evaluate(rule, now);
+        }
+        actions.swap(actions_);
+    }
+    runActions(actions);
+}
+
+void RuleEngine::runActions(std::vector<Action>& actions)
+{
+    for (const auto& action : actions)
+    {
+        switch (action.type)
+        {
+            case Action::Type::ChannelOn:
+                if (action.duration.count() > 0) silvanus_.PulseChannels(action.channelMask, action.duration);
+                else silvanus_.SetChannels(action.channelMask, 0);
+                break;
+            case Action::Type::ChannelOff:
+                silvanus_.SetChannels(0, action.channelMask);
+                break;
+            case Action::Type::Scene:
+                switch (scenes_.Apply(action.scene, action.duration))
+                {
+                    case SceneTable::ApplyResult::Applied:
+                        break;
+                    case SceneTable::ApplyResult::UnknownScene:
+                        LOG_ERROR("A rule asked for scene {}, which doesn't exist.", action.scene);
+                        break;
+                    case SceneTable::ApplyResult::BadDuration:
+                        LOG_ERROR("A rule asked for scene {} with a duration that is too long or ends before its last step.", action.scene);
+                        break;
+                }
+                break;
+        }
+    }
+    actions.clear();
+}
+
+void RuleEngine::timerFunc()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!exit_)
+    {
+        if (deadlines_.empty())
+        {
+            timerCv_.wait(lock);
+            continue;
+        }
+        auto first = *deadlines_.begin();
+        if (first.first > std::chrono::steady_clock::now())
+        {
+            timerCv_.wait_until(lock, first.first);
+            continue;
+        }
+
+        // The condition held the whole time, anything else would have taken the deadline out
+        deadlines_.erase(deadlines_.begin());
+        rules_[first.second].pending = false;
+        fire(rules_[first.second]);
+
+        std::vector<Action> actions;
+        actions.swap(actions_);
+        lock.unlock();
+        runActions(actions);
+        lock.lock();
+    }
+}
+
+json RuleEngine::Status()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    auto status = json::array();
+    for (const auto& rule : rules_)
+    {
+        json entry = {
+            {"rule", rule.text},
+            {"active", rule.active},
+            {"fired", rule.fired}
+        };
+        if (rule.pending)
+        {
+            entry["firesIn"] = std::chrono::duration_cast<std::chrono::milliseconds>(rule.deadline - now).count() / 1000.0;
+        }
+        status.push_back(std::move(entry));
+    }
+    return status;
+}
@@ -0,0 +1,105 @@
+#include "RuntimeState.hpp"
+#include "Log.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint64_t REGION_MAGIC = 0x45544154534c5653; // "SVLSTATE"
+
+static std::string bootId()
+{
+    std::string id;
+    std::ifstream file("/proc/sys/kernel/random/boot_id");
+    std::getline(file, id);
+    return id;
+}
+
+RuntimeState::RuntimeState(const std::string& name, uint64_t layout) :
+    region_(nullptr), resumed_(false), pulsesResumed_(false)
+{
+    std::string boot = bootId();
+
+    if (!name.empty())
+    {
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0)
+        {
+            bool sized = st.st_size == (off_t)sizeof(Region) || ftruncate(fd, sizeof(Region)) == 0;
+            void* memory = sized ? mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+            if (memory != MAP_FAILED)
+            {
+                region_ = static_cast<Region*>(memory);
+                resumed_ = st.st_size == (off_t)sizeof(Region) &&
+                           region_->magic == REGION_MAGIC &&
+                           region_->version == Version &&
+                           region_->size == sizeof(Region) &&
+                           strncmp(region_->bootId, boot.c_str(), sizeof(region_->bootId)) == 0;
+            }
+        }
+        if (fd >= 0) close(fd);
+        if (region_ == nullptr)
+        {
+            LOG_WARNING("Could not map the runtime state {}, it will not survive a restart.", name);
+        }
+    }
+    if (region_ == nullptr)
+    {
+        local_ = std::make_unique<Region>();
+        region_ = local_.get();
+    }
+
+    if (!resumed_)
+    {
+        // Nothing we can trust, start from scratch and mark it valid last
+        memset(static_cast<void*>(region_), 0, sizeof(Region));
+        new (region_) Region();
+        region_->version = Version;
+        region_->size = sizeof(Region);
+        strncpy(region_->bootId, boot.c_str(), sizeof(region_->bootId) - 1);
+        region_->layout = layout;
+        std::atomic_thread_fence(std::memory_order_release);
+        region_->magic = REGION_MAGIC;
+        return;
+    }
+
+    // A crash in the middle of an update leaves the pulse sequence odd
+    pulsesResumed_ = region_->layout == layout && (region_->pulseSeq.load(std::memory_order_acquire) & 1) == 0;
+    if (!pulsesResumed_)
+    {
+        region_->pulseSeq.store(0, std::memory_order_relaxed);
+        region_->channelState.store(0, std::memory_order_relaxed);
+        memset(region_->offTimesNs, 0, sizeof(region_->offTimesNs));
+        region_->layout = layout;
+    }
+    LOG_INFO("Re-attached to the runtime state from the previous run{}.", pulsesResumed_ ? "" : " (without its pulses)");
+}
+
+RuntimeState::~RuntimeState()
+{
+    // The shared object is left behind on purpose for the next run
+    if (local_ == nullptr && region_ != nullptr)
+    {
+        munmap(region_, sizeof(Region));
+    }
+}
+
+RuntimeState::Region& RuntimeState::Get()
+{
+    return *region_;
+}
+
+bool RuntimeState::Resumed() const
+{
+    return resumed_;
+}
+
+bool RuntimeState::PulsesResumed() const
+{
+    return pulsesResumed_;
+}
@@ -0,0 +1,349 @@
+#include "SampleHistory.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static_assert((RuntimeState::SampleCapacity & (RuntimeState::SampleCapacity - 1)) == 0, "The segment tree needs a power of two");
+
+static const SampleHistory::SeriesSummary EMPTY_SERIES = {
+    0, std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), 0.0
+};
+static const SampleHistory::Summary EMPTY_SUMMARY = {0, EMPTY_SERIES, EMPTY_SERIES};
+
+// A NaN reading counts as a sample but not in its series, so it can't
+// poison the sums or the min/max of every node above it
+static SampleHistory::SeriesSummary seriesLeaf(float value)
+{
+    return std::isnan(value) ? EMPTY_SERIES : SampleHistory::SeriesSummary{1, value, value, value};
+}
+
+static SampleHistory::Summary leaf(const StateSample& sample)
+{
+    return SampleHistory::Summary{1, seriesLeaf(sample.temperature), seriesLeaf(sample.humidity)};
+}
+
+static void merge(SampleHistory::SeriesSummary& into, const SampleHistory::SeriesSummary& other)
+{
+    into.count += other.count;
+    into.min = std::min(into.min, other.min);
+    into.max = std::max(into.max, other.max);
+    into.sum += other.sum;
+}
+
+static void merge(SampleHistory::Summary& into, const SampleHistory::Summary& other)
+{
+    into.count += other.count;
+    merge(into.temperature, other.temperature);
+    merge(into.humidity, other.humidity);
+}
+
+SampleHistory::SampleHistory(RuntimeState::SampleRing& ring, RuntimeState::RollupRing& rollups) :
+    ring_(ring), rollups_(rollups), tree_(2 * RuntimeState::SampleCapacity, EMPTY_SUMMARY)
+{
+    // Samples resumed from the runtime state are indexed in one O(n) pass
+    uint64_t head = ring_.head.load(std::memory_order_acquire);
+    for (uint64_t i = head > RuntimeState::SampleCapacity ? head - RuntimeState::SampleCapacity : 0; i < head; i++)
+    {
+        const StateSample& sample = ring_.samples[i % RuntimeState::SampleCapacity];
+        tree_[RuntimeState::SampleCapacity + i % RuntimeState::SampleCapacity] = leaf(sample);
+    }
+    for (size_t i = RuntimeState::SampleCapacity - 1; i > 0; i--)
+    {
+        tree_[i] = tree_[2 * i];
+        merge(tree_[i], tree_[2 * i + 1]);
+    }
+}
+
+void SampleHistory::setLeaf(size_t slot, const StateSample& sample)
+{
+    size_t i = RuntimeState::SampleCapacity + slot;
+    tree_[i] = leaf(sample);
+    for (i /= 2; i > 0; i /= 2)
+    {
+        tree_[i] = tree_[2 * i];
+        merge(tree_[i], tree_[2 * i + 1]);
+    }
+}
+
+SampleHistory::Summary SampleHistory::querySlots(size_t first, size_t last) const
+{
+    Summary summary = EMPTY_SUMMARY;
+    for (first += RuntimeState::SampleCapacity, last += RuntimeState::SampleCapacity; first < last; first /= 2, last /= 2)
+    {
+        if (first & 1) merge(summary, tree_[first++]);
+        if (last & 1) merge(summary, tree_[--last]);
+    }
+    return summary;
+}
+
+SampleHistory::Summary SampleHistory::query(uint64_t first, uint64_t last) const
+{
+    if (first >= last)
+    {
+        return EMPTY_SUMMARY;
+    }
+    // Sample indexes to slots, a span across the end of the ring is two queries
+    size_t slot = first % RuntimeState::SampleCapacity;
+    size_t count = (size_t)(last - first);
+    if (slot + count <= RuntimeState::SampleCapacity)
+    {
+        return querySlots(slot, slot + count);
+    }
+    Summary summary = querySlots(slot, RuntimeState::SampleCapacity);
+    merge(summary, querySlots(0, slot + count - RuntimeState::SampleCapacity));
+    return summary;
+}
+
+void SampleHistory::Record(Clock::time_point time, float temperature, float humidity)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t head = ring_.head.load(std::memory_order_relaxed);
+    int64_t timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    if (head > 0)
+    {
+        timeNs = std::max(timeNs, ring_.samples[(head - 1) % RuntimeState::SampleCapacity].timeNs);
+    }
+
+    // Fill the slot first so a crash never leaves head pointing at a half written sample
+    ring_.samples[head % RuntimeState::SampleCapacity] = StateSample{timeNs, temperature, humidity};
+    ring_.head.store(head + 1, std::memory_order_release);
+    setLeaf(head % RuntimeState::SampleCapacity, ring_.samples[head % RuntimeState::SampleCapacity]);
+    rollUp(ring_.samples[head % RuntimeState::SampleCapacity]);
+}
+
+void SampleHistory::rollUp(const StateSample& sample)
+{
+    // Sample times never go backwards, so neither do the hours
+    int64_t hourNs = sample.timeNs - (sample.timeNs % RuntimeState::RollupPeriodNs + RuntimeState::RollupPeriodNs) % RuntimeState::RollupPeriodNs;
+    uint64_t head = rollups_.head.load(std::memory_order_relaxed);
+    StateRollup* rollup = head > 0 ? &rollups_.rollups[(head - 1) % RuntimeState::RollupCapacity] : nullptr;
+    if (rollup == nullptr || rollup->timeNs != hourNs)
+    {
+        rollup = &rollups_.rollups[head % RuntimeState::RollupCapacity];
+        *rollup = StateRollup{hourNs, 0, EMPTY_SERIES, EMPTY_SERIES};
+        rollups_.head.store(head + 1, std::memory_order_release);
+    }
+    Summary summary = leaf(sample);
+    rollup->count += summary.count;
+    merge(rollup->temperature, summary.temperature);
+    merge(rollup->humidity, summary.humidity);
+}
+
+int64_t SampleHistory::rawStartNs() const
+{
+    uint64_t head = ring_.head.load(std::memory_order_acquire);
+    if (head <= RuntimeState::SampleCapacity) return std::numeric_limits<int64_t>::min();
+    // The oldest sample's hour is only partly left in the ring, its rollup has all of it
+    int64_t oldestNs = ring_.samples[head % RuntimeState::SampleCapacity].timeNs;
+    int64_t into = (oldestNs % RuntimeState::RollupPeriodNs + RuntimeState::RollupPeriodNs) % RuntimeState::RollupPeriodNs;
+    return into == 0 ? oldestNs : oldestNs - into + RuntimeState::RollupPeriodNs;
+}
+
+uint64_t SampleHistory::rollupLowerBound(int64_t timeNs) const
+{
+    uint64_t head = rollups_.head.load(std::memory_order_acquire);
+    uint64_t first = head > RuntimeState::RollupCapacity ? head - RuntimeState::RollupCapacity : 0;
+    uint64_t last = head;
+    while (first < last)
+    {
+        uint64_t middle = first + (last - first) / 2;
+        if (rollups_.rollups[middle % RuntimeState::RollupCapacity].timeNs < timeNs)
+        {
+            first = middle + 1;
+        }
+        else
+        {
+            last = middle;
+        }
+    }
+    return first;
+}
+
+size_t SampleHistory::Size() const
+{
+    return (size_t)std::min<uint64_t>(ring_.head.load(std::memory_order_acquire), RuntimeState::SampleCapacity);
+}
+
+uint64_t SampleHistory::lowerBound(int64_t timeNs) const
+{
+    uint64_t head = ring_.head.load(std::memory_order_acquire);
+    uint64_t first = head > RuntimeState::SampleCapacity ? head - RuntimeState::SampleCapacity : 0;
+    uint64_t last = head;
+    while (first < last)
+    {
+        uint64_t middle = first + (last - first) / 2;
+        if (ring_.samples[middle % RuntimeState::SampleCapacity].timeNs < timeNs)
+        {
+            first = middle + 1;
+        }
+        else
+        {
+            last = middle;
+        }
+    }
+    return first;
+}
+
+std::vector<StateSample> SampleHistory::Range(Clock::time_point from, Clock::time_point to, size_t limit) const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    int64_t fromNs = std::chrono::duration_cast<std::chrono::nanoseconds>(from.time_since_epoch()).count();
+    int64_t toNs = std::chrono::duration_cast<std::chrono::nanoseconds>(to.time_since_epoch()).count();
+
+    std::vector<StateSample> samples;
+    uint64_t head = ring_.head.load(std::memory_order_acquire);
+    for (uint64_t i = lowerBound(fromNs); i < head && samples.size() < limit; i++)
+    {
+        const StateSample& sample = ring_.samples[i % RuntimeState::SampleCapacity];
+        if (sample.timeNs >= toNs) break;
+        samples.push_back(sample);
+    }
+    return samples;
+}
+
+uint64_t SampleHistory::Seek(Clock::time_point time) const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return lowerBound(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+}
+
+size_t SampleHistory::Read(uint64_t& cursor, Clock::time_point to, StateSample* out, size_t max) const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    int64_t toNs = std::chrono::duration_cast<std::chrono::nanoseconds>(to.time_since_epoch()).count();
+    uint64_t head = ring_.head.load(std::memory_order_acquire);
+    cursor = std::max(cursor, head > RuntimeState::SampleCapacity ? head - RuntimeState::SampleCapacity : 0);
+
+    size_t count = 0;
+    for (; cursor < head && count < max; cursor++, count++)
+    {
+        const StateSample& sample = ring_.samples[cursor % RuntimeState::SampleCapacity];
+        if (sample.timeNs >= toNs) break;
+        out[count] = sample;
+    }
+    return count;
+}
+
+std::vector<SampleHistory::Bucket> SampleHistory::Aggregate(Clock::time_point from, Clock::time_point to, std::chrono::nanoseconds step) const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    int64_t fromNs = std::chrono::duration_cast<std::chrono::nanoseconds>(from.time_since_epoch()).count();
+    int64_t toNs = std::chrono::duration_cast<std::chrono::nanoseconds>(to.time_since_epoch()).count();
+
+    // A binary search and a tree query per bucket, however many samples the
+    // range holds, and gaps without samples are skipped in one step. Hours
+    // the ring no longer covers are merged from the rollups instead.
+    std::vector<Bucket> buckets;
+    if (step.count() <= 0) return buckets;
+    int64_t boundaryNs = rawStartNs();
+    uint64_t head = ring_.head.load(std::memory_order_acquire);
+    uint64_t rollupHead = rollups_.head.load(std::memory_order_acquire);
+    uint64_t firstRollup = rollupLowerBound(fromNs);
+    uint64_t first = lowerBound(std::max(fromNs, boundaryNs));
+    for (int64_t start = fromNs; start < toNs; start += step.count())
+    {
+        int64_t nextNs = std::numeric_limits<int64_t>::max();
+        const StateRollup& rollup = rollups_.rollups[firstRollup % RuntimeState::RollupCapacity];
+        if (firstRollup < rollupHead && rollup.timeNs < boundaryNs) nextNs = rollup.timeNs;
+        else if (first < head) nextNs = ring_.samples[first % RuntimeState::SampleCapacity].timeNs;
+        if (nextNs >= toNs) break;
+        start += (nextNs - start) / step.count() * step.count();
+        int64_t endNs = std::min(start + step.count(), toNs);
+
+        Summary summary = EMPTY_SUMMARY;
+        for (uint64_t lastRollup = rollupLowerBound(std::min(endNs, boundaryNs)); firstRollup < lastRollup; firstRollup++)
+        {
+            const StateRollup& hour = rollups_.rollups[firstRollup % RuntimeState::RollupCapacity];
+            merge(summary, Summary{hour.count, hour.temperature, hour.humidity});
+        }
+        uint64_t last = std::max(first, lowerBound(endNs));
+        merge(summary, query(first, last));
+        first = last;
+        buckets.push_back(Bucket{start, summary});
+    }
+    return buckets;
+}
+
+static float seriesValue(const StateSample& sample, SampleHistory::Series series)
+{
+    return series == SampleHistory::Series::Temperature ? sample.temperature : sample.humidity;
+}
+
+std::vector<SampleHistory::ChartPoint> SampleHistory::Chart(Series series, Clock::time_point from, Clock::time_point to, size_t points) const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    int64_t fromNs = std::chrono::duration_cast<std::chrono::nanoseconds>(from.time_since_epoch()).count();
+    int64_t toNs = std::chrono::duration_cast<std::chrono::nanoseconds>(to.time_since_epoch()).count();
+    uint64_t first = lowerBound(fromNs);
+    uint64_t last = lowerBound(toNs);
+    auto valid = [&](uint64_t i) { return !std::isnan(seriesValue(ring_.samples[i % RuntimeState::SampleCapacity], series)); };
+    // Failed readings at either end would otherwise be the fixed first and last picks
+    while (first < last && !valid(first)) first++;
+    while (last > first && !valid(last - 1)) last--;
+    uint64_t count = last - first;
+    auto sampleAt = [&](uint64_t i) -> const StateSample&
+    {
+        return ring_.samples[(first + i) % RuntimeState::SampleCapacity];
+    };
+
+    std::vector<ChartPoint> chart;
+    points = std::max<size_t>(points, 3);
+    if (count <= points)
+    {
+        for (uint64_t i = 0; i < count; i++)
+        {
+            if (!valid(first + i)) continue;
+            chart.push_back(ChartPoint{sampleAt(i).timeNs, seriesValue(sampleAt(i), series)});
+        }
+        return chart;
+    }
+
+    // Times relative to the first sample keep the areas precise in doubles
+    chart.reserve(points);
+    int64_t originNs = sampleAt(0).timeNs;
+    auto seconds = [originNs](int64_t timeNs) { return (timeNs - originNs) / 1e9; };
+
+    // The first and last samples are always kept, the rest is cut into
+    // points - 2 buckets and each bucket keeps the sample that makes the
+    // largest triangle with the previous pick and the next bucket's average.
+    // That average comes from the segment tree, so every sample is read once.
+    // Buckets of nothing but failed readings are left out.
+    double every = (double)(count - 2) / (points - 2);
+    const StateSample* picked = &sampleAt(0);
+    chart.push_back(ChartPoint{picked->timeNs, seriesValue(*picked, series)});
+    for (size_t bucket = 0; bucket < points - 2; bucket++)
+    {
+        uint64_t begin = (uint64_t)(bucket * every) + 1;
+        uint64_t end = (uint64_t)((bucket + 1) * every) + 1;
+        uint64_t nextEnd = std::min<uint64_t>((uint64_t)((bucket + 2) * every) + 1, count);
+
+        double pickedTime = seconds(picked->timeNs);
+        double pickedValue = seriesValue(*picked, series);
+        double nextTime = (seconds(sampleAt(end).timeNs) + seconds(sampleAt(nextEnd - 1).timeNs)) / 2;
+        Summary next = query(first + end, first + nextEnd);
+        const SeriesSummary& nextSeries = series == Series::Temperature ? next.temperature : next.humidity;
+        double nextValue = nextSeries.count > 0 ? nextSeries.sum / nextSeries.count : pickedValue;
+
+        double largest = -1.0;
+        const StateSample* best = nullptr;
+        for (uint64_t i = begin; i < end; i++)
+        {
+            if (!valid(first + i)) continue;
+            const StateSample& sample = sampleAt(i);
+            // Twice the triangle's area, only the comparison matters
+            double area = std::abs((pickedTime - nextTime) * (seriesValue(sample, series) - pickedValue) -
+                                   (pickedTime - seconds(sample.timeNs)) * (nextValue - pickedValue));
+            if (area > largest)
+            {
+                largest = area;
+                best = &sample;
+            }
+        }
+        if (best == nullptr) continue;
+        picked = best;
+        chart.push_back(ChartPoint{picked->timeNs, seriesValue(*picked, series)});
+    }
+    chart.push_back(ChartPoint{sampleAt(count - 1).timeNs, seriesValue(sampleAt(count - 1), series)});
+    return chart;
+}
@@ -0,0 +1,183 @@
+#include "SceneTable.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "Log.hpp"
+
+#include <algorithm>
+#include <fmt/format.h>
+
+using json = nlohmann::json;
+
+static json defaultScenes()
+{
+    return {{"all-off", {{"exclusive", true}}}};
+}
+
+// Channel names to a mask
+static bool channelMask(const json& names, const Silvanus& silvanus, uint32_t& mask, std::string& error)
+{
+    mask = 0;
+    if (names.is_null()) return true;
+    if (!names.is_array())
+    {
+        error = "channel lists must be arrays of channel names";
+        return false;
+    }
+    for (const auto& name : names)
+    {
+        int channel = name.is_string() ? silvanus.FindChannel(name.get<std::string>()) : -1;
+        if (channel < 0)
+        {
+            error = fmt::format("{} is not a channel", name.dump());
+            return false;
+        }
+        mask |= 1u << channel;
+    }
+    return true;
+}
+
+static bool compileStep(const json& definition, const Silvanus& silvanus, SceneTable::Step& step, std::string& error)
+{
+    if (!definition.is_object())
+    {
+        error = "steps must be objects";
+        return false;
+    }
+    json at = definition.value("at", json(0));
+    if (!at.is_number_integer() || at.get<int64_t>() < 0)
+    {
+        error = "\"at\" must be a whole number of milliseconds";
+        return false;
+    }
+    step.at = std::chrono::milliseconds(at.get<int64_t>());
+
+    if (!channelMask(definition.value("on", json()), silvanus, step.onMask, error) ||
+        !channelMask(definition.value("off", json()), silvanus, step.offMask, error))
+    {
+        return false;
+    }
+    if (definition.value("exclusive", false))
+    {
+        uint32_t all = silvanus.Channels().size() >= Silvanus::MaxChannels ? ~0u : (1u << silvanus.Channels().size()) - 1;
+        step.offMask |= all & ~step.onMask;
+    }
+    return true;
+}
+
+SceneTable::SceneTable(Silvanus& silvanus) : silvanus_(silvanus)
+{
+    // Subscribe to settings changes (this also runs the lambda once before subscribing)
+    config.Subscribe([this](const ConfigUpdateEventArg& arg)
+    {
+        json scenes;
+        if (arg.UpdateIfChanged("scenes", scenes, defaultScenes()))
+        {
+            load(scenes);
+        }
+    });
+}
+
+bool SceneTable::Compile(const json& definition, const Silvanus& silvanus, std::vector<Step>& steps, std::string& error)
+{
+    steps.clear();
+    if (!definition.is_object())
+    {
+        error = "a scene must be an object";
+        return false;
+    }
+
+    auto stepList = definition.find("steps");
+    if (stepList == definition.end())
+    {
+        // Single step form
+        Step step;
+        if (!compileStep(definition, silvanus, step, error)) return false;
+        step.at = std::chrono::milliseconds(0);
+        steps.push_back(step);
+        return true;
+    }
+
+    if (!stepList->is_array() || stepList->empty())
+    {
+        error = "\"steps\" must be a non-empty array";
+        return false;
+    }
+    for (const auto& stepDefinition : *stepList)
+    {
+        Step step;
+        if (!compileStep(stepDefinition, silvanus, step, error)) return false;
+        steps.push_back(step);
+    }
+    std::stable_sort(steps.begin(), steps.end(), [](const Step& a, const Step& b) { return a.at < b.at; });
+    return true;
+}
+
+void SceneTable::load(const json& scenes)
+{
+    std::unordered_map<std::string, std::vector<Step>> compiled;
+    if (scenes.is_object())
+    {
+        for (auto& kvp : scenes.items())
+        {
+            std::vector<Step> steps;
+            std::string error;
+            if (Compile(kvp.value(), silvanus_, steps, error))
+            {
+                compiled[kvp.key()] = std::move(steps);
+            }
+            else
+            {
+                LOG_ERROR("Skipping scene {}: {}.", kvp.key(), error);
+            }
+        }
+    }
+    else
+    {
+        LOG_ERROR("The scenes setting must be an object of scene names to definitions.");
+    }
+
+    const std::lock_guard<std::mutex> lock(mutex_);
+    scenes_ = std::move(compiled);
+}
+
+SceneTable::ApplyResult SceneTable::Apply(const std::string& name, std::chrono::milliseconds duration)
+{
+    if (duration.count() < 0 || duration > silvanus_.MaxPulseDuration()) return ApplyResult::BadDuration;
+
+    std::vector<ChannelTransition> sequence;
+    auto start = std::chrono::steady_clock::now();
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        auto scene = scenes_.find(name);
+        if (scene == scenes_.end()) return ApplyResult::UnknownScene;
+
+        uint32_t switchedOn = 0;
+        sequence.reserve(scene->second.size() + 1);
+        for (const auto& step : scene->second)
+        {
+            // Going off before the last step would leave its channels on
+            if (duration.count() > 0 && step.at > duration) return ApplyResult::BadDuration;
+            sequence.push_back({start + step.at, step.onMask, step.offMask});
+            switchedOn |= step.onMask;
+        }
+        if (duration.count() > 0)
+        {
+            sequence.push_back({start + duration, 0, switchedOn});
+        }
+    }
+
+    silvanus_.RunSequence(std::move(sequence));
+    return ApplyResult::Applied;
+}
+
+std::vector<std::string> SceneTable::Names() const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> names;
+    for (const auto& kvp : scenes_)
+    {
+        names.push_back(kvp.first);
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
@@ -0,0 +1,129 @@
+#include "ScheduleEngine.hpp"
+
+#include <ctime>
+
+using Clock = ScheduleEngine::Clock;
+
+// Local midnight dayOffset days from the day of `when`, and that day's weekday
+static Clock::time_point midnight(Clock::time_point when, int dayOffset, int& weekday)
+{
+    time_t t = Clock::to_time_t(when);
+    tm date;
+    localtime_r(&t, &date);
+    date.tm_hour = 0;
+    date.tm_min = 0;
+    date.tm_sec = 0;
+    date.tm_mday += dayOffset;
+    date.tm_isdst = -1; // Let mktime work out DST for the other day
+    time_t result = std::mktime(&date);
+    weekday = date.tm_wday;
+    return Clock::from_time_t(result);
+}
+
+void ScheduleEngine::SetEvents(std::vector<ScheduleEvent> events, Clock::time_point now)
+{
+    events_ = std::move(events);
+    timeline_.clear();
+    for (size_t i = 0; i < events_.size(); i++)
+    {
+        schedule(i, now);
+    }
+}
+
+const std::vector<ScheduleEvent>& ScheduleEngine::Events() const
+{
+    return events_;
+}
+
+void ScheduleEngine::schedule(size_t event, Clock::time_point after)
+{
+    auto next = NextOccurrence(events_[event], after);
+    if (next != Clock::time_point::max())
+    {
+        timeline_.insert(Entry{next, event});
+    }
+}
+
+Clock::time_point ScheduleEngine::NextFire() const
+{
+    return timeline_.empty() ? Clock::time_point::max() : timeline_.begin()->at;
+}
+
+std::vector<std::pair<Clock::time_point, const ScheduleEvent*>> ScheduleEngine::Upcoming(size_t count) const
+{
+    std::vector<std::pair<Clock::time_point, const ScheduleEvent*>> upcoming;
+    for (auto it = timeline_.begin(); it != timeline_.end() && upcoming.size() < count; ++it)
+    {
+        upcoming.emplace_back(it->at, &events_[it->event]);
+    }
+    return upcoming;
+}
+
+Clock::time_point ScheduleEngine::NextOccurrence(const ScheduleEvent& event, Clock::time_point after)
+{
+    if ((event.weekdays & EveryDay) == 0) return Clock::time_point::max();
+
+    // Today's occurrence may already be past, so look up to a week ahead
+    for (int day = 0; day <= 7; day++)
+    {
+        int weekday;
+        auto start = midnight(after, day, weekday) + std::chrono::seconds(event.timeOfDay);
+        if (start > after && (event.weekdays & (1 << weekday)) != 0)
+        {
+            return start;
+        }
+    }
+    return Clock::time_point::max();
+}
+
+Clock::time_point ScheduleEngine::PreviousOccurrence(const ScheduleEvent& event, Clock::time_point now)
+{
+    for (int day = 0; day >= -7; day--)
+    {
+        int weekday;
+        auto start = midnight(now, day, weekday) + std::chrono::seconds(event.timeOfDay);
+        if (start <= now && (event.weekdays & (1 << weekday)) != 0)
+        {
+            return start;
+        }
+    }
+    return Clock::time_point::min();
+}
+
+uint32_t ScheduleEngine::EventKey(const std::string& zone, size_t index)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+    };
+    uint32_t position = (uint32_t)index;
+    mix(zone.data(), zone.size());
+    mix(&position, sizeof(position));
+    return hash;
+}
+
+Clock::time_point ScheduleEngine::OngoingUntil(const ScheduleEvent& event, Clock::time_point now)
+{
+    auto until = Clock::time_point::min();
+    if (event.duration.count() <= 0) return until;
+
+    // Occurrences that started on earlier days can still be running
+    int daysBack = (int)std::chrono::duration_cast<std::chrono::hours>(event.duration).count() / 24 + 1;
+    for (int day = -daysBack; day <= 0; day++)
+    {
+        int weekday;
+        auto start = midnight(now, day, weekday) + std::chrono::seconds(event.timeOfDay);
+        auto end = start + event.duration;
+        if ((event.weekdays & (1 << weekday)) != 0 && start <= now && now < end && end > until)
+        {
+            until = end;
+        }
+    }
+    return until;
+}
@@ -0,0 +1,304 @@
+#include "SensorFilter.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fmt/format.h>
+
+using json = nlohmann::json;
+
+// Weight of a new sample in the reported variance, roughly the last 20 samples
+static const float VARIANCE_ALPHA = 0.1f;
+// Median absolute deviation to standard deviation for normal noise
+static const float MAD_SCALE = 1.4826f;
+
+static const char* typeName(SensorFilter::Type type)
+{
+    switch (type)
+    {
+        case SensorFilter::Type::Median: return "median";
+        case SensorFilter::Type::Ema: return "ema";
+        case SensorFilter::Type::Kalman: return "kalman";
+        case SensorFilter::Type::Outlier: return "outlier";
+        case SensorFilter::Type::RateLimit: return "rate";
+    }
+    return "";
+}
+
+// Steady state gain of the kalman stage, it then behaves like an ema with that alpha
+static float kalmanGain(float q, float r)
+{
+    float predicted = (q + std::sqrt(q * q + 4 * q * r)) / 2;
+    return predicted / (predicted + r);
+}
+
+void SensorFilter::Moments::Add(float value)
+{
+    if (!primed)
+    {
+        mean = value;
+        variance = 0;
+        primed = true;
+        return;
+    }
+    float diff = value - mean;
+    float increment = VARIANCE_ALPHA * diff;
+    mean += increment;
+    variance = (1 - VARIANCE_ALPHA) * (variance + diff * increment);
+}
+
+SensorFilter::SensorFilter() : stageCount_(0)
+{
+    Reset();
+}
+
+bool SensorFilter::Configure(const json& stages, std::string& error)
+{
+    if (!stages.is_array() || stages.size() > MaxStages)
+    {
+        error = fmt::format("a filter chain is a list of at most {} stages", MaxStages);
+        return false;
+    }
+
+    std::array<Stage, MaxStages> parsed;
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        const json& entry = stages[i];
+        Stage& stage = parsed[i];
+        stage = Stage{};
+        std::string type = entry.is_object() ? entry.value("type", std::string()) : std::string();
+        auto number = [&](const char* key, float defaultValue)
+        {
+            auto it = entry.find(key);
+            return it != entry.end() && it->is_number() ? it->get<float>() : (it == entry.end() ? defaultValue : NAN);
+        };
+        if (type == "median")
+        {
+            stage.type = Type::Median;
+            float size = number("size", 5);
+            if (!(size >= 1 && size <= MaxWindow)) { error = fmt::format("stage {}: median size must be 1 to {}", i, MaxWindow); return false; }
+            stage.size = (uint8_t)size;
+        }
+        else if (type == "ema")
+        {
+            stage.type = Type::Ema;
+            stage.param = number("alpha", 0.3f);
+            if (!(stage.param > 0 && stage.param <= 1)) { error = fmt::format("stage {}: ema alpha must be above 0 and at most 1", i); return false; }
+        }
+        else if (type == "kalman")
+        {
+            stage.type = Type::Kalman;
+            stage.param = number("q", 0.01f);
+            stage.noise = number("r", 1.0f);
+            if (!(stage.param > 0 && stage.noise > 0)) { error = fmt::format("stage {}: kalman q and r must be above 0", i); return false; }
+        }
+        else if (type == "outlier")
+        {
+            stage.type = Type::Outlier;
+            float size = number("window", 7);
+            stage.param = number("threshold", 3);
+            if (!(size >= 3 && size <= MaxWindow)) { error = fmt::format("stage {}: outlier window must be 3 to {}", i, MaxWindow); return false; }
+            if (!(stage.param > 0)) { error = fmt::format("stage {}: outlier threshold must be above 0", i); return false; }
+            stage.size = (uint8_t)size;
+        }
+        else if (type == "rate")
+        {
+            stage.type = Type::RateLimit;
+            stage.param = number("max", NAN);
+            if (!(stage.param > 0)) { error = fmt::format("stage {}: rate needs a max step above 0", i); return false; }
+        }
+        else
+        {
+            error = fmt::format("stage {}: type must be median, ema, kalman, outlier or rate", i);
+            return false;
+        }
+    }
+
+    stages_ = parsed;
+    stageCount_ = stages.size();
+    Reset();
+    return true;
+}
+
+void SensorFilter::Reset()
+{
+    for (size_t i = 0; i < stageCount_; i++)
+    {
+        Stage& stage = stages_[i];
+        stage.count = 0;
+        stage.next = 0;
+        stage.primed = false;
+        stage.estimate = 0;
+        stage.error = 0;
+        stage.adjusted = 0;
+    }
+    rawMoments_ = Moments{0, 0, false};
+    filteredMoments_ = Moments{0, 0, false};
+    lastRaw_ = NAN;
+    lastFiltered_ = NAN;
+    samples_ = 0;
+    lastNs_ = 0;
+    maxNs_ = 0;
+    totalNs_ = 0;
+}
+
+size_t SensorFilter::StageCount() const
+{
+    return stageCount_;
+}
+
+float SensorFilter::median(const float* values, size_t count)
+{
+    std::array<float, MaxWindow> sorted{};
+    std::copy(values, values + count, sorted.begin());
+    auto middle = sorted.begin() + count / 2;
+    std::nth_element(sorted.begin(), middle, sorted.begin() + count);
+    if (count % 2 == 1) return *middle;
+    return (*middle + *std::max_element(sorted.begin(), middle)) / 2;
+}
+
+float SensorFilter::run(Stage& stage, float value)
+{
+    switch (stage.type)
+    {
+        case Type::Median:
+        case Type::Outlier:
+        {
+            stage.window[stage.next] = value;
+            stage.next = (stage.next + 1) % stage.size;
+            stage.count = std::min<uint8_t>(stage.count + 1, stage.size);
+            if (stage.type == Type::Median) return median(stage.window.data(), stage.count);
+            // Judge the reading against the window including itself, so a
+            // lasting step wins once it fills half the window
+            if (stage.count < 3) return value;
+            float center = median(stage.window.data(), stage.count);
+            std::array<float, MaxWindow> deviations;
+            for (size_t i = 0; i < stage.count; i++)
+            {
+                deviations[i] = std::fabs(stage.window[i] - center);
+            }
+            float spread = MAD_SCALE * median(deviations.data(), stage.count);
+            if (std::fabs(value - center) <= stage.param * spread) return value;
+            stage.adjusted++;
+            return center;
+        }
+        case Type::Ema:
+            stage.estimate = stage.primed ? stage.estimate + stage.param * (value - stage.estimate) : value;
+            stage.primed = true;
+            return stage.estimate;
+        case Type::Kalman:
+            if (!stage.primed)
+            {
+                stage.estimate = value;
+                stage.error = stage.noise;
+                stage.primed = true;
+                return value;
+            }
+            else
+            {
+                float predicted = stage.error + stage.param;
+                float gain = predicted / (predicted + stage.noise);
+                stage.estimate += gain * (value - stage.estimate);
+                stage.error = (1 - gain) * predicted;
+                return stage.estimate;
+            }
+        case Type::RateLimit:
+            if (stage.primed && std::fabs(value - stage.estimate) > stage.param)
+            {
+                stage.adjusted++;
+                value = stage.estimate + std::copysign(stage.param, value - stage.estimate);
+            }
+            stage.estimate = value;
+            stage.primed = true;
+            return value;
+    }
+    return value;
+}
+
+float SensorFilter::Filter(float raw)
+{
+    if (std::isnan(raw)) return raw;
+
+    auto start = std::chrono::steady_clock::now();
+    float value = raw;
+    for (size_t i = 0; i < stageCount_; i++)
+    {
+        value = run(stages_[i], value);
+    }
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    rawMoments_.Add(raw);
+    filteredMoments_.Add(value);
+    lastRaw_ = raw;
+    lastFiltered_ = value;
+    samples_++;
+    lastNs_ = elapsed;
+    maxNs_ = std::max(maxNs_, elapsed);
+    totalNs_ += elapsed;
+    return value;
+}
+
+float SensorFilter::DelaySamples() const
+{
+    float delay = 0;
+    for (size_t i = 0; i < stageCount_; i++)
+    {
+        const Stage& stage = stages_[i];
+        switch (stage.type)
+        {
+            case Type::Median:
+                delay += (stage.size - 1) / 2.0f;
+                break;
+            case Type::Ema:
+                delay += (1 - stage.param) / stage.param;
+                break;
+            case Type::Kalman:
+            {
+                float gain = kalmanGain(stage.param, stage.noise);
+                delay += (1 - gain) / gain;
+                break;
+            }
+            case Type::Outlier:
+            case Type::RateLimit:
+                break;
+        }
+    }
+    return delay;
+}
+
+json SensorFilter::Status() const
+{
+    auto stages = json::array();
+    uint64_t adjusted = 0;
+    for (size_t i = 0; i < stageCount_; i++)
+    {
+        const Stage& stage = stages_[i];
+        json entry = {{"type", typeName(stage.type)}};
+        switch (stage.type)
+        {
+            case Type::Median: entry["size"] = stage.size; break;
+            case Type::Ema: entry["alpha"] = stage.param; break;
+            case Type::Kalman: entry["q"] = stage.param; entry["r"] = stage.noise; break;
+            case Type::Outlier: entry["window"] = stage.size; entry["threshold"] = stage.param; entry["adjusted"] = stage.adjusted; break;
+            case Type::RateLimit: entry["max"] = stage.param; entry["adjusted"] = stage.adjusted; break;
+        }
+        adjusted += stage.adjusted;
+        stages.push_back(entry);
+    }
+
+    // Json has no NaN, readings that never came are null
+    auto reading = [](float value) { return std::isnan(value) ? json() : json(value); };
+    return {
+        {"stages", stages},
+        {"raw", reading(lastRaw_)},
+        {"filtered", reading(lastFiltered_)},
+        {"rawVariance", rawMoments_.variance},
+        {"filteredVariance", filteredMoments_.variance},
+        {"delaySamples", DelaySamples()},
+        {"adjusted", adjusted},
+        {"samples", samples_},
+        {"lastNs", lastNs_},
+        {"maxNs", maxNs_},
+        {"meanNs", samples_ > 0 ? totalNs_ / samples_ : 0}
+    };
+}
@@ -1,47 +1,116 @@
 #include "Silvanus.hpp"
+#include "ConfigService.hpp"
+static auto& config = ConfigService::global;
+#include "Log.hpp"
+#include "ThreadTuning.hpp"
 
-#include <iostream>
+#include <algorithm>
 #include <chrono>
+#include <filesystem>
+#include <limits>
 #include <thread>
 
 #if PI_HOST
-#include <minimal_gpio.h>
+static const std::string JOURNAL_PATH = "/var/lib/silvanus/SilvanusEvents.journal";
+#else
+static const std::string JOURNAL_PATH = "SilvanusEvents.journal";
 #endif
 
-static const int LIGHT_GPIO = 26;
-static const int PUMP_GPIO = 20;
-static const int EXPANSION_GPIO = 21;
-
 Silvanus::Silvanus()
 {
-    #if PI_HOST
-    if (gpioInitialise() < 0)
+    // The channel table cannot change so no need to subscribe
+    channels_ = ParseChannels(config.GetConfigValue("outputChannels", DefaultChannels()));
+    lightChannel_ = FindChannelByRole("light");
+    pumpChannel_ = FindChannelByRole("pump");
+    activeLowBits_ = 0;
+    gpioBits_.fill(0);
+    for (size_t i = 0; i < channels_.size(); i++)
+    {
+        gpioBits_[i] = 1u << channels_[i].gpio;
+        if (channels_[i].activeLow) activeLowBits_ |= channelBit(i);
+    }
+    channelState_ = 0;
+
+    // The journal location cannot change so no need to subscribe
+    std::string journalPath = config.GetConfigValue("journalPath", JOURNAL_PATH);
+    auto journalSync = std::chrono::milliseconds(config.GetConfigValue("journalSyncInterval", 1000));
+    if (!journalPath.empty() && std::filesystem::path(journalPath).has_parent_path())
+    {
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(journalPath).parent_path(), error);
+    }
+    journal_ = std::make_unique<EventJournal>(journalPath, journalSync);
+
+    // Pulses from the previous run only mean something for the same pins
+    static_assert(MaxChannels == RuntimeState::MaxChannels, "The runtime state holds every channel");
+    uint64_t layout = 14695981039346656037ull;
+    for (const auto& channel : channels_)
     {
-        throw std::runtime_error("Failed to setup GPIO\n");
+        layout = (layout ^ (channel.gpio | (channel.activeLow ? 0x100u : 0u))) * 1099511628211ull;
     }
-    gpioSetMode(LIGHT_GPIO, PI_OUTPUT); // Setup light as output
-    gpioWrite(LIGHT_GPIO, 0);
-    gpioSetMode(PUMP_GPIO, PI_OUTPUT); // Setup pump as output
-    gpioWrite(PUMP_GPIO, 0);
-    //gpioSetMode(EXPANSION_GPIO, PI_OUTPUT); // Setup TBD extra output
-    //gpioWrite(EXPANSION_GPIO, 0);
-    #else
-    lightState_ = false;
-    pumpState_ = false;
-    #endif
+    // The state name cannot change so no need to subscribe
+    state_ = std::make_unique<RuntimeState>(config.GetConfigValue("runtimeState", std::string("/silvanus-state")), layout);
+    auto& region = state_->Get();
+    resumedOffTimesNs_.fill(0);
+    resumedChannels_ = 0;
+    if (state_->PulsesResumed())
+    {
+        std::copy(std::begin(region.offTimesNs), std::end(region.offTimesNs), resumedOffTimesNs_.begin());
+        resumedChannels_ = region.channelState.load(std::memory_order_relaxed);
+    }
+    history_ = std::make_unique<SampleHistory>(region.samples, region.rollups);
+    readingTime_ = std::chrono::steady_clock::time_point();
+    lastTemperature_ = std::numeric_limits<float>::quiet_NaN();
+    lastHumidity_ = std::numeric_limits<float>::quiet_NaN();
+
+    // Drive the off level before switching to output so relays don't click on at startup
+    for (size_t i = 0; i < channels_.size(); i++)
+    {
+        gpio_.SetOutput(channels_[i].gpio, channels_[i].activeLow);
+    }
+    pwm_ = std::make_unique<PwmDimmer>(gpio_.PwmRegisters(), gpio_.OscillatorHz());
+    ramp_ = std::make_unique<LightRamp>(*pwm_, channels_);
+
+    // Switch inputs can hold channels off (e.g. the pump while the reservoir is empty)
+    interlock_ = 0;
+    inputs_ = std::make_unique<GpioInputs>(channels_, [this]() { applyInterlock(); });
+    applyInterlock();
+
+    // Subscribe to settings changes (this also runs the lambda once before subscribing)
+    config.Subscribe([this](const ConfigUpdateEventArg& arg)
+    {
+        nlohmann::json filters;
+        if (arg.UpdateIfChanged("sensorFilters", filters, nlohmann::json::object()))
+        {
+            configureFilters(filters);
+        }
+    });
+
+    // Pulse thread scheduling. These cannot change so no need to subscribe.
+    // The pulse thread runs SCHED_FIFO (0 disables) and pins itself to
+    // actuatorCpu if it is set. main() moves every other thread off that
+    // core before any are created.
+    realtimePriority_ = config.GetConfigValue("actuatorRealtimePriority", 50);
+    pulseCpu_ = config.GetConfigValue("actuatorCpu", -1);
+    deadlineTolerance_ = std::chrono::milliseconds(config.GetConfigValue("actuatorDeadlineTolerance", 10));
+    maxPulseDuration_ = std::chrono::seconds(std::max(1, config.GetConfigValue("maxPulseDuration", 86400)));
+    pulseThreadRealtime_ = false;
+    deadlineMisses_ = 0;
 
     exit_ = false;
-    lightOffTime_ = std::chrono::steady_clock::time_point::max();
-    pumpOffTime_ = std::chrono::steady_clock::time_point::max();
+    offTimes_.fill(std::chrono::steady_clock::time_point::max());
+    sequenceNext_ = 0;
     pulseThread_ = std::make_unique<std::thread>(&Silvanus::pulseThreadFunc, this);
 }
 
 Silvanus::~Silvanus()
 {
+    inputs_ = nullptr;
     {
         const std::lock_guard<std::mutex> lock(threadMutex_);
         exit_ = true;
     }
+    pulseCv_.notify_one();
     if (pulseThread_ != nullptr)
     {
         pulseThread_->join();
@@ -49,102 +118,497 @@ Silvanus::~Silvanus()
     }
 }
 
-void Silvanus::SetLight(bool state)
+nlohmann::json Silvanus::DefaultChannels()
+{
+    // The 3 relay hat from the readme
+    return nlohmann::json::array({
+        {{"name", "light"}, {"role", "light"}, {"gpio", 26}, {"activeLow", false}},
+        {{"name", "pump"}, {"role", "pump"}, {"gpio", 20}, {"activeLow", false}},
+        {{"name", "expansion"}, {"role", ""}, {"gpio", 21}, {"activeLow", false}}
+    });
+}
+
+std::vector<OutputChannel> Silvanus::ParseChannels(const nlohmann::json& table)
+{
+    std::vector<OutputChannel> channels;
+    if (!table.is_array())
+    {
+        LOG_ERROR("outputChannels must be an array, no outputs configured.");
+        return channels;
+    }
+
+    uint32_t usedGpios = 0;
+    for (const auto& entry : table)
+    {
+        OutputChannel channel;
+        try
+        {
+            channel.name = entry.at("name").get<std::string>();
+            channel.role = entry.value("role", std::string());
+            channel.gpio = entry.at("gpio").get<unsigned>();
+            channel.activeLow = entry.value("activeLow", false);
+        }
+        catch (...)
+        {
+            LOG_ERROR("Skipping output channel {}, it needs a name and a gpio.", entry.dump());
+            continue;
+        }
+
+        if (channel.gpio > 31)
+        {
+            LOG_ERROR("Skipping output channel {}, GPIO {} is not in bank 1 (0-31).", channel.name, channel.gpio);
+        }
+        else if ((usedGpios & (1u << channel.gpio)) != 0)
+        {
+            LOG_ERROR("Skipping output channel {}, GPIO {} is already used.", channel.name, channel.gpio);
+        }
+        else if (std::any_of(channels.begin(), channels.end(), [&](const OutputChannel& c) { return c.name == channel.name; }))
+        {
+            LOG_ERROR("Skipping output channel {}, the name is already used.", channel.name);
+        }
+        else if (channels.size() >= MaxChannels)
+        {
+            LOG_ERROR("Skipping output channel {}, only {} channels are supported.", channel.name, MaxChannels);
+        }
+        else
+        {
+            usedGpios |= 1u << channel.gpio;
+            channels.push_back(channel);
+        }
+    }
+    return channels;
+}
+
+const std::vector<OutputChannel>& Silvanus::Channels() const
+{
+    return channels_;
+}
+
+int Silvanus::FindChannel(const std::string& name) const
+{
+    for (size_t i = 0; i < channels_.size(); i++)
+    {
+        if (channels_[i].name == name) return (int)i;
+    }
+    return -1;
+}
+
+int Silvanus::FindChannelByRole(const std::string& role) const
 {
+    for (size_t i = 0; i < channels_.size(); i++)
+    {
+        if (channels_[i].role == role) return (int)i;
+    }
+    return -1;
+}
+
+uint32_t Silvanus::channelBit(int channel)
+{
+    return channel < 0 ? 0 : 1u << channel;
+}
+
+void Silvanus::SetChannels(uint32_t onMask, uint32_t offMask)
+{
+    uint32_t valid = channels_.size() >= MaxChannels ? ~0u : (1u << channels_.size()) - 1;
+    offMask &= valid;
+    onMask &= valid & ~offMask & ~interlock_.load(std::memory_order_acquire);
+    if ((onMask | offMask) == 0) return;
+    if ((offMask & ramp_->DimmedMask()) != 0)
+    {
+        ramp_->EndWindow(offMask);
+    }
+
     const std::lock_guard<std::mutex> lock(ioMutex_);
-    #if PI_HOST
-    gpioWrite(LIGHT_GPIO, state ? 1 : 0);
-    #else
-    lightState_ = state;
-    std::cout << "[Simulator] Set Light: " << (state ? "ON" : "OFF") << std::endl;
-    #endif
+    // Translate to pin levels, active low channels swap set and clear
+    uint32_t setBits = 0;
+    uint32_t clearBits = 0;
+    for (uint32_t pending = onMask | offMask; pending != 0; pending &= pending - 1)
+    {
+        int channel = __builtin_ctz(pending);
+        bool high = ((onMask >> channel) & 1) != ((activeLowBits_ >> channel) & 1);
+        (high ? setBits : clearBits) |= gpioBits_[channel];
+    }
+    if (clearBits != 0) gpio_.ClearBank1(clearBits);
+    if (setBits != 0) gpio_.SetBank1(setBits);
+    uint32_t previous = channelState_.load(std::memory_order_relaxed);
+    channelState_.store((previous | onMask) & ~offMask, std::memory_order_release);
+    state_->Get().channelState.store((previous | onMask) & ~offMask, std::memory_order_relaxed);
+
+    // Only real changes, re-sending the current state is not an event
+    if ((onMask & ~previous) != 0) journal_->Append(EventJournal::Type::ChannelOn, onMask & ~previous);
+    if ((offMask & previous) != 0) journal_->Append(EventJournal::Type::ChannelOff, offMask & previous);
+}
+
+uint32_t Silvanus::GetChannels() const
+{
+    return channelState_.load(std::memory_order_acquire);
+}
+
+void Silvanus::SetChannel(int channel, bool state)
+{
+    SetChannels(state ? channelBit(channel) : 0, state ? 0 : channelBit(channel));
+}
+
+bool Silvanus::GetChannel(int channel) const
+{
+    return (GetChannels() & channelBit(channel)) != 0;
+}
+
+void Silvanus::SetLight(bool state)
+{
+    SetChannel(lightChannel_, state);
 }
 
 void Silvanus::SetPump(bool state)
 {
-    const std::lock_guard<std::mutex> lock(ioMutex_);
-    #if PI_HOST
-    gpioWrite(PUMP_GPIO, state ? 1 : 0);
-    #else
-    pumpState_ = state;
-    std::cout << "[Simulator] Set Pump: " << (state ? "ON" : "OFF") << std::endl;
-    #endif
+    SetChannel(pumpChannel_, state);
 }
 
 bool Silvanus::GetLight()
 {
-    const std::lock_guard<std::mutex> lock(ioMutex_);
-    #if PI_HOST
-    return gpioRead(LIGHT_GPIO) == 0 ? false : true;
-    #else
-    return lightState_;
-    #endif
+    return GetChannel(lightChannel_);
 }
 
 bool Silvanus::GetPump()
 {
-    const std::lock_guard<std::mutex> lock(ioMutex_);
-    #if PI_HOST
-    return gpioRead(PUMP_GPIO) == 0 ? false : true;
-    #else
-    return pumpState_;
-    #endif
+    return GetChannel(pumpChannel_);
+}
+
+LightRamp& Silvanus::Dimming()
+{
+    return *ramp_;
+}
+
+const GpioInputs& Silvanus::Inputs() const
+{
+    return *inputs_;
+}
+
+uint32_t Silvanus::InterlockedChannels() const
+{
+    return interlock_.load(std::memory_order_acquire);
+}
+
+EventJournal& Silvanus::Journal()
+{
+    return *journal_;
+}
+
+SampleHistory& Silvanus::History()
+{
+    return *history_;
+}
+
+void Silvanus::saveOffTimes()
+{
+    auto& region = state_->Get();
+    region.pulseSeq.fetch_add(1, std::memory_order_acq_rel);
+    for (size_t i = 0; i < MaxChannels; i++)
+    {
+        region.offTimesNs[i] = offTimes_[i] == std::chrono::steady_clock::time_point::max() ? 0 :
+            std::chrono::duration_cast<std::chrono::nanoseconds>(offTimes_[i].time_since_epoch()).count();
+    }
+    region.pulseSeq.fetch_add(1, std::memory_order_release);
+}
+
+void Silvanus::ResumePulses()
+{
+    // The steady clock is system wide, so its times carry over between runs of the same boot
+    auto now = std::chrono::steady_clock::now();
+    int resumed = 0;
+    for (size_t i = 0; i < channels_.size(); i++)
+    {
+        if ((resumedChannels_ & channelBit(i)) == 0 || resumedOffTimesNs_[i] == 0) continue;
+        std::chrono::steady_clock::time_point offTime{std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(resumedOffTimesNs_[i]))};
+        if (offTime <= now) continue;
+        PulseChannels(channelBit(i), std::chrono::duration_cast<std::chrono::milliseconds>(offTime - now));
+        resumed++;
+    }
+    resumedChannels_ = 0;
+    if (resumed > 0)
+    {
+        LOG_INFO("Resumed {} pulses from before the restart.", resumed);
+    }
+}
+
+void Silvanus::applyInterlock()
+{
+    uint32_t mask = inputs_->InterlockMask();
+    interlock_.store(mask, std::memory_order_release);
+    if ((GetChannels() & mask) != 0)
+    {
+        LOG_WARNING("Switching off channels {:#x}, an input is holding them off.", GetChannels() & mask);
+        SetChannels(0, mask);
+    }
 }
 
 float Silvanus::GetHumidity()
 {
-  const std::lock_guard<std::mutex> lock(ioMutex_);
+  const std::lock_guard<std::mutex> lock(sensorMutex_);
   return tempHumSensor_.readHumidity();
 }
 
 float Silvanus::GetTemperature()
 {
-  const std::lock_guard<std::mutex> lock(ioMutex_);
+  const std::lock_guard<std::mutex> lock(sensorMutex_);
   return tempHumSensor_.readTemperature();
 }
 
-void Silvanus::PulseLight(std::chrono::seconds duration)
+void Silvanus::Sample(float& temperature, float& humidity)
 {
-    const std::lock_guard<std::mutex> lock(threadMutex_);
-    SetLight(true);
-    lightOffTime_ = std::chrono::steady_clock::now() + duration;
+    {
+        const std::lock_guard<std::mutex> lock(sensorMutex_);
+        tempHumSensor_.readBoth(&temperature, &humidity);
+        readingTime_ = std::chrono::steady_clock::now();
+        lastTemperature_ = temperature;
+        lastHumidity_ = humidity;
+    }
+    const std::lock_guard<std::mutex> lock(filterMutex_);
+    temperature = temperatureFilter_.Filter(temperature);
+    humidity = humidityFilter_.Filter(humidity);
 }
 
-void Silvanus::PulsePump(std::chrono::seconds duration)
+void Silvanus::CachedReading(std::chrono::milliseconds maxAge, float& temperature, float& humidity)
 {
-    const std::lock_guard<std::mutex> lock(threadMutex_);
-    SetPump(true);
-    pumpOffTime_ = std::chrono::steady_clock::now() + duration;
+    const std::lock_guard<std::mutex> lock(sensorMutex_);
+    auto now = std::chrono::steady_clock::now();
+    if (readingTime_ == std::chrono::steady_clock::time_point() || now - readingTime_ > maxAge)
+    {
+        tempHumSensor_.readBoth(&lastTemperature_, &lastHumidity_);
+        readingTime_ = now;
+    }
+    temperature = lastTemperature_;
+    humidity = lastHumidity_;
 }
 
-void  Silvanus::pulseThreadFunc()
+nlohmann::json Silvanus::FilterStatus()
 {
-    while (true)
+    const std::lock_guard<std::mutex> lock(filterMutex_);
+    return {
+        {"temperature", temperatureFilter_.Status()},
+        {"humidity", humidityFilter_.Status()}
+    };
+}
+
+void Silvanus::configureFilters(const nlohmann::json& filters)
+{
+    // Build the chains before locking, a bad one keeps its previous stages
+    SensorFilter temperature;
+    SensorFilter humidity;
+    std::string error;
+    bool temperatureOk = temperature.Configure(filters.is_object() ? filters.value("temperature", nlohmann::json::array()) : nlohmann::json::array(), error);
+    if (!temperatureOk) LOG_WARNING("Ignoring the temperature filters, {}.", error);
+    bool humidityOk = humidity.Configure(filters.is_object() ? filters.value("humidity", nlohmann::json::array()) : nlohmann::json::array(), error);
+    if (!humidityOk) LOG_WARNING("Ignoring the humidity filters, {}.", error);
+
+    const std::lock_guard<std::mutex> lock(filterMutex_);
+    if (temperatureOk) temperatureFilter_ = temperature;
+    if (humidityOk) humidityFilter_ = humidity;
+}
+
+const LatencyHistogram& Silvanus::OffDeadlineLateness() const
+{
+    return offDeadlineLateness_;
+}
+
+uint64_t Silvanus::DeadlineMissCount() const
+{
+    return deadlineMisses_;
+}
+
+std::chrono::microseconds Silvanus::DeadlineTolerance() const
+{
+    return deadlineTolerance_;
+}
+
+std::chrono::milliseconds Silvanus::MaxPulseDuration() const
+{
+    return maxPulseDuration_;
+}
+
+bool Silvanus::PulseThreadRealtime() const
+{
+    return pulseThreadRealtime_;
+}
+
+void Silvanus::PulseChannels(uint32_t mask, std::chrono::milliseconds duration, std::chrono::milliseconds elapsed)
+{
+    // Callers check against it, this keeps now + duration from overflowing whatever they do
+    if (duration > maxPulseDuration_)
+    {
+        LOG_WARNING("Limiting a {} ms pulse to maxPulseDuration.", duration.count());
+        duration = maxPulseDuration_;
+    }
     {
+        const std::lock_guard<std::mutex> lock(threadMutex_);
+        auto now = std::chrono::steady_clock::now();
+        auto offTime = now + duration;
+        ramp_->StartWindow(mask, now - elapsed, offTime);
+        SetChannels(mask, 0);
+        for (size_t i = 0; i < channels_.size(); i++)
         {
-            const std::lock_guard<std::mutex> lock(threadMutex_);
-            if (exit_) break;
-            auto thisEval = std::chrono::steady_clock::now();
-            if (lightOffTime_ <= thisEval)
+            if ((mask & channelBit(i)) != 0) offTimes_[i] = offTime;
+        }
+        saveOffTimes();
+    }
+    pulseCv_.notify_one();
+}
+
+void Silvanus::takeDueTransitions(std::chrono::steady_clock::time_point now, uint32_t& onMask, uint32_t& offMask)
+{
+    // Later transitions override earlier ones channel by channel
+    for (; sequenceNext_ < sequence_.size() && sequence_[sequenceNext_].at <= now; sequenceNext_++)
+    {
+        const auto& transition = sequence_[sequenceNext_];
+        onMask = (onMask & ~transition.offMask) | (transition.onMask & ~transition.offMask);
+        offMask = (offMask & ~transition.onMask) | transition.offMask;
+    }
+    if (sequenceNext_ == sequence_.size())
+    {
+        sequence_.clear();
+        sequenceNext_ = 0;
+    }
+}
+
+void Silvanus::RunSequence(std::vector<ChannelTransition> sequence)
+{
+    {
+        const std::lock_guard<std::mutex> lock(threadMutex_);
+        std::stable_sort(sequence.begin(), sequence.end(), [](const ChannelTransition& a, const ChannelTransition& b)
+        {
+            return a.at < b.at;
+        });
+        sequence_ = std::move(sequence);
+        sequenceNext_ = 0;
+
+        uint32_t onMask = 0;
+        uint32_t offMask = 0;
+        takeDueTransitions(std::chrono::steady_clock::now(), onMask, offMask);
+        SetChannels(onMask, offMask);
+    }
+    pulseCv_.notify_one();
+}
+
+void Silvanus::ApplyChanges(const std::vector<ChannelChange>& changes)
+{
+    if (changes.empty()) return;
+    {
+        const std::lock_guard<std::mutex> lock(threadMutex_);
+        auto now = std::chrono::steady_clock::now();
+        uint32_t onMask = 0;
+        uint32_t offMask = 0;
+        for (const auto& change : changes)
+        {
+            onMask = (onMask & ~change.offMask) | (change.onMask & ~change.offMask);
+            offMask = (offMask & ~change.onMask) | change.offMask;
+        }
+
+        // A channel's last change decides whether it ends up pulsed. Walking
+        // back, the first change that touches a channel is that last one.
+        uint32_t interlocked = interlock_.load(std::memory_order_acquire);
+        uint32_t decided = 0;
+        uint32_t plainMask = 0;
+        for (auto it = changes.rbegin(); it != changes.rend(); ++it)
+        {
+            uint32_t mask = (it->onMask | it->offMask) & ~decided;
+            decided |= mask;
+            uint32_t pulseMask = it->duration.count() > 0 ? mask & it->onMask & ~it->offMask & ~interlocked : 0;
+            plainMask |= mask & ~pulseMask;
+            auto offTime = now + std::min(it->duration, maxPulseDuration_);
+            if (pulseMask != 0) ramp_->StartWindow(pulseMask, now, offTime);
+            for (size_t i = 0; i < channels_.size(); i++)
             {
-                #ifndef PI_HOST
-                std::cout << "[Simulator] Ending sun period." << std::endl;
-                #endif
-                SetLight(false);
-                lightOffTime_ = std::chrono::steady_clock::time_point::max();
+                if ((mask & channelBit(i)) == 0) continue;
+                offTimes_[i] = (pulseMask & channelBit(i)) != 0 ? offTime : std::chrono::steady_clock::time_point::max();
             }
-            if (pumpOffTime_ <= thisEval)
+        }
+        ramp_->EndWindow(plainMask);
+        SetChannels(onMask, offMask);
+        if (decided != 0) saveOffTimes();
+    }
+    pulseCv_.notify_one();
+}
+
+void Silvanus::PulseLight(std::chrono::seconds duration)
+{
+    PulseChannels(channelBit(lightChannel_), duration);
+}
+
+void Silvanus::PulsePump(std::chrono::seconds duration)
+{
+    PulseChannels(channelBit(pumpChannel_), duration);
+}
+
+void Silvanus::recordOffDeadline(std::chrono::steady_clock::time_point deadline)
+{
+    auto lateness = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - deadline);
+    offDeadlineLateness_.Record(lateness.count());
+    if (lateness > deadlineTolerance_)
+    {
+        deadlineMisses_++;
+    }
+}
+
+void Silvanus::pulseThreadFunc()
+{
+    if (pulseCpu_ >= 0 && !ThreadTuning::PinToCpu(pulseCpu_))
+    {
+        LOG_WARNING("Could not pin the pulse thread to CPU {}.", pulseCpu_);
+    }
+    if (realtimePriority_ > 0)
+    {
+        pulseThreadRealtime_ = ThreadTuning::SetRealtimePriority(realtimePriority_);
+        if (!pulseThreadRealtime_)
+        {
+            LOG_WARNING("Could not give the pulse thread realtime priority, running it as a normal thread.");
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(threadMutex_);
+    while (!exit_)
+    {
+        // Sleep until the next off-deadline or sequence step (or until a pulse is started or changed)
+        auto nextDeadline = *std::min_element(offTimes_.begin(), offTimes_.end());
+        if (sequenceNext_ < sequence_.size())
+        {
+            nextDeadline = std::min(nextDeadline, sequence_[sequenceNext_].at);
+        }
+        if (nextDeadline == std::chrono::steady_clock::time_point::max())
+        {
+            pulseCv_.wait(lock);
+        }
+        else
+        {
+            pulseCv_.wait_until(lock, nextDeadline);
+        }
+        if (exit_) break;
+
+        // Everything that came due is switched in one write, pulse ends win
+        auto thisEval = std::chrono::steady_clock::now();
+        uint32_t onMask = 0;
+        uint32_t offMask = 0;
+        takeDueTransitions(thisEval, onMask, offMask);
+        uint32_t due = 0;
+        for (size_t i = 0; i < channels_.size(); i++)
+        {
+            if (offTimes_[i] <= thisEval) due |= channelBit(i);
+        }
+        SetChannels(onMask, offMask | due);
+        for (size_t i = 0; i < channels_.size(); i++)
+        {
+            if ((due & channelBit(i)) != 0)
             {
-                #ifndef PI_HOST
-                std::cout << "[Simulator] Ending rain period." << std::endl;
-                #endif
-                SetPump(false);
-                pumpOffTime_ = std::chrono::steady_clock::time_point::max();
+                LOG_DEBUG("Ending {} pulse.", channels_[i].name);
+                recordOffDeadline(offTimes_[i]);
+                offTimes_[i] = std::chrono::steady_clock::time_point::max();
             }
         }
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        if (due != 0) saveOffTimes();
     }
-    SetLight(false);
-    SetPump(false);
-}
+    lock.unlock();
 
+    // Leave the state as it was for the next run to resume from
+    uint32_t running = state_->Get().channelState.load(std::memory_order_relaxed);
+    SetChannels(0, ~0u);
+    state_->Get().channelState.store(running, std::memory_order_relaxed);
+}
@@ -0,0 +1,63 @@
+#include "StaticFileCache.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+static bool endsWith (const std::string& fullString, const std::string& ending) 
+{
+    if (fullString.length() >= ending.length()) 
+    {
+        return (0 == fullString.compare(fullString.length() - ending.length(), ending.length(), ending));
+    } 
+    return false;
+}
+
+std::string StaticFileCache::GetMimeType(const std::string& filename)
+{
+    if (endsWith(filename, ".html") || endsWith(filename, ".htm"))
+    {
+        return "text/html";
+    }
+    else if (endsWith(filename, ".css"))
+    {
+        return "text/css";
+    }
+    else if (endsWith(filename, ".js"))
+    {
+        return "text/javascript";
+    }
+
+    return "text/plain";
+}
+
+void StaticFileCache::Load(const std::string& directory)
+{
+    for (const auto & entry : std::filesystem::directory_iterator(directory))
+    {
+        if (entry.is_regular_file() && (entry.path().extension() == ".html" || 
+                                        entry.path().extension() == ".htm" || 
+                                        entry.path().extension() == ".css" || 
+                                        entry.path().extension() == ".js"))
+        {
+            std::ifstream t(entry.path());
+            std::stringstream buffer;
+            buffer << t.rdbuf();
+            std::string filename = entry.path().filename();
+            files_[filename] = File{buffer.str(), GetMimeType(filename)};
+        }
+    }
+}
+
+const StaticFileCache::File* StaticFileCache::Find(const std::string& filename) const
+{
+    auto it = files_.find(filename);
+    if (it == files_.end())
+        return nullptr;
+    return &it->second;
+}
+
+const std::unordered_map<std::string, StaticFileCache::File>& StaticFileCache::Files() const
+{
+    return files_;
+}
@@ -0,0 +1,59 @@
+#include "ThreadTuning.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+
+bool ThreadTuning::SetRealtimePriority(int priority)
+{
+    int minPriority = sched_get_priority_min(SCHED_FIFO);
+    int maxPriority = sched_get_priority_max(SCHED_FIFO);
+    if (priority < minPriority || priority > maxPriority)
+        return false;
+
+    sched_param param{};
+    param.sched_priority = priority;
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+}
+
+bool ThreadTuning::PinToCpu(int cpu)
+{
+    #ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    #else
+    return false;
+    #endif
+}
+
+static bool avoidCpu(pthread_t thread, int cpu)
+{
+    #ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+    cpu_set_t set;
+    if (pthread_getaffinity_np(thread, sizeof(set), &set) != 0)
+        return false;
+    CPU_CLR(cpu, &set);
+    // Don't strand the thread with nowhere to run on a single core board
+    if (CPU_COUNT(&set) == 0)
+        return false;
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+    #else
+    return false;
+    #endif
+}
+
+bool ThreadTuning::AvoidCpu(int cpu)
+{
+    return avoidCpu(pthread_self(), cpu);
+}
+
+bool ThreadTuning::AvoidCpu(std::thread& thread, int cpu)
+{
+    return avoidCpu(thread.native_handle(), cpu);
+}
@@ -0,0 +1,237 @@
+#include "TlsSetup.hpp"
+#include "Log.hpp"
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Marks certificates that EnsureCertificate may replace
+static const char* SELF_SIGNED_NAME = "Silvanus self-signed";
+
+// Pi 3 and older have no AES instructions, ChaCha20 is several times faster there
+static const char* TLS12_CIPHERS =
+    "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-ECDSA-AES256-GCM-SHA384:"
+    "ECDHE-RSA-CHACHA20-POLY1305:ECDHE-RSA-AES128-GCM-SHA256:ECDHE-RSA-AES256-GCM-SHA384";
+static const char* TLS13_CIPHERS = "TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384";
+
+using X509Ptr = std::unique_ptr<X509, decltype(&X509_free)>;
+using KeyPtr = std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)>;
+
+static std::string sslError()
+{
+    char text[256];
+    ERR_error_string_n(ERR_get_error(), text, sizeof(text));
+    return text;
+}
+
+static X509Ptr readCertificate(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) return X509Ptr(nullptr, X509_free);
+    X509Ptr cert(PEM_read_X509(file, nullptr, nullptr, nullptr), X509_free);
+    fclose(file);
+    return cert;
+}
+
+static KeyPtr readKey(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) return KeyPtr(nullptr, EVP_PKEY_free);
+    KeyPtr key(PEM_read_PrivateKey(file, nullptr, nullptr, nullptr), EVP_PKEY_free);
+    fclose(file);
+    return key;
+}
+
+static bool isSelfSigned(X509* cert)
+{
+    char name[128] = {0};
+    X509_NAME* subject = X509_get_subject_name(cert);
+    return X509_NAME_cmp(subject, X509_get_issuer_name(cert)) == 0 &&
+           X509_NAME_get_text_by_NID(subject, NID_commonName, name, sizeof(name)) > 0 &&
+           std::string(name) == SELF_SIGNED_NAME;
+}
+
+// Write through a temporary file and rename, so a crash never leaves half a file
+template <typename F>
+static bool writePem(const std::string& path, mode_t mode, F&& write)
+{
+    std::string temp = path + ".tmp";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (fd < 0) return false;
+    FILE* file = fdopen(fd, "w");
+    if (file == nullptr)
+    {
+        close(fd);
+        return false;
+    }
+    bool written = write(file) == 1;
+    written = fflush(file) == 0 && fsync(fd) == 0 && written;
+    fclose(file);
+    if (!written || rename(temp.c_str(), path.c_str()) != 0)
+    {
+        unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool addExtension(X509* cert, int nid, const std::string& value)
+{
+    X509V3_CTX ctx;
+    X509V3_set_ctx_nodb(&ctx);
+    X509V3_set_ctx(&ctx, cert, cert, nullptr, nullptr, 0);
+    X509_EXTENSION* extension = X509V3_EXT_conf_nid(nullptr, &ctx, nid, value.c_str());
+    if (extension == nullptr) return false;
+    bool added = X509_add_ext(cert, extension, -1) == 1;
+    X509_EXTENSION_free(extension);
+    return added;
+}
+
+static bool generateCertificate(const std::string& certPath, const std::string& keyPath, int validDays)
+{
+    // P-256 signs an order of magnitude faster than RSA-2048 on a Cortex-A53
+    EVP_PKEY* rawKey = nullptr;
+    EVP_PKEY_CTX* keyCtx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    bool generated = keyCtx != nullptr &&
+                     EVP_PKEY_keygen_init(keyCtx) == 1 &&
+                     EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyCtx, NID_X9_62_prime256v1) == 1 &&
+                     EVP_PKEY_keygen(keyCtx, &rawKey) == 1;
+    EVP_PKEY_CTX_free(keyCtx);
+    KeyPtr key(rawKey, EVP_PKEY_free);
+    if (!generated)
+    {
+        LOG_ERROR("Could not generate a TLS key: {}", sslError());
+        return false;
+    }
+
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+
+    X509Ptr cert(X509_new(), X509_free);
+    BIGNUM* serial = BN_new();
+    bool built = cert != nullptr && serial != nullptr &&
+                 X509_set_version(cert.get(), 2) == 1 &&
+                 BN_rand(serial, 63, BN_RAND_TOP_ANY, BN_RAND_BOTTOM_ANY) == 1 &&
+                 BN_to_ASN1_INTEGER(serial, X509_get_serialNumber(cert.get())) != nullptr &&
+                 X509_gmtime_adj(X509_getm_notBefore(cert.get()), -3600) != nullptr &&
+                 X509_gmtime_adj(X509_getm_notAfter(cert.get()), validDays * 86400L) != nullptr &&
+                 X509_set_pubkey(cert.get(), key.get()) == 1 &&
+                 X509_NAME_add_entry_by_NID(X509_get_subject_name(cert.get()), NID_commonName, MBSTRING_ASC,
+                                            (const unsigned char*)SELF_SIGNED_NAME, -1, -1, 0) == 1 &&
+                 X509_set_issuer_name(cert.get(), X509_get_subject_name(cert.get())) == 1 &&
+                 addExtension(cert.get(), NID_basic_constraints, "critical,CA:FALSE") &&
+                 addExtension(cert.get(), NID_subject_alt_name,
+                              std::string("DNS:localhost,IP:127.0.0.1") + (host[0] ? std::string(",DNS:") + host + ",DNS:" + host + ".local" : "")) &&
+                 X509_sign(cert.get(), key.get(), EVP_sha256()) > 0;
+    BN_free(serial);
+    if (!built)
+    {
+        LOG_ERROR("Could not build a self-signed certificate: {}", sslError());
+        return false;
+    }
+
+    for (const auto& path : {certPath, keyPath})
+    {
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        std::error_code error;
+        if (!parent.empty()) std::filesystem::create_directories(parent, error);
+    }
+
+    // Key first, a new certificate without its key is useless
+    if (!writePem(keyPath, 0600, [&](FILE* file) { return PEM_write_PrivateKey(file, key.get(), nullptr, nullptr, 0, nullptr, nullptr); }) ||
+        !writePem(certPath, 0644, [&](FILE* file) { return PEM_write_X509(file, cert.get()); }))
+    {
+        LOG_ERROR("Could not write the self-signed certificate to {} and {}.", certPath, keyPath);
+        return false;
+    }
+    LOG_INFO("Generated a self-signed certificate valid for {} days in {}.", validDays, certPath);
+    return true;
+}
+
+bool TlsSetup::EnsureCertificate(const std::string& certPath, const std::string& keyPath, int validDays, int renewDays)
+{
+    X509Ptr cert = readCertificate(certPath);
+    KeyPtr key = readKey(keyPath);
+    if (cert == nullptr && key == nullptr)
+    {
+        return generateCertificate(certPath, keyPath, validDays);
+    }
+    if (cert == nullptr || key == nullptr)
+    {
+        // Half a pair is only ours to fix if the half that's there is ours
+        if (cert != nullptr && isSelfSigned(cert.get()))
+        {
+            return generateCertificate(certPath, keyPath, validDays);
+        }
+        LOG_ERROR("TLS needs both {} and {}.", certPath, keyPath);
+        return false;
+    }
+
+    bool matches = X509_check_private_key(cert.get(), key.get()) == 1;
+    time_t renewAt = time(nullptr) + renewDays * 86400L;
+    bool expiring = X509_cmp_time(X509_get0_notAfter(cert.get()), &renewAt) < 0;
+    if (!isSelfSigned(cert.get()))
+    {
+        if (!matches)
+        {
+            LOG_ERROR("The TLS key {} does not belong to {}.", keyPath, certPath);
+            return false;
+        }
+        if (expiring)
+        {
+            LOG_WARNING("The TLS certificate {} expires within {} days.", certPath, renewDays);
+        }
+        return true;
+    }
+    if (!matches || expiring)
+    {
+        LOG_INFO("Replacing the self-signed certificate in {}.", certPath);
+        return generateCertificate(certPath, keyPath, validDays);
+    }
+    return true;
+}
+
+bool TlsSetup::ConfigureServer(SSL_CTX& ctx, const std::string& certPath, const std::string& keyPath,
+                               long sessionCacheSize, long sessionTimeoutSec)
+{
+    if (SSL_CTX_use_certificate_chain_file(&ctx, certPath.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(&ctx, keyPath.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(&ctx) != 1)
+    {
+        LOG_ERROR("Could not load the TLS certificate {}: {}", certPath, sslError());
+        return false;
+    }
+
+    SSL_CTX_set_min_proto_version(&ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(&ctx, SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_NO_COMPRESSION | SSL_OP_NO_RENEGOTIATION);
+    if (SSL_CTX_set_cipher_list(&ctx, TLS12_CIPHERS) != 1 ||
+        SSL_CTX_set_ciphersuites(&ctx, TLS13_CIPHERS) != 1 ||
+        SSL_CTX_set1_groups_list(&ctx, "X25519:P-256") != 1)
+    {
+        LOG_ERROR("Could not set the TLS ciphers: {}", sslError());
+        return false;
+    }
+
+    // Resumption skips the key exchange and signature: TLS 1.2 clients use
+    // the session cache or a ticket, TLS 1.3 clients a ticket. Ticket keys
+    // are random per start, so a restart costs everyone one full handshake.
+    static const unsigned char sessionContext[] = "silvanus";
+    SSL_CTX_set_session_id_context(&ctx, sessionContext, sizeof(sessionContext) - 1);
+    SSL_CTX_set_session_cache_mode(&ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(&ctx, sessionCacheSize);
+    SSL_CTX_set_timeout(&ctx, sessionTimeoutSec);
+    SSL_CTX_clear_options(&ctx, SSL_OP_NO_TICKET);
+    // One ticket per full handshake is enough for a browser polling the API
+    SSL_CTX_set_num_tickets(&ctx, 1);
+    return true;
+}
@@ -1,24 +1,26 @@
 #include "ConfigService.hpp"
 static auto& config = ConfigService::global;
+#include "ApiRoutes.hpp"
+#include "FleetAggregator.hpp"
+#include "FleetAnnouncer.hpp"
+#include "FleetRoutes.hpp"
+#include "FrontEndRoutes.hpp"
+#include "HardwareDaemon.hpp"
 #include "HttpService.hpp"
+#include "Log.hpp"
+#include "PlantSchedule.hpp"
+#include "RuleEngine.hpp"
+#include "SceneTable.hpp"
 #include "Silvanus.hpp"
+#include "ThreadTuning.hpp"
 
+#include <cstdio>
+#include <memory>
+#include <string>
 #include <unistd.h>
 #include <signal.h>
 #include <thread>
-#include <algorithm>
-#include <map>
-#include <string>
-#include <vector>
-#include <iostream>
 #include <chrono>
-#include <ctime>
-
-#include <nlohmann/json.hpp>
-#include <fmt/format.h>
-#include <sigslot/signal.hpp>
-
-using json = nlohmann::json;
 
 volatile bool interrupt_received = false;
 volatile bool internal_exit = false;
@@ -28,75 +30,55 @@ static void InterruptHandler(int signo)
     interrupt_received = true;
 }
 
-std::chrono::system_clock::time_point timeAtMidnight()
+// Let fleet aggregators find the node if it is enabled
+static std::unique_ptr<FleetAnnouncer> announce(HttpService& httpService)
 {
-    auto now = std::chrono::system_clock::now();
-    time_t tnow = std::chrono::system_clock::to_time_t(now);
-    tm *date = std::localtime(&tnow);
-    date->tm_hour = 0;
-    date->tm_min = 0;
-    date->tm_sec = 0;
-    return std::chrono::system_clock::from_time_t(std::mktime(date));;
+    // Announcing cannot be toggled at runtime so no need to subscribe
+    if (!config.GetConfigValue("fleetAnnounce", false))
+    {
+        return nullptr;
+    }
+    return std::make_unique<FleetAnnouncer>(httpService.Port());
 }
 
-std::chrono::system_clock::duration timeSinceMidnight() 
+// Split mode web process: serves the API without touching the hardware
+static int runFrontEnd()
 {
-    auto now = std::chrono::system_clock::now();
+    // The link name cannot change so no need to subscribe
+    HardwareLink link(config.GetConfigValue("hardwareLink", std::string("/silvanus-link")), HardwareLink::Role::FrontEnd);
+    HttpService httpService;
+    RegisterFrontEndRoutes(httpService, link, []()
+    {
+        internal_exit = true;
+    });
+    auto announcer = announce(httpService);
 
-    time_t tnow = std::chrono::system_clock::to_time_t(now);
-    tm *date = std::localtime(&tnow);
-    date->tm_hour = 0;
-    date->tm_min = 0;
-    date->tm_sec = 0;
-    auto midnight = std::chrono::system_clock::from_time_t(std::mktime(date));
+    while (!interrupt_received && !internal_exit)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
 
-    return now-midnight;
+    LOG_INFO("Web front end exiting.");
+    Log::Flush();
+    return 0;
 }
 
-void primeLight(std::chrono::system_clock::time_point& thisEval, 
-                std::chrono::system_clock::time_point& lastEval, 
-                int lightTime,
-                int lightInterval,
-                Silvanus& silvanus)
+// Fleet mode: no hardware, polls other nodes and serves the merged view
+static int runAggregator()
 {
-    // Start up
-    thisEval = std::chrono::system_clock::now();
+    FleetAggregator fleet;
+    HttpService httpService;
+    RegisterFleetRoutes(httpService, fleet);
+    config.SaveConfig();
 
-    // Prime the light (so that we don't lose a day's sunlight if the system reboots)
-    // Figure out if the light should be on right now (and then turn it on)
+    while (!interrupt_received && !internal_exit)
     {
-        auto todaysLightOn = timeAtMidnight() + std::chrono::seconds(lightTime);
-        auto todaysLightOff = todaysLightOn + std::chrono::seconds(lightInterval);
-        auto yesterdaysLightOn = todaysLightOn - std::chrono::hours(24);
-        auto yesterdaysLightOff = todaysLightOff - std::chrono::hours(24);
-        
-        if (thisEval >= yesterdaysLightOn && thisEval < yesterdaysLightOff)
-        {
-            auto timeRemaining = yesterdaysLightOff - thisEval;
-            silvanus.PulseLight(std::chrono::duration_cast<std::chrono::seconds>(timeRemaining));
-            #ifndef PI_HOST
-            std::cout << "[Simulator] Yesterday's sunlight period was ongoing at startup." << std::endl;
-            #endif
-        }
-        else if (thisEval >= todaysLightOn && thisEval < todaysLightOff)
-        {
-            auto timeRemaining = todaysLightOff - thisEval;
-            silvanus.PulseLight(std::chrono::duration_cast<std::chrono::seconds>(timeRemaining));
-            #ifndef PI_HOST
-            std::cout << "[Simulator] Today's sunlight period was ongoing at startup." << std::endl;
-            #endif
-        }
-        else
-        {
-            silvanus.SetLight(false);
-            #ifndef PI_HOST
-            std::cout << "[Simulator] No sunlight period ongoing, light remains off." << std::endl;
-            #endif
-        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
     }
 
-    // Setup the lastEval to the time evaluated for the light on/off priming logic
-    lastEval = thisEval;
+    LOG_INFO("Fleet aggregator exiting.");
+    Log::Flush();
+    return 0;
 }
 
 int main(int argc, char *argv[])
@@ -105,188 +87,116 @@ int main(int argc, char *argv[])
     signal(SIGTERM, InterruptHandler);
     signal(SIGINT, InterruptHandler);
 
+    // No argument runs everything in one process, or split it into a
+    // privileged hardware daemon and an unprivileged web front end.
+    // The aggregator watches a fleet of other nodes instead.
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (!mode.empty() && mode != "--hardware-daemon" && mode != "--web-frontend" && mode != "--aggregator")
+    {
+        fprintf(stderr, "Usage: Silvanus [--hardware-daemon | --web-frontend | --aggregator]\n");
+        return 1;
+    }
+
     // Init the config service here (since doing it in static init is disallowed)
     // and because lots of components rely on its basic vars being set
     config.Init();
 
-    Silvanus silvanus;
-
-    // Plant watering parameters
-    int lightTime = 25200; // When the light should turn on (seconds after local midnight)
-    int lightInterval = 43200; // How long the light should run (seconds)
-    int waterTime = 25200; // When to water the plants (seconds after local midnight)
-    float waterFlowRate = 1.3f; // milliliters per second
-    float waterAmountPerDay = 100.0f; // milliliters
-    std::chrono::system_clock::time_point thisEval, lastEval;
-
-    // Subscribe to settings changes (this also runs the lambda once before subscribing)
-    config.Subscribe([&](const ConfigUpdateEventArg& arg)
-    {
-        arg.UpdateIfChanged("waterTime", waterTime, 25200);
-        arg.UpdateIfChanged("waterFlowRate", waterFlowRate, 1.3f);
-        arg.UpdateIfChanged("waterAmountPerDay", waterAmountPerDay, 100.0f);
-        arg.UpdateIfChanged("lightTime", lightTime, 25200); // default 7 AM
-        arg.UpdateIfChanged("lightInterval", lightInterval, 43200); // default 12 hours
-    });
-
-    // Add the HTTP service to serve web requests
-    HttpService httpService;
-    httpService.Server().Post("/system/restart", [=](const httplib::Request& req, httplib::Response& res) 
-    {
-        internal_exit = true;
-    });
-
-    httpService.Server().Patch("/system/settings", [&](const httplib::Request& req, httplib::Response& res) 
+    // Keep off the core reserved for Silvanus' pulse thread before starting
+    // any threads, they all inherit this. The log writer is already running
+    // so it is moved explicitly. Cannot change so no need to subscribe.
+    int actuatorCpu = config.GetConfigValue("actuatorCpu", -1);
+    if (actuatorCpu >= 0 && !(ThreadTuning::AvoidCpu(actuatorCpu) && Log::AvoidCpu(actuatorCpu)))
     {
-        auto settingsPatch = json::parse(req.body);
-
-        for (auto& kvp : settingsPatch.items())
-        {
-            if (!config.HasKey(kvp.key()))
-            {
-                res.status = 400;
-                res.body = fmt::format("Bad patch request, settings key {} is invalid.", kvp.key());
-                return;
-            }
-
-            if (!config.ValueTypeMatches(kvp.key(), kvp.value()))
-            {
-                res.status = 400;
-                res.body = fmt::format("Bad patch request, value {} was an incorrect type.", kvp.key());
-                return;
-            }
-        }
-
-        for (auto& kvp : settingsPatch.items())
-        {
-            config.SetConfigValue(kvp.key(), kvp.value());
-        }
-
-        // Save the changed config and determine if the 
-        config.SaveConfig();
-        primeLight(thisEval, lastEval, lightTime, lightInterval, silvanus);
-    });
-
-    httpService.Server().Get("/system/settings", [=](const httplib::Request& req, httplib::Response& res) 
-    {
-        std::stringstream ss;
-        ss << std::setw(4) << config.GetConfigJson();
-        res.body = ss.str();
-    });
-
-    httpService.Server().Get("/status", [&](const httplib::Request& req, httplib::Response& res) 
-    {
-        auto status = json::object();
-        status["temperature"] = silvanus.GetTemperature();
-        status["humidity"] = silvanus.GetHumidity();
-        status["light-on"] = silvanus.GetLight();
-        status["pump-on"] = silvanus.GetPump();
-        std::stringstream ss;
-        ss << std::setw(4) << status;
-        res.body = ss.str();
-    });
+        LOG_WARNING("Could not reserve CPU {} for the pulse thread.", actuatorCpu);
+    }
 
-    httpService.Server().Post("/water-now", [&](const httplib::Request& req, httplib::Response& res) 
+    // Runtime log threshold, anything below SILVANUS_LOG_LEVEL is compiled out regardless
+    LogLevel logLevel;
+    if (Log::ParseLevel(config.GetConfigValue("logLevel", std::string("info")), logLevel))
     {
-        silvanus.PulsePump(std::chrono::seconds((int)(waterAmountPerDay * waterFlowRate)));
-    });
+        Log::SetLevel(logLevel);
+    }
 
-    httpService.Server().Post("/auto-light", [&](const httplib::Request& req, httplib::Response& res) 
+    if (mode == "--web-frontend")
     {
-        // Evaluate if the light should be on already
-        // Resets the light behavior to auto
-        primeLight(thisEval, lastEval, lightTime, lightInterval, silvanus);
-    });
-
-    httpService.Server().Put("/light", [&](const httplib::Request& req, httplib::Response& res) 
+        return runFrontEnd();
+    }
+    if (mode == "--aggregator")
     {
-        auto body = json::parse(req.body);
-        if (body.is_boolean())
-        {
-            silvanus.SetLight(body.get<bool>());
-        }
-        else
-        {
-            res.status = 401;
-            res.body = "Error: Endpoint /light expects json bool value.";
-        }
-    });
+        return runAggregator();
+    }
 
-    httpService.Server().Get("/light", [&](const httplib::Request& req, httplib::Response& res) 
+    Silvanus silvanus;
+    PlantSchedule schedule(silvanus);
+    SceneTable scenes(silvanus);
+    RuleEngine rules(silvanus, scenes);
+
+    // Serve web requests ourselves, or the web front end's commands as the hardware daemon
+    std::unique_ptr<HttpService> httpService;
+    std::unique_ptr<HardwareDaemon> daemon;
+    std::unique_ptr<FleetAnnouncer> announcer;
+    if (mode == "--hardware-daemon")
     {
-        json body = silvanus.GetLight();
-        std::stringstream ss;
-        ss << std::setw(4) << body;
-        res.body = ss.str();
-    });
-
-    httpService.Server().Put("/pump", [&](const httplib::Request& req, httplib::Response& res) 
+        daemon = std::make_unique<HardwareDaemon>(silvanus, schedule, scenes);
+    }
+    else
     {
-        auto body = json::parse(req.body);
-        if (body.is_boolean())
-        {
-            silvanus.SetPump(body.get<bool>());
-        }
-        else
+        httpService = std::make_unique<HttpService>();
+        RegisterApiRoutes(*httpService, silvanus, schedule, scenes, rules, []()
         {
-            res.status = 401;
-            res.body = "Error: Endpoint /pump expects json bool value.";
-        }
-    });
-
-    httpService.Server().Get("/pump", [&](const httplib::Request& req, httplib::Response& res) 
-    {
-        json body = silvanus.GetPump();
-        std::stringstream ss;
-        ss << std::setw(4) << body;
-        res.body = ss.str();
-    });
+            internal_exit = true;
+        });
+        announcer = announce(*httpService);
+    }
 
     // Save the config after startup
     config.SaveConfig();
 
     // Evaluate if the light should be on already
-    primeLight(thisEval, lastEval, lightTime, lightInterval, silvanus);
+    schedule.Prime();
+    // Water now if we were down when the plants should have been watered
+    schedule.CatchUp();
+    // Pick manual pulses back up after a restart
+    silvanus.ResumePulses();
+
+    // The sample rate cannot change so no need to subscribe
+    auto sampleInterval = std::chrono::seconds(config.GetConfigValue("sampleInterval", 60));
+    auto nextSample = std::chrono::steady_clock::now();
 
     // Start the main logic loop
     while (!interrupt_received && !internal_exit)
     {
-        thisEval = std::chrono::system_clock::now();
-        auto midnight = timeAtMidnight();
-        auto todaysLightOn = midnight + std::chrono::seconds(lightTime);
-        auto todaysPumpOn = midnight + std::chrono::seconds(waterTime);
+        schedule.Evaluate();
 
-        if (todaysLightOn > lastEval && todaysLightOn <= thisEval)
+        if (std::chrono::steady_clock::now() >= nextSample)
         {
-            #ifndef PI_HOST
-            std::cout << "[Simulator] Starting sun period." << std::endl;
-            #endif
-            silvanus.PulseLight(std::chrono::seconds(lightInterval));
+            float temperature, humidity;
+            silvanus.Sample(temperature, humidity);
+            silvanus.History().Record(std::chrono::system_clock::now(), temperature, humidity);
+            rules.OnSample(temperature, humidity);
+            nextSample += sampleInterval;
         }
-        if (todaysPumpOn > lastEval && todaysPumpOn <= thisEval)
+        if (daemon != nullptr)
         {
-            #ifndef PI_HOST
-            std::cout << "[Simulator] Starting rain period." << std::endl;
-            #endif
-            silvanus.PulsePump(std::chrono::seconds((int)(waterAmountPerDay * waterFlowRate)));
+            daemon->Publish();
         }
 
         // Regulate update rate
         std::this_thread::sleep_for(std::chrono::seconds(1));
-        lastEval = thisEval;
     }
 
     config.SaveConfig();
 
     if (interrupt_received)
     {
-        fprintf(stderr, "Main thread caught exit signal.\n");
+        LOG_INFO("Main thread caught exit signal.");
     }
 
     if (internal_exit)
     {
-        fprintf(stderr, "Main thread got internal exit request.\n");
+        LOG_INFO("Main thread got internal exit request.");
     }
 
+    Log::Flush();
     return 0;
 }